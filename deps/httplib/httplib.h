@@ -1658,6 +1658,12 @@ private:
 
   long verify_result_ = 0;
 
+  // iProgramInCpp
+  // Last session negotiated with the server, offered again on reconnect so that a
+  // dropped keep-alive connection can resume instead of doing a full handshake.
+  void remember_session(SSL *ssl);
+  SSL_SESSION *session_ = nullptr;
+
   friend class ClientImpl;
 };
 #endif
@@ -7852,6 +7858,23 @@ inline SSLClient::~SSLClient() {
   // base function rather than the derived function once we get to the
   // base class destructor, and won't free the SSL (causing a leak).
   shutdown_ssl_impl(socket_, true);
+  if (session_) { SSL_SESSION_free(session_); } // iProgramInCpp
+}
+
+// iProgramInCpp
+inline void SSLClient::remember_session(SSL *ssl) {
+  if (!SSL_is_init_finished(ssl)) { return; }
+  auto session = SSL_get1_session(ssl);
+  if (!session) { return; }
+#if OPENSSL_VERSION_NUMBER >= 0x10101000L
+  // With TLS 1.3 the ticket only shows up after the handshake
+  if (!SSL_SESSION_is_resumable(session)) {
+    SSL_SESSION_free(session);
+    return;
+  }
+#endif
+  if (session_) { SSL_SESSION_free(session_); }
+  session_ = session;
 }
 
 inline bool SSLClient::is_valid() const { return ctx_; }
@@ -7976,6 +7999,8 @@ inline bool SSLClient::initialize_ssl(Socket &socket, Error &error) {
           SSL_set_verify(ssl2, SSL_VERIFY_NONE, nullptr);
         }
 
+        if (session_) { SSL_set_session(ssl2, session_); } // iProgramInCpp
+
         if (!detail::ssl_connect_or_accept_nonblocking(
                 socket.sock, ssl2, SSL_connect, connection_timeout_sec_,
                 connection_timeout_usec_)) {
@@ -8034,6 +8059,7 @@ inline void SSLClient::shutdown_ssl_impl(Socket &socket,
     return;
   }
   if (socket.ssl) {
+    remember_session(socket.ssl); // iProgramInCpp
     detail::ssl_delete(ctx_mutex_, socket.ssl, shutdown_gracefully);
     socket.ssl = nullptr;
   }
@@ -7,9 +7,17 @@
 #include "utils/Util.hpp"
 #include "Frontend.hpp"
 #include "network/HTTPClient.hpp"
+#include "network/GatewayEventQueue.hpp"
+#include "state/MessageStore.hpp"
 #include "config/DiscordClientConfig.hpp"
 
+#ifdef ZLIB_SUP
+#define DISCORD_WSS_DETAILS "?encoding=json&v=" DISCORD_API_VERSION "&compress=zlib-stream"
+#define DISCORD_WSS_ZLIB true
+#else
 #define DISCORD_WSS_DETAILS "?encoding=json&v=" DISCORD_API_VERSION
+#define DISCORD_WSS_ZLIB false
+#endif
 
 #ifndef _DEBUG
 #define TRY try
@@ -32,34 +40,6 @@ Snowflake CreateTemporarySnowflake()
 	return sf;
 }
 
-std::string GetStatusStringFromGameJsonObject(Json& game)
-{
-	std::string dump = game.dump();
-
-	if (!game.contains("type") || !game["type"].is_number_integer()) {
-		DbgPrintF("Returning nothing because type didn't exist");
-		return "";
-	}
-
-	int type = game["type"];
-	switch (type) {
-		default:
-			return "";
-		case ACTIVITY_PLAYING:
-			return "Playing " + GetFieldSafe(game, "name");
-		case ACTIVITY_STREAMING:
-			return "Streaming " + GetFieldSafe(game, "details");
-		case ACTIVITY_LISTENING:
-			return "Listening to " + GetFieldSafe(game, "name");
-		case ACTIVITY_WATCHING:
-			return "Watching " + GetFieldSafe(game, "name");
-		case ACTIVITY_COMPETING:
-			return "Competing";
-		case ACTIVITY_CUSTOM_STATUS:
-			return GetFieldSafe(game, "state");
-	}
-}
-
 void DebugResponse(NetRequest* pReq)
 {
 	//std::string str = std::to_string(pReq->result) + ": \"" + pReq->response + "\"\n";
@@ -75,6 +55,7 @@ void DiscordInstance::OnFetchedChannels(Guild* pGld, const std::string& content)
 {
 	Json j = Json::parse(content);
 
+	UnindexGuildChannels(*pGld);
 	pGld->m_channels.clear();
 
 	Snowflake chan = 0;
@@ -92,6 +73,8 @@ void DiscordInstance::OnFetchedChannels(Guild* pGld, const std::string& content)
 	pGld->m_bChannelsLoaded = true;
 	pGld->m_currentChannel = chan;
 
+	IndexGuildChannels(*pGld);
+
 	GetFrontend()->UpdateSelectedGuild();
 }
 
@@ -556,15 +539,15 @@ void DiscordInstance::HandleRequest(NetRequest* pRequest)
 
 					GetFrontend()->OnFailedToSendMessage(m_CurrentChannel, nonce);
 
-					Message msg;
-					msg.m_type = MessageType::DEFAULT;
-					msg.m_snowflake = nonce + 1;
-					msg.m_author_snowflake = 1; // *1
-					msg.m_author = "Clyde";
-					msg.m_message = "Your message could not be delivered. This is usually because you don't share a server "
+					MessagePtr msg = MakeMessage();
+					msg->m_type = MessageType::DEFAULT;
+					msg->m_snowflake = nonce + 1;
+					msg->m_author_snowflake = 1; // *1
+					msg->m_author = "Clyde";
+					msg->m_message = "Your message could not be delivered. This is usually because you don't share a server "
 						"with the recipient or the recipient is only accepting direct messages from friends. You can see th"
 						"e full list of reasons here: https://support.discord.com/hc/en-us/articles/360060145013";
-					msg.SetTime(time(NULL));
+					msg->SetTime(time(NULL));
 
 					// *1 - I checked, the official Discord client also does that :)
 					GetFrontend()->OnAddMessage(m_CurrentChannel, msg);
@@ -735,7 +718,7 @@ void DiscordInstance::HandleRequest(NetRequest* pRequest)
 			case GUILDS:
 			{
 				// reload guild DB
-				m_guilds.clear();
+				ClearGuilds();
 				
 				for (auto& elem : j)
 					ParseAndAddGuild(elem);
@@ -832,10 +815,20 @@ void DiscordInstance::GatewayClosed(int errorCode)
 		case websocketpp::close::status::going_away:
 		case websocketpp::close::status::service_restart:
 		case websocketpp::close::status::normal:
+		case CloseCode::UNKNOWN_ERROR:
 		case CloseCode::LOG_ON_AGAIN:
+		{
+			// The session is still alive on Discord's end, so try to pick it back up.
+			m_bResumePending = CanResumeSession();
+			GetFrontend()->OnLoginAgain();
+			break;
+		}
 		case CloseCode::INVALID_SEQ:
 		case CloseCode::SESSION_TIMED_OUT:
 		{
+			// These need a brand new session.
+			m_bResumePending = false;
+			m_sessionId.clear();
 			GetFrontend()->OnLoginAgain();
 			break;
 		}
@@ -853,14 +846,34 @@ void DiscordInstance::GatewayClosed(int errorCode)
 	}
 }
 
+bool DiscordInstance::CanResumeSession() const
+{
+	return !m_sessionId.empty() && !m_gatewayResumeUrl.empty() && m_heartbeatSequenceId >= 0;
+}
+
 void DiscordInstance::StartGatewaySession()
 {
 	GetFrontend()->OnConnecting();
 
-	if (m_gatewayConnId)
-		GetWebsocketClient()->Close(m_gatewayConnId, websocketpp::close::status::normal);
+	// m_bResumePending stays set until RESUME is sent, in case this connection fails too.
+	m_bResuming = m_bResumePending && CanResumeSession();
+
+	// N.B. Closing with a normal close code invalidates the session on Discord's end.
+	if (m_gatewayConnId >= 0)
+		GetWebsocketClient()->Close(m_gatewayConnId, m_bResuming ? websocketpp::close::status::value(CloseCode::UNKNOWN_ERROR) : websocketpp::close::status::normal);
+
+	std::string url = m_gatewayUrl;
+
+	if (m_bResuming)
+	{
+		url = m_gatewayResumeUrl;
+		if (url[url.size() - 1] != '/')
+			url += '/';
+
+		DbgPrintF("Resuming session %s from sequence %d", m_sessionId.c_str(), m_heartbeatSequenceId);
+	}
 
-	int connID = GetWebsocketClient()->Connect(m_gatewayUrl + DISCORD_WSS_DETAILS);
+	int connID = GetWebsocketClient()->Connect(url + DISCORD_WSS_DETAILS, DISCORD_WSS_ZLIB);
 
 	if (connID < 0)
 		GetFrontend()->OnGatewayConnectFailure();
@@ -1209,15 +1222,29 @@ std::string DiscordInstance::ReverseMentions(const std::string& message, Snowfla
 }
 
 typedef void(DiscordInstance::*DispatchFunction)(Json& j);
+typedef void(*ApplyFunction)(DiscordInstance* pThis, GatewayEventData& data);
 
 std::map <std::string, DispatchFunction> g_dispatchFunctions;
+std::map <std::string, ApplyFunction> g_applyFunctions; // for dispatches digested on the websocket thread
 void DiscordInstance::HandleGatewayMessage(const std::string& payload)
 {
-	DbgPrintF("Got Payload: %s [PAYLOAD ENDS HERE]", payload.c_str());
+	GatewayEvent ev;
+	if (!GatewayEvent::Digest(m_gatewayConnId, payload, ev))
+		return;
+
+	HandleGatewayEvent(ev);
+}
+
+void DiscordInstance::HandleGatewayEvent(GatewayEvent& ev)
+{
+	if (ev.m_bClosed) {
+		GatewayClosed(ev.m_closeCode);
+		return;
+	}
 
-	Json j = Json::parse(payload);
+	Json& j = ev.m_json;
 
-	int op = j["op"];
+	int op = ev.m_opcode;
 	using namespace GatewayOp;
 	switch (op)
 	{
@@ -1225,29 +1252,11 @@ void DiscordInstance::HandleGatewayMessage(const std::string& payload)
 		{
 			GetFrontend()->SetHeartbeatInterval(j["d"]["heartbeat_interval"]);
 
-			// hello packet - send an identification back
-			Json jout;
-			jout["op"] = IDENTIFY;
-
-			Json data, presenceData, propertiesData;
-			data["token"] = m_token;
-			data["compress"] = false;
-			// note: real Discord client sends "capabilities" field, undocumented so not gonna bother really
-			data["capabilities"] = 16381;
-
-			presenceData["activities"] = Json::array();
-			presenceData["afk"] = false;
-			presenceData["broadcast"] = nullptr;
-			presenceData["since"] = 0;
-			presenceData["status"] = "online";
-
-			propertiesData = GetClientConfig()->Serialize();
-
-			data["presence"] = presenceData;
-			data["properties"] = propertiesData;
-			jout["d"] = data;
-
-			GetWebsocketClient()->SendMsg(m_gatewayConnId, jout.dump());
+			// hello packet - send an identification back, or pick up where we left off
+			if (m_bResuming)
+				SendResume();
+			else
+				SendIdentify();
 
 			// send a heartbeat too, we'd like to keep things simple
 			SendHeartbeat();
@@ -1259,15 +1268,57 @@ void DiscordInstance::HandleGatewayMessage(const std::string& payload)
 			DbgPrintF("Heartbeat acknowledged");
 			break;
 		}
+		case RECONNECT:
+		{
+			// Discord wants us to move elsewhere.  The session stays valid, so resume it.
+			DbgPrintF("Gateway asked us to reconnect");
+			m_bResumePending = CanResumeSession();
+			StartGatewaySession();
+			break;
+		}
+		case INVALID_SESSION:
+		{
+			// If "d" is true the session is still alive and may be resumed, otherwise start over.
+			// Either way, Discord wants us to wait 1 to 5 seconds before trying again.
+			bool bResumable = j["d"].is_boolean() && j["d"].get<bool>();
+			int delayMs = 1000 + rand() % 4001;
+			DbgPrintF("Invalid session (resumable: %d), reconnecting in %d ms", bResumable, delayMs);
+
+			m_bResumePending = bResumable && CanResumeSession();
+			if (!m_bResumePending) {
+				m_sessionId.clear();
+				m_heartbeatSequenceId = -1;
+			}
+
+			// N.B. Closing with a normal close code invalidates the session on Discord's end.
+			GetWebsocketClient()->Close(m_gatewayConnId, m_bResumePending ? websocketpp::close::status::value(CloseCode::UNKNOWN_ERROR) : websocketpp::close::status::normal);
+			m_gatewayConnId = -1;
+			m_bResuming = false;
+
+			GetFrontend()->ReconnectGatewayIn(delayMs);
+			break;
+		}
 		case DISPATCH:
 		{
-			if (!j.contains("t")) {
+			if (ev.m_type.empty()) {
 				DbgPrintF("Error, dispatch opcode doesn't contain type");
 				break;
 			}
 
-			std::string dispatchCode = j["t"];
-			m_heartbeatSequenceId = j["s"];
+			const std::string& dispatchCode = ev.m_type;
+			m_heartbeatSequenceId = ev.m_sequence;
+
+			// Already turned into records, there's no DOM left
+			if (ev.m_pData)
+			{
+				ApplyFunction af = g_applyFunctions[dispatchCode];
+				if (af)
+					af(this, *ev.m_pData);
+				else
+					DbgPrintF("ERROR: Nothing applies digested dispatch %s", dispatchCode.c_str());
+
+				break;
+			}
 
 			DispatchFunction df = g_dispatchFunctions[dispatchCode];
 			if (!df)
@@ -1276,6 +1327,12 @@ void DiscordInstance::HandleGatewayMessage(const std::string& payload)
 				break;
 			}
 
+			// READY's guilds and read states were already taken out of the DOM
+			if (ev.m_pReady) {
+				ApplyREADY(j, *ev.m_pReady);
+				break;
+			}
+
 			//yeah.
 			(this->*df)(j);
 
@@ -1289,6 +1346,50 @@ void DiscordInstance::HandleGatewayMessage(const std::string& payload)
 	}
 }
 
+void DiscordInstance::SendIdentify()
+{
+	using namespace GatewayOp;
+	Json jout;
+	jout["op"] = IDENTIFY;
+
+	Json data, presenceData, propertiesData;
+	data["token"] = m_token;
+	data["compress"] = false;
+	// note: real Discord client sends "capabilities" field, undocumented so not gonna bother really
+	data["capabilities"] = 16381;
+
+	presenceData["activities"] = Json::array();
+	presenceData["afk"] = false;
+	presenceData["broadcast"] = nullptr;
+	presenceData["since"] = 0;
+	presenceData["status"] = "online";
+
+	propertiesData = GetClientConfig()->Serialize();
+
+	data["presence"] = presenceData;
+	data["properties"] = propertiesData;
+	jout["d"] = data;
+
+	GetWebsocketClient()->SendMsg(m_gatewayConnId, jout.dump());
+	m_bResumePending = false;
+}
+
+void DiscordInstance::SendResume()
+{
+	using namespace GatewayOp;
+	Json jout;
+	jout["op"] = RESUME;
+
+	Json data;
+	data["token"] = m_token;
+	data["session_id"] = m_sessionId;
+	data["seq"] = m_heartbeatSequenceId;
+	jout["d"] = data;
+
+	GetWebsocketClient()->SendMsg(m_gatewayConnId, jout.dump());
+	m_bResumePending = false;
+}
+
 void DiscordInstance::SendHeartbeat()
 {
 	DbgPrintF("Sending heartbeat");
@@ -1694,14 +1795,17 @@ void DiscordInstance::ResetGatewayURL()
 void DiscordInstance::ClearData()
 {
 	CloseGatewaySession();
+	GetGatewayEventQueue()->Clear();
 
-	m_guilds.clear();
 	m_dmGuild.m_channels.clear();
+	ClearGuilds();
 	m_messageRequestsInProgress.clear();
 	m_gatewayUrl.clear();
 	m_gatewayResumeUrl.clear();
 	m_sessionId.clear();
 	m_sessionType.clear();
+	m_bResumePending = false;
+	m_bResuming = false;
 	m_pendingUploads.clear();
 	m_channelHistory.Clear();
 	m_userGuildSettings.Clear();
@@ -1709,6 +1813,7 @@ void DiscordInstance::ClearData()
 	m_relationships.clear();
 
 	m_mySnowflake = 0;
+	GetMessageStore()->SetUser(0);
 	m_CurrentGuild = 0;
 	m_CurrentChannel = 0;
 	m_gatewayConnId = -1;
@@ -1936,19 +2041,18 @@ void DiscordInstance::ParsePermissionOverwrites(Channel& channel, nlohmann::json
 	}
 }
 
-void DiscordInstance::ParseReadStateObject(nlohmann::json& readState, bool bAlternate)
+void DiscordInstance::ApplyReadState(const ReadStateEntry& entry)
 {
-	Snowflake id = GetSnowflake(readState, bAlternate ? "channel_id" : "id");
-	Snowflake lastMessageId = GetSnowflake(readState, bAlternate ? "message_id" : "last_message_id");
-	int flags = GetFieldSafeInt(readState, "flags");
-	int lastViewed = GetFieldSafeInt(readState, "last_viewed");
-	int mentionCount = GetFieldSafeInt(readState, "mention_count");
-	bool bHaveLastViewed = flags & RSTATE_FLAG_HAS_LASTVIEWED;
+	Snowflake id = entry.m_channel;
+	Snowflake lastMessageId = entry.m_lastMessage;
+	int lastViewed = entry.m_lastViewed;
+	int mentionCount = entry.m_mentionCount;
+	bool bHaveLastViewed = entry.m_flags & RSTATE_FLAG_HAS_LASTVIEWED;
 
 	// TOTAL FABRICATION:  I guess you have to ignore earlier versions?
-	if (readState.contains("version"))
+	if (entry.m_version >= 0)
 	{
-		int version = GetFieldSafeInt(readState, "version");
+		int version = entry.m_version;
 		if (m_ackVersion >= version) {
 			DbgPrintF("Received MESSAGE_ACK version %d, latest version is %d, skipping", version, m_ackVersion);
 			return;
@@ -2202,9 +2306,13 @@ bool DiscordInstance::SortGuilds()
 
 void DiscordInstance::ParseAndAddGuild(nlohmann::json& elem)
 {
-	std::string uu = elem.dump();
-
 	Guild g;
+	ParseGuild(g, elem);
+	AddGuild(g);
+}
+
+void DiscordInstance::ParseGuild(Guild& g, nlohmann::json& elem, std::vector<nlohmann::json>* pUsers)
+{
 	g.m_snowflake = GetSnowflake(elem, "id");
 	Json& props = elem["properties"];
 
@@ -2224,9 +2332,6 @@ void DiscordInstance::ParseAndAddGuild(nlohmann::json& elem)
 	// parse avatar
 	g.m_avatarlnk = GetFieldSafe(props, "icon");
 
-	if (!g.m_avatarlnk.empty())
-		GetFrontend()->RegisterIcon(g.m_snowflake, g.m_avatarlnk);
-
 	// parse channels
 	Json& channels = elem["channels"];
 
@@ -2267,7 +2372,7 @@ void DiscordInstance::ParseAndAddGuild(nlohmann::json& elem)
 	for (auto& emojij : emojis)
 	{
 		Emoji emoji;
-		emoji.Load(emojij);
+		emoji.Load(emojij, pUsers);
 		g.m_emoji[emoji.m_id] = emoji;
 	}
 
@@ -2285,34 +2390,80 @@ void DiscordInstance::ParseAndAddGuild(nlohmann::json& elem)
 				g.m_voiceMembers[channelId].insert(userId);
 		}
 	}
+}
+
+void DiscordInstance::AddGuild(Guild& g)
+{
+	if (!g.m_avatarlnk.empty())
+		GetFrontend()->RegisterIcon(g.m_snowflake, g.m_avatarlnk);
 
 	// Check if the guild already exists.  If it does, replace its contents.
 	// I'm not totally sure why discord sends a GUILD_CREATE event.  Perhaps
 	// the server I was testing with is considered a "lazy guild"?
+	Guild* pOldGuild = GetGuild(g.m_snowflake);
+	if (pOldGuild)
+	{
+		UnindexGuildChannels(*pOldGuild);
+		*pOldGuild = std::move(g);
+		IndexGuildChannels(*pOldGuild);
+		return;
+	}
+
+	m_guilds.push_front(std::move(g));
+	m_guildIndex[m_guilds.front().m_snowflake] = &m_guilds.front();
+	IndexGuildChannels(m_guilds.front());
+}
+
+void DiscordInstance::ClearGuilds()
+{
+	m_guilds.clear();
+	RebuildLookupIndexes();
+}
+
+void DiscordInstance::IndexGuildChannels(Guild& gld)
+{
+	for (auto& chan : gld.m_channels)
+		m_channelIndex[chan.m_snowflake] = &chan;
+}
+
+void DiscordInstance::UnindexGuildChannels(Guild& gld)
+{
+	for (auto& chan : gld.m_channels)
+	{
+		auto iter = m_channelIndex.find(chan.m_snowflake);
+		if (iter != m_channelIndex.end() && iter->second == &chan)
+			m_channelIndex.erase(iter);
+	}
+}
+
+void DiscordInstance::RebuildLookupIndexes()
+{
+	m_guildIndex.clear();
+	m_channelIndex.clear();
+
 	for (auto& gld : m_guilds)
 	{
-		if (gld.m_snowflake == g.m_snowflake) {
-			gld = g;
-			return;
-		}
+		m_guildIndex[gld.m_snowflake] = &gld;
+		IndexGuildChannels(gld);
 	}
 
-	m_guilds.push_front(g);
+	IndexGuildChannels(m_dmGuild);
 }
 
 // DISPATCH FUNCTIONS
 
 #define DECL(Code) g_dispatchFunctions[#Code] = &DiscordInstance::Handle ## Code
+#define DECL_APPLY(Code, Type) g_applyFunctions[#Code] = [](DiscordInstance* pThis, GatewayEventData& data) { pThis->Apply ## Code(static_cast<Type&>(data)); }
 
 void DiscordInstance::InitDispatchFunctions()
 {
 	g_dispatchFunctions.clear();
+	g_applyFunctions.clear();
 	DECL(READY);
 	DECL(READY_SUPPLEMENTAL);
+	DECL(RESUMED);
 	DECL(MESSAGE_CREATE);
 	DECL(MESSAGE_UPDATE);
-	DECL(MESSAGE_DELETE);
-	DECL(MESSAGE_ACK);
 	DECL(USER_SETTINGS_PROTO_UPDATE);
 	DECL(USER_GUILD_SETTINGS_UPDATE);
 	DECL(USER_NOTE_UPDATE);
@@ -2321,10 +2472,6 @@ void DiscordInstance::InitDispatchFunctions()
 	DECL(CHANNEL_CREATE);
 	DECL(CHANNEL_DELETE);
 	DECL(CHANNEL_UPDATE);
-	DECL(GUILD_MEMBER_LIST_UPDATE);
-	DECL(GUILD_MEMBERS_CHUNK);
-	DECL(TYPING_START);
-	DECL(PRESENCE_UPDATE);
 	DECL(PASSIVE_UPDATE_V1);
 	DECL(VOICE_STATE_UPDATE);
 	DECL(VOICE_SERVER_UPDATE);
@@ -2332,26 +2479,19 @@ void DiscordInstance::InitDispatchFunctions()
 	DECL(STREAM_SERVER_UPDATE);
 	DECL(STREAM_DELETE);
 
+	DECL_APPLY(MESSAGE_DELETE, MessageDelete);
+	DECL_APPLY(MESSAGE_ACK, MessageAck);
+	DECL_APPLY(GUILD_MEMBER_LIST_UPDATE, MemberListUpdate);
+	DECL_APPLY(GUILD_MEMBERS_CHUNK, MembersChunk);
+	DECL_APPLY(TYPING_START, TypingStart);
+	DECL_APPLY(PRESENCE_UPDATE, PresenceUpdate);
+
 	m_dmGuild.m_name = GetFrontend()->GetDirectMessagesText();
 }
 
+#undef DECL_APPLY
 #undef DECL
 
-static std::string GetStatusFromActivities(Json& activities)
-{
-	if (!activities.is_array() || activities.empty())
-		return "";
-
-	for (auto& activity : activities)
-	{
-		if (GetFieldSafe(activity, "name") == "Custom Status")
-			// prioritize custom status
-			return GetStatusStringFromGameJsonObject(activity);
-	}
-
-	return GetStatusStringFromGameJsonObject(activities[0]);
-}
-
 void DiscordInstance::HandleREADY_SUPPLEMENTAL(Json& j)
 {
 	Json& data = j["d"];
@@ -2438,13 +2578,27 @@ void DiscordInstance::HandleREADY_SUPPLEMENTAL(Json& j)
 	GetFrontend()->OnVoiceStateChange();
 }
 
-void DiscordInstance::HandleREADY(Json& j)
+void DiscordInstance::HandleRESUMED(Json& j)
 {
+	// All missed events were replayed before this, so the state we have is up to date.
+	DbgPrintF("Session %s resumed", m_sessionId.c_str());
+	m_bResuming = false;
+
 	GetFrontend()->OnConnected();
+}
 
-#ifdef _DEBUG
-	std::string str = j.dump();
-#endif
+void DiscordInstance::HandleREADY(Json& j)
+{
+	// The payload wasn't streamed, take the records out of the DOM
+	ReadyData ready;
+	ReadyParser::Collect(j["d"], ready);
+	ApplyREADY(j, ready);
+}
+
+void DiscordInstance::ApplyREADY(Json& j, ReadyData& ready)
+{
+	GetFrontend()->OnConnected();
+	m_bResuming = false;
 
 	Json& data = j["d"];
 	m_gatewayResumeUrl = data["resume_gateway_url"];
@@ -2456,6 +2610,7 @@ void DiscordInstance::HandleREADY(Json& j)
 
 	Snowflake oldSnowflake = m_mySnowflake;
 	m_mySnowflake = GetSnowflake(user, "id");
+	GetMessageStore()->SetUser(m_mySnowflake);
 
 	bool firstReadyOnThisUser = m_mySnowflake != oldSnowflake;
 
@@ -2468,17 +2623,20 @@ void DiscordInstance::HandleREADY(Json& j)
 	LoadUserSettings(data["user_settings_proto"]);
 
 	// ==== reload guild DB
-	Json& guilds = data["guilds"];
-	m_guilds.clear();
+	ClearGuilds();
 
 	std::vector<Snowflake> guildIds; // used by merged members
-	for (auto& elem : guilds) {
-		guildIds.push_back(GetSnowflake(elem, "id"));
+	for (auto& gld : ready.m_guilds) {
+		guildIds.push_back(gld.m_snowflake);
 	}
 
-	// reverse because that's pretty much the order Discord stores guilds in
-	for (auto& elem : guilds)
-		ParseAndAddGuild(elem);
+	for (auto& gld : ready.m_guilds)
+		AddGuild(gld);
+
+	ready.m_guilds.clear();
+
+	for (auto& prof : ready.m_profiles)
+		GetProfileCache()->LoadProfile(0, prof);
 
 	SortGuilds();
 
@@ -2539,6 +2697,7 @@ void DiscordInstance::HandleREADY(Json& j)
 		auto& chans = data["private_channels"];
 		
 		Guild* pGld = &m_dmGuild;
+		UnindexGuildChannels(*pGld);
 		pGld->m_channels.clear();
 
 		Snowflake chan = 0;
@@ -2555,6 +2714,8 @@ void DiscordInstance::HandleREADY(Json& j)
 		pGld->m_channels.sort();
 		pGld->m_bChannelsLoaded = true;
 		pGld->m_currentChannel = chan;
+
+		IndexGuildChannels(*pGld);
 	}
 
 	// ==== load read_state
@@ -2564,9 +2725,8 @@ void DiscordInstance::HandleREADY(Json& j)
 		m_ackVersion = 0;
 
 		Json& readStateData = data["read_state"];
-		Json& readStates = readStateData["entries"];
-		for (Json& readState : readStates)
-			ParseReadStateObject(readState, false);
+		for (auto& entry : ready.m_readStates)
+			ApplyReadState(entry);
 
 		m_ackVersion = GetFieldSafeInt(readStateData, "version");
 	}
@@ -2618,15 +2778,35 @@ void DiscordInstance::HandleREADY(Json& j)
 	if (forceRefresh)
 		GetFrontend()->UpdateSelectedGuild();
 
-	// Doing this because the contents of all channels might be outdated.
-	GetMessageCache()->ClearAllChannels();
+	// The contents of the loaded channels might be outdated.  If this is the
+	// same user, only fetch what was posted while we were away.
+	if (firstReadyOnThisUser)
+	{
+		GetMessageCache()->ClearAllChannels();
+	}
+	else
+	{
+		std::map<Snowflake, Snowflake> lastMessages;
+		for (auto& chan : m_channelIndex)
+			lastMessages[chan.first] = chan.second->m_lastSentMsg;
+
+		auto stats = GetMessageCache()->Reconcile(lastMessages);
+		DbgPrintF(
+			"Reconciled message cache: %d channels up to date, %d with new messages, %d dropped, %d messages kept",
+			int(stats.m_unchanged), int(stats.m_gapped), int(stats.m_dropped), int(stats.m_keptMessages)
+		);
+	}
+
 	GetFrontend()->UpdateSelectedChannel();
 }
 
 void DiscordInstance::HandleMessageInsertOrUpdate(Json& j, bool bIsUpdate)
 {
 	Json& data = j["d"];
-	Json& author = data["author"];
+
+	// Partial updates (e.g. embeds resolving) don't carry the whole message.
+	// N.B. Check before anything looks it up with operator[], which would add it.
+	bool bHasAuthor = data.find("author") != data.end();
 
 	Snowflake guildId = GetSnowflake(data, "guild_id");
 	Snowflake channelId = GetSnowflake(data, "channel_id");
@@ -2640,17 +2820,26 @@ void DiscordInstance::HandleMessageInsertOrUpdate(Json& j, bool bIsUpdate)
 	if (!pChan)
 		return;
 
-	Message msg;
+	if (!bIsUpdate)
+		GetMessageStore()->Put(channelId, messageId, data, pChan->m_lastSentMsg);
+	else if (bHasAuthor)
+		GetMessageStore()->Put(channelId, messageId, data);
+
+	// Loaded messages are shared with the message list, so an update goes into a
+	// copy which then replaces the old message in the cache.  New messages are
+	// allocated once and handed over.
+	MessagePtr msg;
 
 	MessagePtr pOldMsg = GetMessageCache()->GetLoadedMessage(channelId, messageId);
 	if (pOldMsg)
-	{
-		msg = *pOldMsg; // copy it asap
-		pOldMsg = NULL;
-	}
-	else if (bIsUpdate) return;
+		msg = MakeMessage(*pOldMsg);
+	else if (bIsUpdate)
+		return;
+	else
+		msg = MakeMessage();
 
-	msg.Load(data, guildId);
+	pOldMsg = nullptr;
+	msg->Load(data, guildId);
 
 	Snowflake oldSentMsg = pChan->m_lastSentMsg;
 	pChan->m_lastSentMsg = std::max(pChan->m_lastSentMsg, messageId);
@@ -2681,7 +2870,7 @@ void DiscordInstance::HandleMessageInsertOrUpdate(Json& j, bool bIsUpdate)
 				isNonMutedDM = true;
 		}
 
-		if ((isNonMutedDM || msg.CheckWasMentioned(m_mySnowflake, guildId, suppEveryone, suppRoles)) && m_CurrentChannel != channelId)
+		if ((isNonMutedDM || msg->CheckWasMentioned(m_mySnowflake, guildId, suppEveryone, suppRoles)) && m_CurrentChannel != channelId)
 			pChan->m_mentionCount++;
 	}
 
@@ -2701,7 +2890,7 @@ void DiscordInstance::HandleMessageInsertOrUpdate(Json& j, bool bIsUpdate)
 		GetFrontend()->UpdateChannelAcknowledge(channelId, pChan->m_lastViewedMsg);
 
 	if (!bIsUpdate)
-		m_notificationManager.OnMessageCreate(guildId, channelId, msg);
+		m_notificationManager.OnMessageCreate(guildId, channelId, *msg);
 }
 
 void DiscordInstance::HandleMESSAGE_CREATE(Json& j)
@@ -2714,12 +2903,11 @@ void DiscordInstance::HandleMESSAGE_UPDATE(Json& j)
 	HandleMessageInsertOrUpdate(j, true);
 }
 
-void DiscordInstance::HandleMESSAGE_DELETE(Json& j)
+void DiscordInstance::ApplyMESSAGE_DELETE(MessageDelete& del)
 {
-	Json& data = j["d"];
-	Snowflake guildId = GetIntFromString(GetFieldSafe(data, "guild_id"));
-	Snowflake channelId = GetIntFromString(data["channel_id"]);
-	Snowflake messageId = GetIntFromString(data["id"]);
+	Snowflake guildId = del.m_guild;
+	Snowflake channelId = del.m_channel;
+	Snowflake messageId = del.m_message;
 	
 	GetMessageCache()->DeleteMessage(channelId, messageId);
 
@@ -2729,13 +2917,10 @@ void DiscordInstance::HandleMESSAGE_DELETE(Json& j)
 	GetFrontend()->OnDeleteMessage(messageId);
 }
 
-void DiscordInstance::HandleMESSAGE_ACK(nlohmann::json& j)
+void DiscordInstance::ApplyMESSAGE_ACK(MessageAck& ack)
 {
-	Json& data = j["d"];
-
-	// NOTE: Seems like this version of the read state object has different names for channel ID and message ID.  Also differing versions?
-	// Maybe you're supposed to ignore things with an earlier version?
-	ParseReadStateObject(data, true);
+	// NOTE: Also differing versions?  Maybe you're supposed to ignore things with an earlier version?
+	ApplyReadState(ack.m_entry);
 }
 
 void DiscordInstance::HandleUSER_GUILD_SETTINGS_UPDATE(nlohmann::json& j)
@@ -2801,6 +2986,8 @@ void DiscordInstance::HandleGUILD_DELETE(Json& j)
 	{
 		if (iter->m_snowflake == sf)
 		{
+			UnindexGuildChannels(*iter);
+			m_guildIndex.erase(sf);
 			m_guilds.erase(iter);
 			m_guildItemList.EraseGuild(sf);
 			GetFrontend()->RepaintGuildList();
@@ -2832,6 +3019,7 @@ void DiscordInstance::HandleCHANNEL_CREATE(Json& j)
 
 	chn.m_parentGuild = pGuild->m_snowflake;
 	pGuild->m_channels.push_back(chn);
+	m_channelIndex[chn.m_snowflake] = &pGuild->m_channels.back();
 	pGuild->m_channels.sort();
 
 	if (m_CurrentGuild == guildId)
@@ -2886,6 +3074,9 @@ void DiscordInstance::HandleCHANNEL_DELETE(Json& j)
 		++iter)
 	{
 		if (iter->m_snowflake == channelId) {
+			if (GetChannel(channelId) == &*iter)
+				m_channelIndex.erase(channelId);
+
 			pGuild->m_channels.erase(iter);
 			break;
 		}
@@ -2898,59 +3089,45 @@ void DiscordInstance::HandleCHANNEL_DELETE(Json& j)
 		GetFrontend()->UpdateChannelList();
 }
 
-static Snowflake GetGroupId(std::string idStr)
-{
-	/**/ if (idStr == "online")  return GROUP_ONLINE;
-	else if (idStr == "offline") return GROUP_OFFLINE;
-	else return GetIntFromString(idStr);
-}
-
-void DiscordInstance::HandleGUILD_MEMBER_LIST_UPDATE(Json& j)
+void DiscordInstance::ApplyGUILD_MEMBER_LIST_UPDATE(MemberListUpdate& upd)
 {
-	Json& data = j["d"];
-	Snowflake guildId = GetSnowflake(data, "guild_id");
+	Snowflake guildId = upd.m_guild;
 
 	Guild* pGld = GetGuild(guildId);
 	if (!pGld)
 		return;
 
-	for (auto& op : data["groups"])
+	for (auto& group : upd.m_groups)
 	{
-		Snowflake groupId = GetGroupId(GetFieldSafe(op, "id"));
-		int count = GetFieldSafeInt(op, "count");
-
-		GuildMember* pGroupMember = pGld->GetGuildMember(groupId);
-		pGroupMember->m_groupCount = count;
+		GuildMember* pGroupMember = pGld->GetGuildMember(group.first);
+		pGroupMember->m_groupCount = group.second;
 	}
 
-	pGld->m_memberCount = GetFieldSafeInt(data, "member_count");
-	pGld->m_onlineCount = GetFieldSafeInt(data, "online_count");
+	pGld->m_memberCount = upd.m_memberCount;
+	pGld->m_onlineCount = upd.m_onlineCount;
 
-	for (auto& op : data["ops"])
+	for (auto& op : upd.m_ops)
 	{
-		std::string opCode = op["op"];
-
-		if (opCode == "SYNC") {
-			HandleGuildMemberListUpdate_Sync(guildId, op);
-			continue;
-		}
-		if (opCode == "INSERT") {
-			HandleGuildMemberListUpdate_Insert(guildId, op);
-			continue;
-		}
-		if (opCode == "DELETE") {
-			HandleGuildMemberListUpdate_Delete(guildId, op);
-			continue;
-		}
-		if (opCode == "UPDATE") {
-			HandleGuildMemberListUpdate_Update(guildId, op);
-			continue;
-		}
-		if (opCode == "INVALIDATE") {
-			// nothing really
-			continue;
+		switch (op.m_type)
+		{
+			case MemberListOp::OP_SYNC:
+				ApplyMemberListSync(guildId, op);
+				break;
+			case MemberListOp::OP_INSERT:
+				ApplyMemberListInsert(guildId, op);
+				break;
+			case MemberListOp::OP_DELETE:
+				ApplyMemberListDelete(guildId, op);
+				break;
+			case MemberListOp::OP_UPDATE:
+				ApplyMemberListUpdate(guildId, op);
+				break;
+			case MemberListOp::OP_INVALIDATE:
+				// nothing really
+				break;
+			default:
+				assert(!"TODO"); // what else
 		}
-		assert(!"TODO"); // what else
 	}
 
 	Snowflake currentGroup = 0;
@@ -2968,14 +3145,19 @@ void DiscordInstance::HandleGUILD_MEMBER_LIST_UPDATE(Json& j)
 
 Snowflake DiscordInstance::ParseGuildMember(Snowflake guild, nlohmann::json& memb, Snowflake userID)
 {
-	Json& pres = memb["presence"], &user = memb["user"], & roles = memb["roles"];
+	GuildMemberRecord member;
+	member.Load(memb);
+	return ApplyGuildMember(guild, member, userID);
+}
+
+Snowflake DiscordInstance::ApplyGuildMember(Snowflake guild, GuildMemberRecord& memb, Snowflake userID)
+{
 	Profile* pf = nullptr;
 
-	if (user.is_object())
+	if (memb.m_user)
 	{
-		Snowflake id = GetSnowflake(user, "id");
-		pf = GetProfileCache()->LoadProfile(id, user);
-		userID = id;
+		userID = memb.m_user;
+		pf = GetProfileCache()->LoadProfile(userID, memb.m_userData);
 	}
 	else
 	{
@@ -2984,15 +3166,11 @@ Snowflake DiscordInstance::ParseGuildMember(Snowflake guild, nlohmann::json& mem
 		pf = GetProfileCache()->LookupProfile(userID, "", "", "", false);
 	}
 
-	std::string avatarOverride = GetFieldSafe(memb, "avatar");
-	std::string nameOverride = GetFieldSafe(memb, "nick");
-
 	GuildMember& gm = pf->m_guildMembers[guild];
 	gm.m_user = pf->m_snowflake;
-	gm.m_avatar = avatarOverride;
-	gm.m_nick = nameOverride;
-	gm.m_user = pf->m_snowflake;
-	gm.m_joinedAt = ParseTime(GetFieldSafe(memb, "joined_at"));
+	gm.m_avatar = memb.m_avatar;
+	gm.m_nick = memb.m_nick;
+	gm.m_joinedAt = memb.m_joinedAt;
 	gm.m_bIsLoadedFromChunk = true;
 	gm.m_groupId = 0; // to be filled in by the group layout
 
@@ -3000,57 +3178,32 @@ Snowflake DiscordInstance::ParseGuildMember(Snowflake guild, nlohmann::json& mem
 	if (pGuild)
 		pGuild->AddKnownMember(pf->m_snowflake);
 
-	// TODO: Not sure if this is the guild specific or global status. Probably guild specific
-	if (!pres.is_null()) {
-		if (pres.contains("status")) {
-			auto status = GetFieldSafe(pres, "status");
-			if (!status.empty())
-				pf->m_activeStatus = GetStatusFromString(status);
-		}
-		if (pres.contains("game") && !pres["game"].is_null()) {
-			pf->m_status = GetStatusStringFromGameJsonObject(pres["game"]);
-		}
-		else if (pres.contains("activities") && !pres["activities"].is_null()) {
-			pf->m_status = GetStatusFromActivities(pres["activities"]);
-		}
-		else {
-			pf->m_status = "";
-		}
+	if (memb.m_bHasPresence) {
+		if (!memb.m_activeStatus.empty())
+			pf->m_activeStatus = GetStatusFromString(memb.m_activeStatus);
+
+		pf->m_status = memb.m_status;
 	}
 
-	gm.m_roles.clear();
-	for (auto& it : roles)
-		gm.m_roles.push_back(GetSnowflakeFromJsonObject(it));
+	gm.m_roles = memb.m_roles;
 
 	return userID;
 }
 
-void DiscordInstance::HandlePRESENCE_UPDATE(nlohmann::json& j)
+void DiscordInstance::ApplyPRESENCE_UPDATE(PresenceUpdate& upd)
 {
-	Json& data = j["d"];
-
-	Json& user = data["user"];
-	Snowflake userID = GetSnowflake(user, "id");
+	Snowflake userID = upd.m_user;
 
 	Profile* pf = GetProfileCache()->LookupProfile(userID, "", "", "", false);
 
 	// Note: Updating these first because maybe LoadProfile triggers a refresh
-	if (data.contains("status")) {
-		std::string stat = GetFieldSafe(data, "status");
-		if (!stat.empty())
-			pf->m_activeStatus = GetStatusFromString(stat);
-	}
+	if (!upd.m_activeStatus.empty())
+		pf->m_activeStatus = GetStatusFromString(upd.m_activeStatus);
 
-	// Look for any activities -- TODO: Server specific activities
-	if (data.contains("game") && !data["game"].is_null())
-		pf->m_status = GetStatusStringFromGameJsonObject(data["game"]);
-	else if (data.contains("activities") && !data["activities"].is_null())
-		pf->m_status = GetStatusFromActivities(data["activities"]);
-	else
-		pf->m_status = "";
+	pf->m_status = upd.m_status;
 
-	if (user.contains("global_name")) // the full user object is provided
-		GetProfileCache()->LoadProfile(userID, user);
+	if (!upd.m_userData.is_null())
+		GetProfileCache()->LoadProfile(userID, upd.m_userData);
 	else
 		GetFrontend()->UpdateUserData(userID);
 }
@@ -3081,47 +3234,35 @@ void DiscordInstance::HandlePASSIVE_UPDATE_V1(nlohmann::json& j)
 	}
 }
 
-void DiscordInstance::HandleGUILD_MEMBERS_CHUNK(nlohmann::json& j)
+void DiscordInstance::ApplyGUILD_MEMBERS_CHUNK(MembersChunk& chunk)
 {
-	Json& data = j["d"];
-	Snowflake guildId = GetSnowflake(data, "guild_id");
+	Snowflake guildId = chunk.m_guild;
 
 	Guild* pGld = GetGuild(guildId);
 	if (!pGld)
 		return;
 
 	std::set<Snowflake> memsToRefresh;
-	if (data["members"].is_array())
-	{
-		for (Json& mem : data["members"])
-			memsToRefresh.insert(ParseGuildMember(guildId, mem));
-	}
+	for (auto& mem : chunk.m_members)
+		memsToRefresh.insert(ApplyGuildMember(guildId, mem));
 
-	if (data["not_found"].is_array())
-	{
-		for (auto& nf : data["not_found"]) {
-			GetProfileCache()->ProfileDoesntExist(GetSnowflakeFromJsonObject(nf), guildId);
-		}
-	}
+	for (auto nf : chunk.m_notFound)
+		GetProfileCache()->ProfileDoesntExist(nf, guildId);
 
 	if (m_CurrentGuild == guildId)
 		GetFrontend()->RefreshMembers(memsToRefresh);
 }
 
-void DiscordInstance::HandleTYPING_START(nlohmann::json& j)
+void DiscordInstance::ApplyTYPING_START(TypingStart& typing)
 {
-	Json& data = j["d"];
-	Snowflake guildID = 0;
-	Snowflake userID = GetSnowflake(data, "user_id");
-	Snowflake chanID = GetSnowflake(data, "channel_id");
-	if (data.contains("guild_id"))
-	{
-		guildID = GetSnowflake(data, "guild_id");
-		userID = ParseGuildMember(guildID, data["member"], userID);
-	}
+	Snowflake guildID = typing.m_guild;
+	Snowflake userID = typing.m_user;
+	Snowflake chanID = typing.m_channel;
+	if (guildID)
+		userID = ApplyGuildMember(guildID, typing.m_member, userID);
 
 	time_t currTime = time(NULL);
-	time_t startTime = time_t(GetFieldSafeInt(data, "timestamp"));
+	time_t startTime = typing.m_timestamp;
 
 	// If there is major desync just use the current time. Could be because of time zone differences for example
 	if (abs(int64_t(startTime) - int64_t(currTime)) > 10000)
@@ -3130,13 +3271,11 @@ void DiscordInstance::HandleTYPING_START(nlohmann::json& j)
 	GetFrontend()->OnStartTyping(userID, guildID, chanID, startTime);
 }
 
-Snowflake DiscordInstance::ParseGuildMemberOrGroup(Snowflake guild, nlohmann::json& item)
+Snowflake DiscordInstance::ApplyMemberListItem(Snowflake guild, MemberListItem& item)
 {
-	if (item.contains("group")) {
-		Json& grp = item["group"];
-
+	if (item.m_bIsGroup) {
 		// fake a profile to integrate with the existing stuff
-		Snowflake groupId = GetGroupId(GetFieldSafe(grp, "id"));
+		Snowflake groupId = item.m_groupId;
 		Profile* pf = GetProfileCache()->LookupProfile(groupId, "GROUP", "GROUP", "", false);
 
 		GuildMember& gm = pf->m_guildMembers[guild];
@@ -3144,10 +3283,9 @@ Snowflake DiscordInstance::ParseGuildMemberOrGroup(Snowflake guild, nlohmann::js
 		gm.m_bIsGroup = true;
 		return gm.m_groupId;
 	}
-	else if (item.contains("member"))
+	else if (item.m_bIsMember)
 	{
-		assert(item["member"].is_object());
-		return ParseGuildMember(guild, item["member"]);
+		return ApplyGuildMember(guild, item.m_member);
 	}
 	else
 	{
@@ -3156,29 +3294,24 @@ Snowflake DiscordInstance::ParseGuildMemberOrGroup(Snowflake guild, nlohmann::js
 	}
 }
 
-void DiscordInstance::HandleGuildMemberListUpdate_Sync(Snowflake guild, nlohmann::json& jx)
+void DiscordInstance::ApplyMemberListSync(Snowflake guild, MemberListOp& op)
 {
 	Guild* pGld = GetGuild(guild);
 	assert(pGld);
 
 	pGld->m_members.clear();
 
-	// TODO: j["range"].  Is the range we told discord about
-	// when subscribing to the channel using websocket.
-	int m_ordinal = 0;
-	Json& items = jx["items"];
-	for (auto& item : items)
-		pGld->m_members.push_back(ParseGuildMemberOrGroup(guild, item));
+	for (auto& item : op.m_items)
+		pGld->m_members.push_back(ApplyMemberListItem(guild, item));
 }
 
-void DiscordInstance::HandleGuildMemberListUpdate_Insert(Snowflake guild, nlohmann::json& j)
+void DiscordInstance::ApplyMemberListInsert(Snowflake guild, MemberListOp& op)
 {
 	Guild* pGld = GetGuild(guild);
 	assert(pGld);
 
-	Json& item = j["item"];
-	int index = j["index"];
-	Snowflake sf = ParseGuildMemberOrGroup(guild, item);
+	int index = op.m_index;
+	Snowflake sf = ApplyMemberListItem(guild, op.m_items[0]);
 
 	if (index < 0 || index >= int(pGld->m_members.size() + 1)) {
 		//assert(!"huh");
@@ -3189,12 +3322,12 @@ void DiscordInstance::HandleGuildMemberListUpdate_Insert(Snowflake guild, nlohma
 	pGld->m_members.insert(pGld->m_members.begin() + index, sf);
 }
 
-void DiscordInstance::HandleGuildMemberListUpdate_Delete(Snowflake guild, nlohmann::json& j)
+void DiscordInstance::ApplyMemberListDelete(Snowflake guild, MemberListOp& op)
 {
 	Guild* pGld = GetGuild(guild);
 	assert(pGld);
 
-	int index = j["index"];
+	int index = op.m_index;
 
 	if (index < 0 || index >= int(pGld->m_members.size())) {
 		//assert(!"huh");
@@ -3213,12 +3346,12 @@ void DiscordInstance::HandleGuildMemberListUpdate_Delete(Snowflake guild, nlohma
 	pGld->m_members.erase(pGld->m_members.begin() + index);
 }
 
-void DiscordInstance::HandleGuildMemberListUpdate_Update(Snowflake guild, nlohmann::json& j)
+void DiscordInstance::ApplyMemberListUpdate(Snowflake guild, MemberListOp& op)
 {
 	Guild* pGld = GetGuild(guild);
 	assert(pGld);
 
-	int index = j["index"];
+	int index = op.m_index;
 
 	if (index < 0 || index >= int(pGld->m_members.size())) {
 		//assert(!"huh");
@@ -3226,7 +3359,7 @@ void DiscordInstance::HandleGuildMemberListUpdate_Update(Snowflake guild, nlohma
 		return;
 	}
 
-	Snowflake sf = ParseGuildMemberOrGroup(guild, j["item"]);
+	Snowflake sf = ApplyMemberListItem(guild, op.m_items[0]);
 	pGld->m_members[index] = sf;
 
 	std::set<Snowflake> updates{ sf };
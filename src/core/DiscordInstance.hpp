@@ -6,6 +6,7 @@
 #include <list>
 #include <set>
 #include <unordered_set>
+#include <atomic>
 #include <nlohmann/json.h>
 #include "network/DiscordAPI.hpp"
 #include "models/Snowflake.hpp"
@@ -26,10 +27,23 @@
 #include "stream/StreamViewer.hpp"
 
 struct NetRequest;
+struct GatewayEvent;
+struct GatewayEventData;
+struct ReadyData;
+struct ReadStateEntry;
+struct GuildMemberRecord;
+struct MemberListItem;
+struct MemberListOp;
+struct MemberListUpdate;
+struct MembersChunk;
+struct PresenceUpdate;
+struct TypingStart;
+struct MessageDelete;
+struct MessageAck;
 
 struct AddMessageParams
 {
-	Message msg;
+	MessagePtr msg;
 	Snowflake channel;
 };
 
@@ -180,12 +194,17 @@ public:
 
 	Guild m_dmGuild;
 
+	// Lookup indexes into the guild DB.  std::list never moves its elements, so
+	// these stay valid until the guild or channel itself is removed.
+	std::unordered_map<Snowflake, Guild*> m_guildIndex;
+	std::unordered_map<Snowflake, Channel*> m_channelIndex;
+
 	// Requests in progress
 	std::map<Snowflake, bool> m_messageRequestsInProgress;
 
-	// Gateway url and connection ID
+	// Gateway url and connection ID.  The ID is read by the websocket thread to route messages.
 	std::string m_gatewayUrl = "";
-	int m_gatewayConnId = -1;
+	std::atomic<int> m_gatewayConnId { -1 };
 	int m_heartbeatSequenceId = -1;
 
 	// Things we get on ready
@@ -193,6 +212,12 @@ public:
 	std::string m_sessionId = ""; // for resume
 	std::string m_sessionType = "";
 
+	// Set when the gateway went away in a way that allows resuming the session.
+	// The next StartGatewaySession() will then connect to the resume URL.
+	bool m_bResumePending = false;
+	// Set while the current connection is trying to resume instead of identifying.
+	bool m_bResuming = false;
+
 	// Last time we sent a typing indicator
 	uint64_t m_lastTypingSent = 0;
 
@@ -257,7 +282,6 @@ public:
 		return m_gatewayConnId;
 	}
 
-	// TODO optimize this stuff
 	Guild* GetGuild(Snowflake sf)
 	{
 		assert(sf != 1);
@@ -265,12 +289,11 @@ public:
 		if (!sf)
 			return &m_dmGuild;
 
-		for (auto& g : m_guilds)
-		{
-			if (g.m_snowflake == sf)
-				return &g;
-		}
-		return nullptr;
+		auto iter = m_guildIndex.find(sf);
+		if (iter == m_guildIndex.end())
+			return nullptr;
+
+		return iter->second;
 	}
 
 	void GetGuildIDs(std::vector<Snowflake>& sf, bool bUI = false)
@@ -361,20 +384,11 @@ public:
 
 	Channel* GetChannel(Snowflake sf)
 	{
-		Channel* pChan;
-		Guild* pGuild = GetCurrentGuild();
-		if (pGuild) {
-			pChan = pGuild->GetChannel(sf);
-			if (pChan) return pChan;
-		}
+		auto iter = m_channelIndex.find(sf);
+		if (iter == m_channelIndex.end())
+			return nullptr;
 
-		for (auto& gld : m_guilds) {
-			pChan = gld.GetChannel(sf);
-			if (pChan)
-				return pChan;
-		}
-
-		return m_dmGuild.GetChannel(sf);
+		return iter->second;
 	}
 
 	Channel* GetCurrentChannel()
@@ -437,12 +451,17 @@ public:
 	// Handle the case where a channel list was fetched from a guild.
 	void OnFetchedChannels(Guild* pGld, const std::string& content);
 
-	// Handle the case where the gateway is closed.
+	// Handle the case where the gateway is closed.  Call this from the thread
+	// owning the instance, it touches the session state.
 	void GatewayClosed(int errorCode);
 
-	// Start a new gateway session.
+	// Start a new gateway session.  If the previous session can be resumed, this
+	// connects to the resume URL instead and replays the missed events.
 	void StartGatewaySession();
 
+	// Check if the last gateway session can be resumed.
+	bool CanResumeSession() const;
+
 	// Transform user, channel, or emoji mentions ("@usernamehere") into snowflake mentions (<@12347689436274>).
 	std::string ResolveMentions(const std::string& str, Snowflake guild, Snowflake channel);
 
@@ -533,8 +552,12 @@ public:
 
 	void HandleRequest(NetRequest* pReq);
 
+	// Parses and handles a gateway message.  Prefer HandleGatewayEvent with an event
+	// digested on the websocket thread, parsing large payloads is expensive.
 	void HandleGatewayMessage(const std::string& payload);
 
+	void HandleGatewayEvent(GatewayEvent& ev);
+
 	void SendHeartbeat();
 
 	void SendSettingsProto(const std::vector<uint8_t>& data);
@@ -544,18 +567,31 @@ public:
 	bool ResortChannels(Snowflake guild);
 
 public:
+	// Parses a guild object into a guild that isn't part of the instance yet.  Doesn't
+	// touch any shared state if pUsers is given: user objects the guild refers to are
+	// added to it, for the caller to load into the profile cache later.
+	static void ParseGuild(Guild& g, nlohmann::json& j, std::vector<nlohmann::json>* pUsers = nullptr);
+
 	// returns user's id. The user parameter is used only if j["user"] doesn't exist
 	Snowflake ParseGuildMember(Snowflake guild, nlohmann::json& j, Snowflake user = 0);
-	Snowflake ParseGuildMemberOrGroup(Snowflake guild, nlohmann::json& j);
+	Snowflake ApplyGuildMember(Snowflake guild, GuildMemberRecord& memb, Snowflake user = 0);
 
 private:
 	void InitDispatchFunctions();
+	void ClearGuilds();
+	void IndexGuildChannels(Guild& gld);
+	void UnindexGuildChannels(Guild& gld);
+	void RebuildLookupIndexes();
+	void SendIdentify();
+	void SendResume();
 	void UpdateSettingsInfo();
 	bool SortGuilds();
-	void ParseChannel(Channel& c, nlohmann::json& j, int& num);
+	static void ParseChannel(Channel& c, nlohmann::json& j, int& num);
 	void ParseAndAddGuild(nlohmann::json& j);
-	void ParsePermissionOverwrites(Channel& c, nlohmann::json& j);
-	void ParseReadStateObject(nlohmann::json& j, bool bAlternate);
+	void AddGuild(Guild& g); // takes the guild's contents
+	static void ParsePermissionOverwrites(Channel& c, nlohmann::json& j);
+	void ApplyReadState(const ReadStateEntry& entry);
+	void ApplyREADY(nlohmann::json& j, ReadyData& ready);
 	void OnUploadAttachmentFirst(NetRequest* pReq);
 	void OnUploadAttachmentSecond(NetRequest* pReq);
 	void SearchSubGuild(std::vector<QuickMatch>& matches, Guild* pGuild, int matchFlags, const char* query);
@@ -566,10 +602,9 @@ private:
 	// handle functions
 	void HandleREADY(nlohmann::json& j);
 	void HandleREADY_SUPPLEMENTAL(nlohmann::json& j);
+	void HandleRESUMED(nlohmann::json& j);
 	void HandleMESSAGE_CREATE(nlohmann::json& j);
-	void HandleMESSAGE_DELETE(nlohmann::json& j);
 	void HandleMESSAGE_UPDATE(nlohmann::json& j);
-	void HandleMESSAGE_ACK(nlohmann::json& j);
 	void HandleUSER_GUILD_SETTINGS_UPDATE(nlohmann::json& j);
 	void HandleUSER_SETTINGS_PROTO_UPDATE(nlohmann::json& j);
 	void HandleUSER_NOTE_UPDATE(nlohmann::json& j);
@@ -578,10 +613,6 @@ private:
 	void HandleCHANNEL_CREATE(nlohmann::json& j);
 	void HandleCHANNEL_DELETE(nlohmann::json& j);
 	void HandleCHANNEL_UPDATE(nlohmann::json& j);
-	void HandleGUILD_MEMBER_LIST_UPDATE(nlohmann::json& j);
-	void HandleGUILD_MEMBERS_CHUNK(nlohmann::json& j);
-	void HandleTYPING_START(nlohmann::json& j);
-	void HandlePRESENCE_UPDATE(nlohmann::json& j);
 	void HandlePASSIVE_UPDATE_V1(nlohmann::json& j);
 	void HandleVOICE_STATE_UPDATE(nlohmann::json& j);
 	void HandleVOICE_SERVER_UPDATE(nlohmann::json& j);
@@ -589,11 +620,20 @@ private:
 	void HandleSTREAM_SERVER_UPDATE(nlohmann::json& j);
 	void HandleSTREAM_DELETE(nlohmann::json& j);
 
+	// apply functions, for dispatches digested on the websocket thread
+	void ApplyMESSAGE_DELETE(MessageDelete& del);
+	void ApplyMESSAGE_ACK(MessageAck& ack);
+	void ApplyGUILD_MEMBER_LIST_UPDATE(MemberListUpdate& upd);
+	void ApplyGUILD_MEMBERS_CHUNK(MembersChunk& chunk);
+	void ApplyTYPING_START(TypingStart& typing);
+	void ApplyPRESENCE_UPDATE(PresenceUpdate& upd);
+
 private:
-	void HandleGuildMemberListUpdate_Sync(Snowflake guild, nlohmann::json& j);
-	void HandleGuildMemberListUpdate_Insert(Snowflake guild, nlohmann::json& j);
-	void HandleGuildMemberListUpdate_Delete(Snowflake guild, nlohmann::json& j);
-	void HandleGuildMemberListUpdate_Update(Snowflake guild, nlohmann::json& j);
+	Snowflake ApplyMemberListItem(Snowflake guild, MemberListItem& item);
+	void ApplyMemberListSync(Snowflake guild, MemberListOp& op);
+	void ApplyMemberListInsert(Snowflake guild, MemberListOp& op);
+	void ApplyMemberListDelete(Snowflake guild, MemberListOp& op);
+	void ApplyMemberListUpdate(Snowflake guild, MemberListOp& op);
 	void HandleMessageInsertOrUpdate(nlohmann::json& j, bool bIsUpdate);
 };
 
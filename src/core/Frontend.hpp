@@ -23,8 +23,9 @@ public:
 	virtual void OnSessionClosed(int errorCode) = 0;
 	virtual void OnConnecting() = 0;
 	virtual void OnConnected() = 0;
-	virtual void OnAddMessage(Snowflake channelID, const Message& msg) = 0;
-	virtual void OnUpdateMessage(Snowflake channelID, const Message& msg) = 0;
+	// The message is handed over to the message cache as is, don't modify it afterwards.
+	virtual void OnAddMessage(Snowflake channelID, const MessagePtr& msg) = 0;
+	virtual void OnUpdateMessage(Snowflake channelID, const MessagePtr& msg) = 0;
 	virtual void OnDeleteMessage(Snowflake messageInCurrentChannel) = 0;
 	virtual void OnStartTyping(Snowflake userID, Snowflake guildID, Snowflake channelID, time_t startTime) = 0;
 	virtual void OnAttachmentDownloaded(bool bIsProfilePicture, const uint8_t* pData, size_t nSize, const std::string& additData) = 0;
@@ -77,6 +78,9 @@ public:
 	// Heartbeat interval
 	virtual void SetHeartbeatInterval(int timeMs) = 0;
 
+	// Calls DiscordInstance::StartGatewaySession after a delay
+	virtual void ReconnectGatewayIn(int timeMs) = 0;
+
 	// Interface with AvatarCache
 	virtual void RegisterIcon(Snowflake sf, const std::string& avatarlnk) = 0;
 	virtual void RegisterAvatar(Snowflake sf, const std::string& avatarlnk) = 0;
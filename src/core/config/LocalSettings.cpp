@@ -131,6 +131,12 @@ bool LocalSettings::Load()
 	if (j.contains("UseDoubleBuffering"))
 		m_bUseDoubleBuffering = j["UseDoubleBuffering"];
 
+	if (j.contains("MediaCacheSizeMB"))
+		m_mediaCacheSizeMB = j["MediaCacheSizeMB"];
+
+	if (j.contains("MessageCacheSizeMB"))
+		m_messageCacheSizeMB = j["MessageCacheSizeMB"];
+
 	if (m_bSaveWindowSize)
 	{
 		if (j.contains("WindowWidth"))
@@ -217,6 +223,8 @@ bool LocalSettings::Save()
 	j["Use12HourTime"] = m_bUse12HourTime;
 	j["ShowBlockedMessages"] = m_bShowBlockedMessages;
 	j["UseDoubleBuffering"] = m_bUseDoubleBuffering;
+	j["MediaCacheSizeMB"] = m_mediaCacheSizeMB;
+	j["MessageCacheSizeMB"] = m_messageCacheSizeMB;
 	j["AudioInputDevice"] = m_audioInputDevice;
 	j["AudioOutputDevice"] = m_audioOutputDevice;
 	j["AudioInputVolume"] = m_audioInputVolume;
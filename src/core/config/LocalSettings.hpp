@@ -226,6 +226,18 @@ public:
 	void SetUseDoubleBuffering(bool b) {
 		m_bUseDoubleBuffering = b;
 	}
+	int GetMediaCacheSizeMB() const {
+		return m_mediaCacheSizeMB;
+	}
+	void SetMediaCacheSizeMB(int sizeMB) {
+		m_mediaCacheSizeMB = sizeMB;
+	}
+	int GetMessageCacheSizeMB() const {
+		return m_messageCacheSizeMB;
+	}
+	void SetMessageCacheSizeMB(int sizeMB) {
+		m_messageCacheSizeMB = sizeMB;
+	}
 
 	// Audio settings
 	const std::string& GetAudioInputDevice() const { return m_audioInputDevice; }
@@ -282,6 +294,8 @@ private:
 	int m_width = 1000;
 	int m_height = 700;
 	int m_userScale = 1000;
+	int m_mediaCacheSizeMB = 256;
+	int m_messageCacheSizeMB = 64;
 };
 
 LocalSettings* GetLocalSettings();
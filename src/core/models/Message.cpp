@@ -8,7 +8,6 @@ void Message::SetDate(const std::string & dateStr)
 {
 	if (dateStr.empty()) {
 		m_dateTime = 0;
-		m_dateFull = m_dateCompact = "";
 		return;
 	}
 
@@ -18,16 +17,12 @@ void Message::SetDate(const std::string & dateStr)
 void Message::SetTime(time_t t)
 {
 	m_dateTime = t;
-	m_dateFull = FormatTimeLong(m_dateTime, true);
-	m_dateCompact = FormatTimeShorter(m_dateTime);
-	m_dateOnly = FormatDate(m_dateTime);
 }
 
 void Message::SetDateEdited(const std::string& dateStr)
 {
 	if (dateStr.empty()) {
 		m_timeEdited = 0;
-		m_editedText = "";
 		return;
 	}
 
@@ -37,27 +32,49 @@ void Message::SetDateEdited(const std::string& dateStr)
 void Message::SetTimeEdited(time_t t)
 {
 	m_timeEdited = t;
-	m_editedText = "(edited " + FormatTimeLong(m_timeEdited, true) + ")";
-	m_editedTextCompact = "(edited)";
 }
 
-void Message::UpdateTimestamp()
+std::string Message::GetDateFull() const
 {
-	if (m_type == MessageType::SENDING_MESSAGE) {
-		m_dateCompact = "Sending...";
-		m_dateFull = "Sending...";
-		return;
-	}
+	if (m_type == MessageType::SENDING_MESSAGE)
+		return "Sending...";
+
+	if (!m_dateTime)
+		return m_datePrefix;
+
+	return m_datePrefix + FormatTimeLong(m_dateTime, true);
+}
+
+std::string Message::GetDateCompact() const
+{
+	if (m_type == MessageType::SENDING_MESSAGE)
+		return "Sending...";
+
+	if (!m_dateTime)
+		return m_datePrefix;
+
+	return m_datePrefix + FormatTimeShorter(m_dateTime);
+}
 
-	if (m_dateTime)
-		SetTime(m_dateTime);
-	else
-		m_dateCompact = m_dateFull = "";
+std::string Message::GetDateOnly() const
+{
+	if (!m_dateTime)
+		return m_datePrefix;
 
-	if (m_timeEdited)
-		SetTimeEdited(m_timeEdited);
-	else
-		m_editedText = m_editedTextCompact = "";
+	return m_datePrefix + FormatDate(m_dateTime);
+}
+
+std::string Message::GetEditedText() const
+{
+	if (!m_timeEdited)
+		return "";
+
+	return "(edited " + FormatTimeLong(m_timeEdited, true) + ")";
+}
+
+std::string Message::GetEditedTextCompact() const
+{
+	return m_timeEdited ? "(edited)" : "";
 }
 
 bool Message::CheckWasMentioned(Snowflake user, Snowflake guild, bool bSuppressEveryone, bool bSuppressRoles) const
@@ -1,14 +1,15 @@
 #pragma once
 #include <string>
 #include <vector>
-#include <set>
 #include <ctime>
 #include <memory>
 #include <nlohmann/json.h>
 #include "Snowflake.hpp"
+#include "SnowflakeSet.hpp"
 #include "Attachment.hpp"
 #include "MessageType.hpp"
 #include "../network/MessagePoll.hpp"
+#include "../utils/InternedString.hpp"
 
 // XXX: Ok, I'm going to be cheap here and implement a separate class for the referenced message stuff.
 struct ReferenceMessage
@@ -26,7 +27,7 @@ struct ReferenceMessage
 	bool m_bHasEmbeds = false;
 	bool m_bMentionsAuthor = false;
 	bool m_bIsAuthorBot = false;
-	std::set<Snowflake> m_userMentions;
+	SnowflakeSet m_userMentions;
 
 	void Load(nlohmann::json& msgData, Snowflake guild);
 };
@@ -95,20 +96,16 @@ public:
 	Snowflake m_snowflake = 0;
 	Snowflake m_author_snowflake = 0;
 	std::string m_message = "";
-	std::string m_author = "";
-	std::string m_avatar = "";
+	InternedString m_author;
+	InternedString m_avatar;
 	Snowflake m_anchor = 0; // for gap messages
 	Snowflake m_nonce = 0; // to create messages
 	std::vector<Attachment> m_attachments;
-	std::string m_dateFull = "";
-	std::string m_dateCompact = "";
-	std::string m_dateOnly = "";
-	std::string m_editedText = "";
-	std::string m_editedTextCompact = "";
+	std::string m_datePrefix = ""; // shown before the dates, used by the notification viewer
 	time_t m_dateTime = 0;
 	time_t m_timeEdited = 0;
-	std::set<Snowflake> m_userMentions;
-	std::set<Snowflake> m_roleMentions;
+	SnowflakeSet m_userMentions;
+	SnowflakeSet m_roleMentions;
 	bool m_bMentionedEveryone = false;
 	bool m_bIsAuthorBot = false;
 	bool m_bIsPinned = false;
@@ -147,7 +144,14 @@ public:
 	void SetTime(time_t t);
 	void SetDateEdited(const std::string& dateStr);
 	void SetTimeEdited(time_t t);
-	void UpdateTimestamp();
+
+	// The dates as displayed.  They're formatted when asked for, so that they
+	// follow the current time format settings and don't take up memory.
+	std::string GetDateFull() const;
+	std::string GetDateCompact() const;
+	std::string GetDateOnly() const;
+	std::string GetEditedText() const;
+	std::string GetEditedTextCompact() const;
 
 	bool CheckWasMentioned(Snowflake user, Snowflake guild, bool bSuppressEveryone = false, bool bSuppressRoles = false) const;
 
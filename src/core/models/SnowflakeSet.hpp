@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include <algorithm>
+#include "Snowflake.hpp"
+
+// A set of snowflakes kept as a sorted vector.  Meant for the few IDs stored
+// with every message (mentions), where a std::set would allocate a node for
+// each one.  Has the parts of the std::set interface the code uses.
+class SnowflakeSet
+{
+public:
+	typedef std::vector<Snowflake>::const_iterator const_iterator;
+	typedef const_iterator iterator;
+
+	void insert(Snowflake sf)
+	{
+		auto it = std::lower_bound(m_items.begin(), m_items.end(), sf);
+		if (it == m_items.end() || *it != sf)
+			m_items.insert(it, sf);
+	}
+
+	const_iterator find(Snowflake sf) const
+	{
+		auto it = std::lower_bound(m_items.begin(), m_items.end(), sf);
+		return it != m_items.end() && *it == sf ? it : m_items.end();
+	}
+
+	size_t count(Snowflake sf) const { return find(sf) != end() ? 1 : 0; }
+
+	const_iterator begin() const { return m_items.begin(); }
+	const_iterator end() const { return m_items.end(); }
+	size_t size() const { return m_items.size(); }
+	size_t capacity() const { return m_items.capacity(); }
+	bool empty() const { return m_items.empty(); }
+	void clear() { m_items.clear(); }
+
+private:
+	std::vector<Snowflake> m_items;
+};
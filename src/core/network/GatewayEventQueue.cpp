@@ -0,0 +1,338 @@
+#include <map>
+#include "GatewayEventQueue.hpp"
+#include "../utils/Util.hpp"
+#include "../config/SettingsManager.hpp"
+
+using Json = nlohmann::json;
+
+static GatewayEventQueue g_GEQSingleton;
+
+GatewayEventQueue* GetGatewayEventQueue()
+{
+	return &g_GEQSingleton;
+}
+
+std::string GetStatusStringFromGameJsonObject(Json& game)
+{
+	if (!game.contains("type") || !game["type"].is_number_integer()) {
+		DbgPrintF("Returning nothing because type didn't exist");
+		return "";
+	}
+
+	int type = game["type"];
+	switch (type) {
+		default:
+			return "";
+		case ACTIVITY_PLAYING:
+			return "Playing " + GetFieldSafe(game, "name");
+		case ACTIVITY_STREAMING:
+			return "Streaming " + GetFieldSafe(game, "details");
+		case ACTIVITY_LISTENING:
+			return "Listening to " + GetFieldSafe(game, "name");
+		case ACTIVITY_WATCHING:
+			return "Watching " + GetFieldSafe(game, "name");
+		case ACTIVITY_COMPETING:
+			return "Competing";
+		case ACTIVITY_CUSTOM_STATUS:
+			return GetFieldSafe(game, "state");
+	}
+}
+
+std::string GetStatusFromActivities(Json& activities)
+{
+	if (!activities.is_array() || activities.empty())
+		return "";
+
+	for (auto& activity : activities)
+	{
+		if (GetFieldSafe(activity, "name") == "Custom Status")
+			// prioritize custom status
+			return GetStatusStringFromGameJsonObject(activity);
+	}
+
+	return GetStatusStringFromGameJsonObject(activities[0]);
+}
+
+// The status text of a presence, empty if it has no activity.
+static std::string GetStatusFromPresence(Json& pres)
+{
+	// TODO: Server specific activities
+	if (pres.contains("game") && !pres["game"].is_null())
+		return GetStatusStringFromGameJsonObject(pres["game"]);
+	else if (pres.contains("activities") && !pres["activities"].is_null())
+		return GetStatusFromActivities(pres["activities"]);
+	else
+		return "";
+}
+
+static Snowflake GetGroupId(const std::string& idStr)
+{
+	/**/ if (idStr == "online")  return GROUP_ONLINE;
+	else if (idStr == "offline") return GROUP_OFFLINE;
+	else return GetIntFromString(idStr);
+}
+
+void GuildMemberRecord::Load(Json& j)
+{
+	// TYPING_START in a DM doesn't carry a member at all
+	if (!j.is_object())
+		return;
+
+	auto it = j.find("user");
+	if (it != j.end() && it->is_object())
+	{
+		m_user = GetSnowflake(*it, "id");
+		m_userData = std::move(*it);
+	}
+
+	m_avatar = GetFieldSafe(j, "avatar");
+	m_nick = GetFieldSafe(j, "nick");
+	m_joinedAt = ParseTime(GetFieldSafe(j, "joined_at"));
+
+	// TODO: Not sure if this is the guild specific or global status. Probably guild specific
+	it = j.find("presence");
+	if (it != j.end() && !it->is_null())
+	{
+		m_bHasPresence = true;
+		m_activeStatus = GetFieldSafe(*it, "status");
+		m_status = GetStatusFromPresence(*it);
+	}
+
+	it = j.find("roles");
+	if (it != j.end() && it->is_array())
+	{
+		for (auto& role : *it)
+			m_roles.push_back(GetSnowflakeFromJsonObject(role));
+	}
+}
+
+void MemberListItem::Load(Json& j)
+{
+	if (j.contains("group"))
+	{
+		m_bIsGroup = true;
+		m_groupId = GetGroupId(GetFieldSafe(j["group"], "id"));
+	}
+	else if (j.contains("member"))
+	{
+		m_bIsMember = true;
+		m_member.Load(j["member"]);
+	}
+}
+
+void MemberListOp::Load(Json& j)
+{
+	std::string opCode = j["op"];
+
+	if (opCode == "SYNC")
+	{
+		// TODO: j["range"].  Is the range we told discord about
+		// when subscribing to the channel using websocket.
+		m_type = OP_SYNC;
+		Json& items = j["items"];
+		m_items.resize(items.size());
+		for (size_t i = 0; i < items.size(); i++)
+			m_items[i].Load(items[i]);
+	}
+	else if (opCode == "INSERT" || opCode == "UPDATE")
+	{
+		m_type = opCode == "INSERT" ? OP_INSERT : OP_UPDATE;
+		m_index = j["index"];
+		m_items.resize(1);
+		m_items[0].Load(j["item"]);
+	}
+	else if (opCode == "DELETE")
+	{
+		m_type = OP_DELETE;
+		m_index = j["index"];
+	}
+	else if (opCode == "INVALIDATE")
+	{
+		m_type = OP_INVALIDATE;
+	}
+}
+
+void MemberListUpdate::Load(Json& data)
+{
+	m_guild = GetSnowflake(data, "guild_id");
+	m_memberCount = GetFieldSafeInt(data, "member_count");
+	m_onlineCount = GetFieldSafeInt(data, "online_count");
+
+	for (auto& group : data["groups"])
+		m_groups.push_back(std::make_pair(GetGroupId(GetFieldSafe(group, "id")), GetFieldSafeInt(group, "count")));
+
+	Json& ops = data["ops"];
+	m_ops.resize(ops.size());
+	for (size_t i = 0; i < ops.size(); i++)
+		m_ops[i].Load(ops[i]);
+}
+
+void MembersChunk::Load(Json& data)
+{
+	m_guild = GetSnowflake(data, "guild_id");
+
+	Json& members = data["members"];
+	if (members.is_array())
+	{
+		m_members.resize(members.size());
+		for (size_t i = 0; i < members.size(); i++)
+			m_members[i].Load(members[i]);
+	}
+
+	Json& notFound = data["not_found"];
+	if (notFound.is_array())
+	{
+		for (auto& nf : notFound)
+			m_notFound.push_back(GetSnowflakeFromJsonObject(nf));
+	}
+}
+
+void PresenceUpdate::Load(Json& data)
+{
+	Json& user = data["user"];
+	m_user = GetSnowflake(user, "id");
+
+	if (data.contains("status"))
+		m_activeStatus = GetFieldSafe(data, "status");
+
+	m_status = GetStatusFromPresence(data);
+
+	if (user.contains("global_name")) // the full user object is provided
+		m_userData = std::move(user);
+}
+
+void TypingStart::Load(Json& data)
+{
+	m_user = GetSnowflake(data, "user_id");
+	m_channel = GetSnowflake(data, "channel_id");
+	m_timestamp = time_t(GetFieldSafeInt(data, "timestamp"));
+
+	if (data.contains("guild_id"))
+	{
+		m_guild = GetSnowflake(data, "guild_id");
+		m_member.Load(data["member"]);
+	}
+}
+
+void MessageDelete::Load(Json& data)
+{
+	m_guild = GetSnowflake(data, "guild_id");
+	m_channel = GetSnowflake(data, "channel_id");
+	m_message = GetSnowflake(data, "id");
+}
+
+void MessageAck::Load(Json& data)
+{
+	// NOTE: Seems like this version of the read state object has different names for channel ID and message ID.
+	m_entry.Load(data, true);
+}
+
+typedef std::unique_ptr<GatewayEventData>(*DigestFunction)(Json& data);
+
+template<typename T>
+static std::unique_ptr<GatewayEventData> DigestData(Json& data)
+{
+	std::unique_ptr<T> pData(new T);
+	pData->Load(data);
+	return std::move(pData);
+}
+
+// Dispatches that are turned into records on the websocket thread.  These are
+// the frequent ones, or the ones that come in storms.
+static const std::map<std::string, DigestFunction> g_digestFunctions = {
+	{ "GUILD_MEMBER_LIST_UPDATE", &DigestData<MemberListUpdate> },
+	{ "GUILD_MEMBERS_CHUNK",      &DigestData<MembersChunk> },
+	{ "PRESENCE_UPDATE",          &DigestData<PresenceUpdate> },
+	{ "TYPING_START",             &DigestData<TypingStart> },
+	{ "MESSAGE_DELETE",           &DigestData<MessageDelete> },
+	{ "MESSAGE_ACK",              &DigestData<MessageAck> },
+};
+
+GatewayEvent GatewayEvent::Closed(int gatewayId, int closeCode)
+{
+	GatewayEvent event;
+	event.m_gatewayId = gatewayId;
+	event.m_bClosed = true;
+	event.m_closeCode = closeCode;
+	return event;
+}
+
+bool GatewayEvent::Digest(int gatewayId, const std::string& payload, GatewayEvent& event)
+{
+	DbgPrintF("Got Payload: %s [PAYLOAD ENDS HERE]", payload.c_str());
+
+	event.m_gatewayId = gatewayId;
+	event.m_payloadSize = payload.size();
+	event.m_opcode = -1;
+	event.m_sequence = -1;
+	event.m_type.clear();
+	event.m_pReady.reset();
+	event.m_pData.reset();
+	event.m_bClosed = false;
+	event.m_closeCode = 0;
+
+	try
+	{
+		std::string error;
+		if (!ReadyParser::Parse(payload, event.m_json, event.m_pReady, error))
+		{
+			DbgPrintF("ERROR: Could not parse gateway payload: %s", error.c_str());
+			return false;
+		}
+
+		auto& j = event.m_json;
+		if (j.contains("op") && j["op"].is_number_integer())
+			event.m_opcode = j["op"];
+
+		if (j.contains("s") && j["s"].is_number_integer())
+			event.m_sequence = j["s"];
+
+		if (j.contains("t") && j["t"].is_string())
+			event.m_type = j["t"];
+
+		auto iter = g_digestFunctions.find(event.m_type);
+		if (iter != g_digestFunctions.end())
+		{
+			event.m_pData = iter->second(j["d"]);
+			event.m_json = Json();
+		}
+	}
+	catch (nlohmann::json::exception& ex)
+	{
+		DbgPrintF("ERROR: Could not parse gateway payload: %s", ex.what());
+		return false;
+	}
+
+	return true;
+}
+
+bool GatewayEventQueue::Push(GatewayEvent&& event)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	bool wasEmpty = m_events.empty();
+	m_events.push_back(std::move(event));
+	return wasEmpty;
+}
+
+bool GatewayEventQueue::Pop(GatewayEvent& event)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (m_events.empty())
+		return false;
+
+	event = std::move(m_events.front());
+	m_events.pop_front();
+	return true;
+}
+
+void GatewayEventQueue::Clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_events.clear();
+}
+
+size_t GatewayEventQueue::Size() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_events.size();
+}
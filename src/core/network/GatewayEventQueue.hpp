@@ -0,0 +1,171 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <ctime>
+#include <nlohmann/json.h>
+#include "ReadyParser.hpp"
+
+// The records a dispatch was digested into.  Dispatches that have a digested
+// form don't keep their DOM, the owning thread only applies the records.
+struct GatewayEventData
+{
+	virtual ~GatewayEventData() {}
+};
+
+// A guild member, as found in GUILD_MEMBER_LIST_UPDATE, GUILD_MEMBERS_CHUNK and TYPING_START.
+struct GuildMemberRecord
+{
+	Snowflake m_user = 0;       // 0 if the member didn't carry a user object
+	nlohmann::json m_userData;  // the user object, to be loaded into the profile cache
+	std::string m_nick;
+	std::string m_avatar;
+	time_t m_joinedAt = 0;
+	std::vector<Snowflake> m_roles;
+	bool m_bHasPresence = false;
+	std::string m_activeStatus; // empty if the presence didn't carry one
+	std::string m_status;       // activity text
+
+	void Load(nlohmann::json& j);
+};
+
+// An entry of a member list, either a group header or a member.
+struct MemberListItem
+{
+	bool m_bIsGroup = false;
+	bool m_bIsMember = false;
+	Snowflake m_groupId = 0;
+	GuildMemberRecord m_member;
+
+	void Load(nlohmann::json& j);
+};
+
+struct MemberListOp
+{
+	enum eType
+	{
+		OP_UNKNOWN,
+		OP_SYNC,
+		OP_INSERT,
+		OP_DELETE,
+		OP_UPDATE,
+		OP_INVALIDATE,
+	};
+
+	eType m_type = OP_UNKNOWN;
+	int m_index = 0;
+	std::vector<MemberListItem> m_items; // the whole range for SYNC, one item for INSERT and UPDATE
+
+	void Load(nlohmann::json& j);
+};
+
+struct MemberListUpdate : GatewayEventData
+{
+	Snowflake m_guild = 0;
+	int m_memberCount = 0;
+	int m_onlineCount = 0;
+	std::vector<std::pair<Snowflake, int>> m_groups; // group ID and member count
+	std::vector<MemberListOp> m_ops;
+
+	void Load(nlohmann::json& data);
+};
+
+struct MembersChunk : GatewayEventData
+{
+	Snowflake m_guild = 0;
+	std::vector<GuildMemberRecord> m_members;
+	std::vector<Snowflake> m_notFound;
+
+	void Load(nlohmann::json& data);
+};
+
+struct PresenceUpdate : GatewayEventData
+{
+	Snowflake m_user = 0;
+	nlohmann::json m_userData;  // only if the full user object was sent
+	std::string m_activeStatus; // empty if it didn't change
+	std::string m_status;
+
+	void Load(nlohmann::json& data);
+};
+
+struct TypingStart : GatewayEventData
+{
+	Snowflake m_guild = 0;
+	Snowflake m_channel = 0;
+	Snowflake m_user = 0;
+	time_t m_timestamp = 0;
+	GuildMemberRecord m_member; // guilds only
+
+	void Load(nlohmann::json& data);
+};
+
+struct MessageDelete : GatewayEventData
+{
+	Snowflake m_guild = 0;
+	Snowflake m_channel = 0;
+	Snowflake m_message = 0;
+
+	void Load(nlohmann::json& data);
+};
+
+struct MessageAck : GatewayEventData
+{
+	ReadStateEntry m_entry;
+
+	void Load(nlohmann::json& data);
+};
+
+// A gateway message that was already parsed on the websocket thread, or the
+// connection closing.  The owning (UI) thread only has to apply it to the state.
+struct GatewayEvent
+{
+	int m_gatewayId = -1;
+	int m_opcode = -1;
+	int m_sequence = -1;     // -1 if the message didn't carry one
+	std::string m_type;      // dispatch type, empty if this isn't a dispatch
+	size_t m_payloadSize = 0;
+	nlohmann::json m_json;   // the whole message, handlers look at j["d"].  Null if m_pData is set
+	std::unique_ptr<ReadyData> m_pReady; // READY only, the records taken out of m_json
+	std::unique_ptr<GatewayEventData> m_pData; // the digested dispatch, if it has a digested form
+	bool m_bClosed = false;  // the connection was closed with m_closeCode, nothing else is set
+	int m_closeCode = 0;
+
+	// Parses a raw gateway payload into an event.  Safe to call from any thread.
+	// Returns false if the payload isn't valid JSON.
+	static bool Digest(int gatewayId, const std::string& payload, GatewayEvent& event);
+
+	// Makes the event that tells the owning thread the connection was closed.
+	static GatewayEvent Closed(int gatewayId, int closeCode);
+};
+
+// Thread safe FIFO of gateway events, filled by the websocket thread and
+// drained by the thread owning the DiscordInstance.
+class GatewayEventQueue
+{
+public:
+	// Queues an event.  Returns true if the queue was empty before, meaning the
+	// consumer has to be woken up.  If it was not empty, the consumer was already
+	// notified and will get to this event when draining the queue.
+	bool Push(GatewayEvent&& event);
+
+	// Takes the oldest event off the queue.  Returns false if the queue is empty.
+	bool Pop(GatewayEvent& event);
+
+	// Drops all events.  Used when the gateway connection is torn down.
+	void Clear();
+
+	size_t Size() const;
+
+private:
+	mutable std::mutex m_mutex;
+	std::deque<GatewayEvent> m_events;
+};
+
+GatewayEventQueue* GetGatewayEventQueue();
+
+// The status text of a presence's "game" object or its list of activities.
+std::string GetStatusStringFromGameJsonObject(nlohmann::json& game);
+std::string GetStatusFromActivities(nlohmann::json& activities);
@@ -46,3 +46,78 @@ void HTTPClient::DefaultRequestHandler(NetRequest* pRequest)
 {
 	GetFrontend()->OnRequestDone(pRequest);
 }
+
+bool HTTPClient::CanCoalesce(const NetRequest& request)
+{
+	// Progress requests report to their own handler as they go, so they can't share
+	return request.type == NetRequest::GET;
+}
+
+std::string HTTPClient::GetCoalescingKey(const NetRequest& request)
+{
+	return request.url + '\n' + request.authorization;
+}
+
+bool HTTPClient::JoinInFlightRequest(NetRequest& request)
+{
+	if (!CanCoalesce(request))
+		return false;
+
+	std::lock_guard<std::mutex> lock(m_inFlightMutex);
+	m_coalescingStats.m_requests++;
+
+	auto result = m_inFlight.insert(std::make_pair(GetCoalescingKey(request), InFlightEntry()));
+	if (result.second)
+	{
+		result.first->second.m_token = m_nextInFlightToken++;
+		request.m_inFlightToken = result.first->second.m_token;
+		return false;
+	}
+
+	DbgPrintF("Coalescing request to %s with the one in flight", request.url.c_str());
+	result.first->second.m_waiters.push_back(request);
+	m_coalescingStats.m_coalesced++;
+	return true;
+}
+
+void HTTPClient::ClearInFlightRequests()
+{
+	std::lock_guard<std::mutex> lock(m_inFlightMutex);
+	m_inFlight.clear();
+}
+
+void HTTPClient::FinishRequest(NetRequest& request)
+{
+	std::vector<NetRequest> waiters;
+
+	if (CanCoalesce(request) && request.m_inFlightToken != 0)
+	{
+		// Take it out of the table first, so that a handler requesting the same
+		// thing again starts a new request instead of joining this finished one.
+		// If the table was cleared while this one was out, the entry for its key
+		// (if any) belongs to a newer request, so leave it alone.
+		std::lock_guard<std::mutex> lock(m_inFlightMutex);
+
+		auto iter = m_inFlight.find(GetCoalescingKey(request));
+		if (iter != m_inFlight.end() && iter->second.m_token == request.m_inFlightToken)
+		{
+			waiters.swap(iter->second.m_waiters);
+			m_inFlight.erase(iter);
+		}
+	}
+
+	request.pFunc(&request);
+
+	for (auto& waiter : waiters)
+	{
+		waiter.result = request.result;
+		waiter.response = request.response;
+		waiter.pFunc(&waiter);
+	}
+}
+
+HTTPClient::CoalescingStats HTTPClient::GetCoalescingStats()
+{
+	std::lock_guard<std::mutex> lock(m_inFlightMutex);
+	return m_coalescingStats;
+}
@@ -2,6 +2,8 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <mutex>
 #include <cstring>
 #include <cstdint>
 #include "DiscordRequest.hpp"
@@ -73,6 +75,8 @@ struct NetRequest
 	size_t m_offset; // used only for *_PROGRESS
 	size_t m_length; // used only for *_PROGRESS
 	bool m_bCancelOp = false; // used only for *_PROGRESS
+	int m_rateLimitRetries = 0; // how many times this request was rejected with a 429
+	uint64_t m_inFlightToken = 0; // identifies the in flight entry this GET leads, if any
 
 	size_t GetOffset() const {
 		return m_offset;
@@ -143,6 +147,46 @@ public:
 	) = 0;
 
 	static void DefaultRequestHandler(NetRequest* pRequest);
+
+	struct CoalescingStats
+	{
+		uint64_t m_requests = 0;  // GETs that could have been coalesced
+		uint64_t m_coalesced = 0; // ... that joined an identical GET already in flight
+	};
+
+	CoalescingStats GetCoalescingStats();
+
+	// Calls the handler of a request that got its final response, as well as the
+	// handlers of the requests that were coalesced into it.
+	void FinishRequest(NetRequest& request);
+
+protected:
+	// Single-flight for GETs: while a GET is in flight, identical ones (same URL
+	// and authorization) don't go out again.  They wait for the first one, and
+	// get a copy of its response.
+	//
+	// Returns true if `request` was attached to one that is in flight already.
+	// Otherwise it's now the one in flight for its key, and must be sent.  It
+	// gets stamped with the entry's token, so that only it can finish the entry.
+	bool JoinInFlightRequest(NetRequest& request);
+
+	// Forgets the requests in flight, and drops their waiters without calling them.
+	void ClearInFlightRequests();
+
+private:
+	static bool CanCoalesce(const NetRequest& request);
+	static std::string GetCoalescingKey(const NetRequest& request);
+
+	struct InFlightEntry
+	{
+		uint64_t m_token = 0; // matches the m_inFlightToken of the request sent out
+		std::vector<NetRequest> m_waiters;
+	};
+
+	std::mutex m_inFlightMutex;
+	std::map<std::string, InFlightEntry> m_inFlight; // key -> entry
+	uint64_t m_nextInFlightToken = 1;
+	CoalescingStats m_coalescingStats;
 };
 
 HTTPClient* GetHTTPClient();
@@ -0,0 +1,228 @@
+#include "RateLimiter.hpp"
+#include "../utils/Util.hpp"
+
+static const char* GetMethodName(NetRequest::eType type)
+{
+	switch (type)
+	{
+		case NetRequest::POST:
+		case NetRequest::POST_JSON:
+			return "POST";
+		case NetRequest::PUT:
+		case NetRequest::PUT_JSON:
+		case NetRequest::PUT_OCTETS:
+		case NetRequest::PUT_OCTETS_PROGRESS:
+			return "PUT";
+		case NetRequest::PATCH:
+			return "PATCH";
+		case NetRequest::DELETE_:
+			return "DELETE";
+		default:
+			return "GET";
+	}
+}
+
+static bool IsNumeric(const std::string& str)
+{
+	if (str.empty())
+		return false;
+
+	for (char c : str) {
+		if (c < '0' || c > '9')
+			return false;
+	}
+
+	return true;
+}
+
+static bool IsMajorParameter(const std::string& segment)
+{
+	return segment == "channels" || segment == "guilds" || segment == "webhooks";
+}
+
+// Returns the "channels/1234" part of a route, or an empty string.
+static std::string GetMajorParameter(const std::string& route)
+{
+	static const char* const majors[] = { "/channels/", "/guilds/", "/webhooks/" };
+
+	for (const char* major : majors)
+	{
+		size_t pos = route.find(major);
+		if (pos == std::string::npos)
+			continue;
+
+		size_t end = route.find('/', pos + strlen(major));
+		return route.substr(pos + 1, end == std::string::npos ? std::string::npos : end - pos - 1);
+	}
+
+	return "";
+}
+
+std::string RateLimiter::GetRoute(const NetRequest& request)
+{
+	std::string url = request.url;
+
+	size_t pos = url.find("://");
+	if (pos != std::string::npos)
+		url = url.substr(pos + 3);
+
+	pos = url.find_first_of("?#");
+	if (pos != std::string::npos)
+		url.resize(pos);
+
+	std::string route = GetMethodName(request.type);
+	route += ' ';
+
+	bool keptMajor = false;
+	std::string previous;
+	size_t start = 0;
+	while (start <= url.size())
+	{
+		size_t end = url.find('/', start);
+		if (end == std::string::npos)
+			end = url.size();
+
+		std::string segment = url.substr(start, end - start);
+
+		if (start != 0)
+			route += '/';
+
+		if (previous == "reactions")
+		{
+			// All emojis of a message share a bucket
+			route += ":emoji";
+		}
+		else if (IsNumeric(segment) && !(IsMajorParameter(previous) && !keptMajor))
+		{
+			route += ":id";
+		}
+		else
+		{
+			if (IsNumeric(segment))
+				keptMajor = true;
+
+			route += segment;
+		}
+
+		previous = segment;
+		start = end + 1;
+	}
+
+	return route;
+}
+
+RateLimiter::Bucket* RateLimiter::GetBucket(const std::string& route)
+{
+	auto iter = m_routeBuckets.find(route);
+	if (iter == m_routeBuckets.end())
+		return nullptr;
+
+	return &m_buckets[iter->second + "|" + GetMajorParameter(route)];
+}
+
+uint64_t RateLimiter::Acquire(const std::string& route, bool authorized, uint64_t now)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	if (m_globalBlockedUntil > now)
+		return m_globalBlockedUntil;
+
+	Bucket* pBucket = GetBucket(route);
+	if (pBucket)
+	{
+		if (pBucket->m_resetAt <= now)
+		{
+			// The real reset time comes with the next response.  Until then
+			// assume the window is at least a second long.
+			pBucket->m_remaining = pBucket->m_limit;
+			pBucket->m_resetAt = now + 1000;
+		}
+
+		if (pBucket->m_remaining <= 0)
+			return pBucket->m_resetAt;
+	}
+
+	if (authorized)
+	{
+		if (now - m_globalWindowStart >= 1000)
+		{
+			m_globalWindowStart = now;
+			m_globalCount = 0;
+		}
+
+		if (m_globalCount >= GLOBAL_LIMIT)
+			return m_globalWindowStart + 1000;
+
+		m_globalCount++;
+	}
+
+	if (pBucket)
+		pBucket->m_remaining--;
+
+	return 0;
+}
+
+uint64_t RateLimiter::OnResponse(const std::string& route, int status, const RateLimitHeaders& headers, uint64_t now)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	Bucket* pBucket = nullptr;
+	if (!headers.m_bucket.empty())
+	{
+		m_routeBuckets[route] = headers.m_bucket;
+		pBucket = GetBucket(route);
+
+		if (headers.m_limit > 0)
+			pBucket->m_limit = headers.m_limit;
+
+		if (headers.m_resetAfter >= 0.0)
+		{
+			uint64_t resetAt = now + uint64_t(headers.m_resetAfter * 1000.0);
+
+			// A new window started since our last look, our count is out of date
+			if (resetAt > pBucket->m_resetAt)
+				pBucket->m_remaining = pBucket->m_limit;
+
+			pBucket->m_resetAt = resetAt;
+		}
+
+		// Requests still in flight have already taken their slots from our count,
+		// so trust whichever number is lower.
+		if (headers.m_remaining >= 0 && headers.m_remaining < pBucket->m_remaining)
+			pBucket->m_remaining = headers.m_remaining;
+	}
+	else
+	{
+		pBucket = GetBucket(route);
+	}
+
+	if (status != HTTP_TOOMANYREQS)
+		return 0;
+
+	// Discord always sends Retry-After with a 429.  Back off for a second if it's missing.
+	double retryAfter = headers.m_retryAfter >= 0.0 ? headers.m_retryAfter : 1.0;
+	uint64_t retryAt = now + uint64_t(retryAfter * 1000.0);
+
+	if (headers.m_global)
+	{
+		DbgPrintF("Hit the global rate limit, retrying in %.2f s", retryAfter);
+		if (m_globalBlockedUntil < retryAt)
+			m_globalBlockedUntil = retryAt;
+	}
+	else
+	{
+		if (!pBucket)
+		{
+			// Limited before we learned the bucket, give the route one of its own
+			m_routeBuckets[route] = route;
+			pBucket = GetBucket(route);
+		}
+
+		DbgPrintF("Hit the rate limit of bucket %s, retrying in %.2f s", headers.m_bucket.c_str(), retryAfter);
+		pBucket->m_remaining = 0;
+		if (pBucket->m_resetAt < retryAt)
+			pBucket->m_resetAt = retryAt;
+	}
+
+	return retryAt;
+}
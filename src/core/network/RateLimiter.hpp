@@ -0,0 +1,69 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <mutex>
+#include <cstdint>
+#include "HTTPClient.hpp"
+
+// The rate limit related headers of a response.  Negative numbers mean the
+// header was missing.
+struct RateLimitHeaders
+{
+	std::string m_bucket;       // X-RateLimit-Bucket
+	int m_limit = -1;           // X-RateLimit-Limit
+	int m_remaining = -1;       // X-RateLimit-Remaining
+	double m_resetAfter = -1.0; // X-RateLimit-Reset-After, in seconds
+	double m_retryAfter = -1.0; // Retry-After, in seconds
+	bool m_global = false;      // X-RateLimit-Global
+};
+
+// Keeps track of Discord's rate limit buckets so that requests are held back
+// before the server has to reject them.
+//
+// Discord doesn't publish the buckets.  Every route starts out unlimited, and
+// learns its bucket from the X-RateLimit-* headers of the first response.
+// Routes that report the same bucket hash share its budget, as long as their
+// major parameter (channel, guild or webhook ID) is the same too.
+//
+// Times are in milliseconds, on the GetTimeMs() clock.  Thread safe.
+class RateLimiter
+{
+public:
+	// Requests per second allowed across all authorized routes
+	static constexpr int GLOBAL_LIMIT = 50;
+
+	// Identifies the route of a request: the method, the host and the path with
+	// every ID other than the major parameter taken out.
+	static std::string GetRoute(const NetRequest& request);
+
+	// Takes a slot for a request on `route`.  Returns 0 if the request may be
+	// sent now, otherwise the time at which to try again.
+	uint64_t Acquire(const std::string& route, bool authorized, uint64_t now);
+
+	// Learns from the headers of a response on `route`.  If it was a 429,
+	// returns the time at which the request may be retried, otherwise 0.
+	uint64_t OnResponse(const std::string& route, int status, const RateLimitHeaders& headers, uint64_t now);
+
+private:
+	struct Bucket
+	{
+		int m_limit = 1;
+		int m_remaining = 1;
+		uint64_t m_resetAt = 0;
+	};
+
+	Bucket* GetBucket(const std::string& route);
+
+	std::mutex m_mutex;
+
+	// route -> bucket hash, as learned from the responses
+	std::map<std::string, std::string> m_routeBuckets;
+
+	// bucket hash + major parameter -> bucket
+	std::map<std::string, Bucket> m_buckets;
+
+	uint64_t m_globalBlockedUntil = 0;
+	uint64_t m_globalWindowStart = 0;
+	int m_globalCount = 0;
+};
@@ -0,0 +1,435 @@
+#include <deque>
+#include <memory>
+#include "ReadyParser.hpp"
+#include "../DiscordInstance.hpp"
+#include "../utils/Util.hpp"
+#include "../utils/Threading.hpp"
+
+using Json = nlohmann::json;
+
+void ReadStateEntry::Load(const nlohmann::json& j, bool bAlternate)
+{
+	m_channel      = GetSnowflake(j, bAlternate ? "channel_id" : "id");
+	m_lastMessage  = GetSnowflake(j, bAlternate ? "message_id" : "last_message_id");
+	m_flags        = GetFieldSafeInt(j, "flags");
+	m_lastViewed   = GetFieldSafeInt(j, "last_viewed");
+	m_mentionCount = GetFieldSafeInt(j, "mention_count");
+	m_version      = j.contains("version") ? GetFieldSafeInt(j, "version") : -1;
+}
+
+namespace
+{
+
+// Turns guild objects into detached guilds on a few worker threads, while the
+// rest of the payload is still being parsed.  The guilds come out in the order
+// they were submitted.  With no threads, guilds are parsed right away.
+class GuildParsePool
+{
+public:
+	explicit GuildParsePool(int nThreads)
+	{
+		if (nThreads > ReadyParser::MAX_PARSE_THREADS)
+			nThreads = ReadyParser::MAX_PARSE_THREADS;
+
+		for (int i = 0; i < nThreads; i++)
+		{
+			try
+			{
+				m_threads.emplace_back(new threading::thread([this] { Run(); }));
+			}
+			catch (std::exception& ex)
+			{
+				DbgPrintF("Could not start guild parser thread: %s", ex.what());
+				break;
+			}
+		}
+
+		m_maxQueued = m_threads.size() * 2;
+	}
+
+	~GuildParsePool()
+	{
+		Stop();
+	}
+
+	// Takes the guild object.  Blocks while the workers are behind, so that
+	// the objects waiting to be parsed don't pile up.
+	void Submit(Json&& guild)
+	{
+		// Only this thread adds slots.  The workers get pointers to them, which
+		// stay valid as the deque grows.
+		m_slots.push_back(Slot());
+		Slot* pSlot = &m_slots.back();
+
+		if (m_threads.empty())
+		{
+			Parse(guild, *pSlot);
+			return;
+		}
+
+		threading::unique_lock<threading::mutex> lock(m_mutex);
+		while (m_jobs.size() >= m_maxQueued)
+			m_spaceCv.wait(lock);
+
+		m_jobs.push_back(Job());
+		m_jobs.back().m_json = std::move(guild);
+		m_jobs.back().m_pSlot = pSlot;
+		lock.unlock();
+
+		m_jobsCv.notify_one();
+	}
+
+	// Waits for all guilds to be parsed and moves them to `ready`.  Returns false
+	// if any of them couldn't be parsed, the others are moved anyway.
+	bool Finish(ReadyData& ready, std::string& error)
+	{
+		Stop();
+
+		ready.m_guilds.reserve(ready.m_guilds.size() + m_slots.size());
+		for (auto& slot : m_slots)
+		{
+			if (!slot.m_bValid)
+				continue;
+
+			ready.m_guilds.push_back(std::move(slot.m_guild));
+			for (auto& user : slot.m_users)
+				ready.m_profiles.push_back(std::move(user));
+		}
+
+		m_slots.clear();
+		error = m_error;
+		return m_error.empty();
+	}
+
+	static int GetThreadCount()
+	{
+		// One core is already busy parsing the payload.  0 if the count is unknown.
+		return int(threading::thread::hardware_concurrency()) - 1;
+	}
+
+private:
+	struct Slot
+	{
+		Guild m_guild;
+		std::vector<Json> m_users;
+		bool m_bValid = false;
+	};
+
+	struct Job
+	{
+		Json m_json;
+		Slot* m_pSlot = nullptr;
+	};
+
+	void Parse(Json& guild, Slot& slot)
+	{
+		try
+		{
+			DiscordInstance::ParseGuild(slot.m_guild, guild, &slot.m_users);
+			slot.m_bValid = true;
+		}
+		catch (nlohmann::json::exception& ex)
+		{
+			DbgPrintF("ERROR: Could not parse guild: %s", ex.what());
+
+			threading::lock_guard<threading::mutex> lock(m_mutex);
+			if (m_error.empty())
+				m_error = ex.what();
+		}
+	}
+
+	void Run()
+	{
+		while (true)
+		{
+			threading::unique_lock<threading::mutex> lock(m_mutex);
+			while (m_jobs.empty() && !m_bStopping)
+				m_jobsCv.wait(lock);
+
+			// Stopping only ends the thread once the queue is done
+			if (m_jobs.empty())
+				break;
+
+			Job job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+			lock.unlock();
+
+			m_spaceCv.notify_one();
+			Parse(job.m_json, *job.m_pSlot);
+		}
+	}
+
+	// Lets the workers finish the queued jobs and waits for them.
+	void Stop()
+	{
+		if (m_threads.empty())
+			return;
+
+		m_mutex.lock();
+		m_bStopping = true;
+		m_mutex.unlock();
+
+		m_jobsCv.notify_all();
+
+		for (auto& pThread : m_threads)
+			pThread->join();
+
+		m_threads.clear();
+	}
+
+	threading::mutex m_mutex;
+	threading::condition_variable m_jobsCv;  // signaled when a job is queued, or when stopping
+	threading::condition_variable m_spaceCv; // signaled when a job is taken off the queue
+	std::deque<Job> m_jobs;
+	std::deque<Slot> m_slots;
+	size_t m_maxQueued = 0;
+	bool m_bStopping = false;
+	std::vector<std::unique_ptr<threading::thread> > m_threads;
+	std::string m_error;
+};
+
+// Builds the DOM the same way nlohmann's json_sax_dom_parser does, but diverts
+// the elements of READY's "guilds" and "read_state.entries" arrays into their
+// own small DOM, which is converted and dropped as soon as it's complete.
+// Guilds are handed to a GuildParsePool.
+class ReadySaxHandler : public nlohmann::json_sax<Json>
+{
+public:
+	ReadySaxHandler(Json& root, ReadyData& ready, int parseThreads) :
+		m_root(root), m_ready(ready), m_parseThreads(parseThreads) {}
+
+	// True if this was READY and its records were taken out of the DOM
+	bool IsStreamed() const { return m_bStreamed; }
+	const std::string& GetError() const { return m_error; }
+
+	// Waits for the guilds still being parsed.
+	bool Finish(std::string& error)
+	{
+		if (!m_pGuildPool)
+			return true;
+
+		bool bResult = m_pGuildPool->Finish(m_ready, error);
+		m_pGuildPool.reset();
+		return bResult;
+	}
+
+	bool null() override
+	{
+		HandleValue(nullptr);
+		return true;
+	}
+
+	bool boolean(bool val) override
+	{
+		HandleValue(val);
+		return true;
+	}
+
+	bool number_integer(number_integer_t val) override
+	{
+		HandleValue(val);
+		return true;
+	}
+
+	bool number_unsigned(number_unsigned_t val) override
+	{
+		HandleValue(val);
+		return true;
+	}
+
+	bool number_float(number_float_t val, const string_t&) override
+	{
+		HandleValue(val);
+		return true;
+	}
+
+	bool string(string_t& val) override
+	{
+		if (m_stack.size() == 1 && m_lastKey == "t" && val == "READY")
+			m_bIsReady = true;
+
+		HandleValue(val);
+		return true;
+	}
+
+	bool binary(binary_t& val) override
+	{
+		HandleValue(std::move(val));
+		return true;
+	}
+
+	bool start_object(std::size_t) override
+	{
+		if (m_bIsReady && !m_stack.empty() && (m_stack.back() == m_pGuilds || m_stack.back() == m_pEntries))
+		{
+			// Start of a guild or read state entry, keep it to the side
+			m_element = Json::object();
+			m_stack.push_back(&m_element);
+			return true;
+		}
+
+		Json* pObject = HandleValue(Json::value_t::object);
+
+		if (m_stack.size() == 1 && m_lastKey == "d")
+		{
+			m_pData = pObject;
+			m_bStreamed = m_bIsReady;
+		}
+		else if (m_stack.size() == 2 && m_stack.back() == m_pData && m_lastKey == "read_state")
+			m_pReadState = pObject;
+
+		m_stack.push_back(pObject);
+		return true;
+	}
+
+	bool key(string_t& val) override
+	{
+		m_lastKey = val;
+		m_pObjectElement = &(*m_stack.back())[val];
+		return true;
+	}
+
+	bool end_object() override
+	{
+		Json* pObject = m_stack.back();
+		m_stack.pop_back();
+
+		if (pObject != &m_element)
+			return true;
+
+		if (m_stack.back() == m_pGuilds)
+		{
+			if (!m_pGuildPool)
+				m_pGuildPool.reset(new GuildParsePool(m_parseThreads < 0 ? GuildParsePool::GetThreadCount() : m_parseThreads));
+
+			m_pGuildPool->Submit(std::move(m_element));
+		}
+		else
+		{
+			ReadStateEntry entry;
+			entry.Load(m_element, false);
+			m_ready.m_readStates.push_back(entry);
+		}
+
+		m_element = Json();
+		return true;
+	}
+
+	bool start_array(std::size_t) override
+	{
+		Json* pArray = HandleValue(Json::value_t::array);
+
+		if (m_bIsReady && m_stack.size() == 2 && m_stack.back() == m_pData && m_lastKey == "guilds")
+			m_pGuilds = pArray;
+		else if (m_bIsReady && m_stack.size() == 3 && m_stack.back() == m_pReadState && m_lastKey == "entries")
+			m_pEntries = pArray;
+
+		m_stack.push_back(pArray);
+		return true;
+	}
+
+	bool end_array() override
+	{
+		m_stack.pop_back();
+		return true;
+	}
+
+	bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override
+	{
+		m_error = ex.what();
+		return false;
+	}
+
+private:
+	template<typename Value>
+	Json* HandleValue(Value&& v)
+	{
+		if (m_stack.empty())
+		{
+			m_root = Json(std::forward<Value>(v));
+			return &m_root;
+		}
+
+		Json* pParent = m_stack.back();
+		if (pParent->is_array())
+		{
+			pParent->emplace_back(std::forward<Value>(v));
+			return &pParent->back();
+		}
+
+		*m_pObjectElement = Json(std::forward<Value>(v));
+		return m_pObjectElement;
+	}
+
+	Json& m_root;
+	ReadyData& m_ready;
+	int m_parseThreads;
+	std::vector<Json*> m_stack;
+	Json* m_pObjectElement = nullptr;
+	std::string m_lastKey;
+	std::string m_error;
+
+	bool m_bIsReady = false;
+	bool m_bStreamed = false;
+	Json* m_pData = nullptr;      // root["d"]
+	Json* m_pReadState = nullptr; // root["d"]["read_state"]
+	Json* m_pGuilds = nullptr;    // root["d"]["guilds"], stays empty
+	Json* m_pEntries = nullptr;   // root["d"]["read_state"]["entries"], stays empty
+	Json m_element;               // the guild or read state entry being read
+	std::unique_ptr<GuildParsePool> m_pGuildPool;
+};
+
+}
+
+bool ReadyParser::Parse(const std::string& payload, nlohmann::json& out, std::unique_ptr<ReadyData>& ready, std::string& error, int parseThreads)
+{
+	std::unique_ptr<ReadyData> pData(new ReadyData);
+	ReadySaxHandler handler(out, *pData, parseThreads);
+
+	if (!Json::sax_parse(payload, &handler))
+	{
+		error = handler.GetError();
+		return false;
+	}
+
+	if (!handler.Finish(error))
+		return false;
+
+	if (handler.IsStreamed())
+		ready = std::move(pData);
+	else
+		ready.reset();
+
+	return true;
+}
+
+void ReadyParser::Collect(nlohmann::json& data, ReadyData& ready)
+{
+	auto it = data.find("guilds");
+	if (it != data.end() && it->is_array())
+	{
+		GuildParsePool pool(GuildParsePool::GetThreadCount());
+		for (auto& elem : *it)
+			pool.Submit(std::move(elem));
+
+		it->clear();
+
+		std::string error;
+		if (!pool.Finish(ready, error))
+			DbgPrintF("ERROR: Some guilds in READY couldn't be parsed: %s", error.c_str());
+	}
+
+	it = data.find("read_state");
+	if (it != data.end() && it->is_object() && it->contains("entries") && (*it)["entries"].is_array())
+	{
+		Json& entries = (*it)["entries"];
+		ready.m_readStates.reserve(entries.size());
+		for (auto& elem : entries)
+		{
+			ReadStateEntry entry;
+			entry.Load(elem, false);
+			ready.m_readStates.push_back(entry);
+		}
+		entries.clear();
+	}
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <nlohmann/json.h>
+#include "../models/Snowflake.hpp"
+#include "../models/Guild.hpp"
+
+// A read state entry, as found in READY and MESSAGE_ACK.
+struct ReadStateEntry
+{
+	Snowflake m_channel = 0;
+	Snowflake m_lastMessage = 0;
+	int m_flags = 0;
+	int m_lastViewed = 0;
+	int m_mentionCount = 0;
+	int m_version = -1; // -1 if the entry didn't carry one
+
+	void Load(const nlohmann::json& j, bool bAlternate);
+};
+
+// The bulky parts of READY, turned into records while the payload was parsed.
+// Guilds are detached: they aren't part of any instance yet, and the things that
+// touch shared state (icons, profiles) are left for the owning thread to do.
+struct ReadyData
+{
+	std::vector<Guild> m_guilds;             // in the order Discord sent them
+	std::vector<nlohmann::json> m_profiles;  // users referenced by the guilds, load them into the profile cache
+	std::vector<ReadStateEntry> m_readStates;
+};
+
+// Parses gateway payloads with nlohmann's SAX interface.  Messages are turned
+// into a regular DOM, except for READY, which can run into tens of megabytes:
+// each of its guilds and read state entries is converted into a record as soon
+// as it has been read and then thrown away, so the DOM never holds more than
+// the few guilds waiting to be parsed.  Guilds are parsed on worker threads
+// while the rest of the payload is read.
+//
+// This only works if "t" comes before "d" in the payload, which is how Discord
+// sends them.  Otherwise READY is parsed like everything else, and Collect has
+// to be used to get the records out of the DOM.
+class ReadyParser
+{
+public:
+	// Most threads used to parse guilds in parallel, besides the one parsing the payload
+	static constexpr int MAX_PARSE_THREADS = 8;
+
+	// Parses a payload into `out`.  If it's a READY message, its guilds and read
+	// state entries end up in `ready` instead of the DOM.  Safe to call from any thread.
+	// `parseThreads` is how many threads parse guilds, -1 to use one less than the
+	// number of cores.
+	static bool Parse(const std::string& payload, nlohmann::json& out, std::unique_ptr<ReadyData>& ready, std::string& error, int parseThreads = -1);
+
+	// Moves the records out of an already parsed READY's "d" object.
+	static void Collect(nlohmann::json& data, ReadyData& ready);
+};
@@ -90,12 +90,46 @@ void WSConnectionMetadata::OnClose(WSClient* c, websocketpp::connection_hdl hdl)
 	DbgPrintF("Connection ID %d closed by gateway! %s", m_id, s.str().c_str());
 
 	m_errorReason = s.str();
+
+	int closeCode = pConn->get_remote_close_code();
+#ifdef ZLIB_SUP
+	// We dropped it ourselves, see OnMessage.  The session is still fine.
+	if (m_pInflater && m_pInflater->HasFailed())
+		closeCode = CloseCode::UNKNOWN_ERROR;
+#endif
 	
-	GetFrontend()->OnWebsocketClose(m_id, pConn->get_remote_close_code(), s.str());
+	GetFrontend()->OnWebsocketClose(m_id, closeCode, s.str());
 }
 
-void WSConnectionMetadata::OnMessage(websocketpp::connection_hdl hdl, WSClient::message_ptr msg)
+void WSConnectionMetadata::OnMessage(WSClient* c, websocketpp::connection_hdl hdl, WSClient::message_ptr msg)
 {
+#ifdef ZLIB_SUP
+	if (m_pInflater && msg->get_opcode() == websocketpp::frame::opcode::binary)
+	{
+		// Already closing
+		if (m_pInflater->HasFailed())
+			return;
+
+		std::string payload;
+		if (m_pInflater->Feed(msg->get_payload(), payload))
+		{
+			GetFrontend()->OnWebsocketMessage(m_id, payload);
+		}
+		else if (m_pInflater->HasFailed())
+		{
+			// Our inflate state no longer matches the server's.  Drop the connection
+			// without ending the session, so the client resumes it on a new connection
+			// with a fresh inflater.
+			websocketpp::lib::error_code ec;
+			c->close(hdl, websocketpp::close::status::value(CloseCode::UNKNOWN_ERROR), "decompression failed", ec);
+			if (ec)
+				DbgPrintF("Error initiating close: %s", ec.message().c_str());
+		}
+
+		return;
+	}
+#endif
+
 	if (msg->get_opcode() != websocketpp::frame::opcode::text)
 	{
 		DbgPrintF("ERROR: Got unhandled opcode %d", msg->get_opcode());
@@ -105,6 +139,74 @@ void WSConnectionMetadata::OnMessage(websocketpp::connection_hdl hdl, WSClient::
 	GetFrontend()->OnWebsocketMessage(m_id, msg->get_payload());
 }
 
+#ifdef ZLIB_SUP
+
+ZlibStreamInflater::ZlibStreamInflater()
+{
+	memset(&m_stream, 0, sizeof m_stream);
+
+	int res = inflateInit(&m_stream);
+	if (res != Z_OK) {
+		DbgPrintF("ERROR: inflateInit failed with code %d", res);
+		m_bFailed = true;
+		return;
+	}
+
+	m_bInitted = true;
+}
+
+ZlibStreamInflater::~ZlibStreamInflater()
+{
+	if (m_bInitted)
+		inflateEnd(&m_stream);
+}
+
+bool ZlibStreamInflater::Feed(const std::string& frame, std::string& out)
+{
+	static const char syncFlushSuffix[] = { '\x00', '\x00', '\xFF', '\xFF' };
+
+	if (!m_bInitted || m_bFailed)
+		return false;
+
+	m_pending.append(frame);
+	m_compressedBytes += frame.size();
+
+	// Wait for the rest of the message.
+	if (m_pending.size() < sizeof syncFlushSuffix ||
+		memcmp(m_pending.data() + m_pending.size() - sizeof syncFlushSuffix, syncFlushSuffix, sizeof syncFlushSuffix) != 0)
+		return false;
+
+	m_stream.next_in = (Bytef*) m_pending.data();
+	m_stream.avail_in = (uInt) m_pending.size();
+
+	out.clear();
+
+	char buffer[16384];
+	do
+	{
+		m_stream.next_out = (Bytef*) buffer;
+		m_stream.avail_out = (uInt) sizeof buffer;
+
+		int res = inflate(&m_stream, Z_SYNC_FLUSH);
+		if (res != Z_OK && res != Z_BUF_ERROR)
+		{
+			DbgPrintF("ERROR: inflate failed with code %d (%s)", res, m_stream.msg ? m_stream.msg : "no message");
+			m_pending.clear();
+			m_bFailed = true;
+			return false;
+		}
+
+		out.append(buffer, sizeof buffer - m_stream.avail_out);
+	}
+	while (m_stream.avail_out == 0);
+
+	m_pending.clear();
+	m_inflatedBytes += out.size();
+	return true;
+}
+
+#endif
+
 WebsocketClient::WebsocketClient()
 {
 }
@@ -207,7 +309,7 @@ void WebsocketClient::Kill()
 	m_thread->join();
 }
 
-int WebsocketClient::Connect(const std::string& uri)
+int WebsocketClient::Connect(const std::string& uri, bool zlibStream)
 {
 	websocketpp::lib::error_code ec;
 	DbgPrintF("WebsocketClient: Connecting to %s", uri.c_str());
@@ -222,7 +324,7 @@ int WebsocketClient::Connect(const std::string& uri)
 	con->append_header("Origin", "https://discord.com");
 
 	int newID = m_nextId++;
-	WSConnectionMetadata::Pointer pMetadata(new WSConnectionMetadata(newID, con->get_handle(), uri));
+	WSConnectionMetadata::Pointer pMetadata(new WSConnectionMetadata(newID, con->get_handle(), uri, zlibStream));
 	m_connList[newID] = pMetadata;
 
 	con->set_open_handler(websocketpp::lib::bind(
@@ -246,6 +348,7 @@ int WebsocketClient::Connect(const std::string& uri)
 	con->set_message_handler(websocketpp::lib::bind(
 		&WSConnectionMetadata::OnMessage,
 		pMetadata,
+		&m_endpoint,
 		websocketpp::lib::placeholders::_1,
 		websocketpp::lib::placeholders::_2
 	));
@@ -2,6 +2,10 @@
 #include <websocketpp/config/asio_client.hpp>
 #include <websocketpp/client.hpp>
 
+#ifdef ZLIB_SUP
+#include <zlib.h>
+#endif
+
 namespace CloseCode
 {
 	enum {
@@ -30,6 +34,41 @@ typedef websocketpp::lib::asio::ssl::context AsioSslContext;
 typedef websocketpp::lib::shared_ptr<AsioSslContext> AsioSslContextSharedPtr;
 typedef websocketpp::transport::asio::tls_socket::connection::socket_type AsioSocketType;
 
+#ifdef ZLIB_SUP
+
+// Inflates a zlib-stream compressed connection.  The server sends one continuous
+// deflate stream for the lifetime of the connection, so the inflate context has to
+// survive between messages.  A message may span several frames; the last frame of
+// each message ends with the Z_SYNC_FLUSH suffix (00 00 FF FF).
+class ZlibStreamInflater
+{
+public:
+	ZlibStreamInflater();
+	~ZlibStreamInflater();
+
+	// Feeds a frame into the inflater.  Returns true and fills "out" once a whole
+	// message has been received.
+	bool Feed(const std::string& frame, std::string& out);
+
+	// True if the stream is broken.  Nothing else can be inflated, so the
+	// connection has to be dropped.
+	bool HasFailed() const { return m_bFailed; }
+
+	// Statistics.  Used to check how much the compression is actually saving.
+	uint64_t GetCompressedBytes() const { return m_compressedBytes; }
+	uint64_t GetInflatedBytes() const { return m_inflatedBytes; }
+
+private:
+	z_stream m_stream;
+	std::string m_pending;
+	bool m_bInitted = false;
+	bool m_bFailed = false;
+	uint64_t m_compressedBytes = 0;
+	uint64_t m_inflatedBytes = 0;
+};
+
+#endif
+
 class WSConnectionMetadata
 {
 public:
@@ -43,18 +82,23 @@ public:
 
 	typedef websocketpp::lib::shared_ptr<WSConnectionMetadata> Pointer;
  
-	WSConnectionMetadata(int id, websocketpp::connection_hdl hdl, std::string uri)
+	WSConnectionMetadata(int id, websocketpp::connection_hdl hdl, std::string uri, bool zlibStream)
 	  : m_id(id)
 	  , m_hdl(hdl)
 	  , m_status(CONNECTING)
 	  , m_uri(uri)
 	  , m_server("N/A")
-	{}
+	{
+#ifdef ZLIB_SUP
+		if (zlibStream)
+			m_pInflater.reset(new ZlibStreamInflater);
+#endif
+	}
 
 	void OnOpen(WSClient* c, websocketpp::connection_hdl hdl);
 	void OnFail(WSClient* c, websocketpp::connection_hdl hdl);
 	void OnClose(WSClient* c, websocketpp::connection_hdl hdl);
-	void OnMessage(websocketpp::connection_hdl hdl, WSClient::message_ptr msg);
+	void OnMessage(WSClient* c, websocketpp::connection_hdl hdl, WSClient::message_ptr msg);
 
 	websocketpp::connection_hdl GetHDL() const
 	{
@@ -78,6 +122,9 @@ private:
 	std::string m_uri;
 	std::string m_server;
 	std::string m_errorReason;
+#ifdef ZLIB_SUP
+	std::unique_ptr<ZlibStreamInflater> m_pInflater;
+#endif
 };
 
 struct WebsocketMessageParm
@@ -96,8 +143,9 @@ public:
 
 	void Kill();
 
-	// Returns a connection ID.
-	int Connect(const std::string& uri);
+	// Returns a connection ID.  If zlibStream is set, the connection is expected to
+	// use zlib-stream transport compression (the URI must request it too).
+	int Connect(const std::string& uri, bool zlibStream = false);
 
 	// Gets metadata about a connection.
 	WSConnectionMetadata::Pointer GetMetadata(int ID);
@@ -1,10 +1,18 @@
+#include <algorithm>
 #include "MessageCache.hpp"
 #include "ProfileCache.hpp"
+#include "MessageStore.hpp"
 #include "../Frontend.hpp"
 #include "../DiscordInstance.hpp"
 
 constexpr int MESSAGES_PER_REQUEST = 50;
 
+// How many stored messages to show when opening a channel
+constexpr size_t MESSAGES_FROM_STORE = 100;
+
+// How many messages a channel is cut down to when the cache is over budget
+constexpr size_t TRIMMED_CHANNEL_MESSAGES = 100;
+
 using nlohmann::json;
 static MessageCache g_MCSingleton;
 
@@ -14,8 +22,16 @@ MessageCache::MessageCache()
 
 void MessageCache::GetLoadedMessages(Snowflake channel, Snowflake guild, std::list<MessagePtr>& out)
 {
-	MessageChunkList& lst = m_mapMessages[channel];
+	MessageChunkList& lst = GetChannel(channel);
 	lst.m_guild = guild;
+	Touch(lst);
+
+	if (!lst.m_bOpened) {
+		size_t oldBytes = lst.m_bytes;
+		lst.m_bOpened = true;
+		lst.LoadFromStore(channel);
+		Account(lst, oldBytes);
+	}
 
 	for (auto& msg : lst.m_messages)
 		out.push_back(msg.second);
@@ -23,33 +39,99 @@ void MessageCache::GetLoadedMessages(Snowflake channel, Snowflake guild, std::li
 
 void MessageCache::ProcessRequest(Snowflake channel, ScrollDir::eScrollDir sd, Snowflake anchor, nlohmann::json& j, const std::string& channelName)
 {
-	MessageChunkList& lst = m_mapMessages[channel];
+	MessageChunkList& lst = GetChannel(channel);
+
+	// The messages were fetched relative to the gap's anchor
+	Snowflake source = 0;
+	MessagePtr pGap = lst.GetLoadedMessage(anchor);
+	if (pGap && pGap->IsLoadGap())
+		source = pGap->m_anchor;
+
+	GetMessageStore()->PutMany(channel, j, sd, source);
+
+	size_t oldBytes = lst.m_bytes;
+	Touch(lst);
 	lst.ProcessRequest(sd, anchor, j, channelName);
+	Account(lst, oldBytes);
+	EnforceBudget();
 }
 
-void MessageCache::AddMessage(Snowflake channel, const Message& msg)
+void MessageCache::AddMessage(Snowflake channel, const MessagePtr& msg)
 {
-	m_mapMessages[channel].AddMessage(msg);
+	MessageChunkList& lst = GetChannel(channel);
+	size_t oldBytes = lst.m_bytes;
+	lst.AddMessage(msg);
+	Account(lst, oldBytes);
+	EnforceBudget();
 }
 
-void MessageCache::EditMessage(Snowflake channel, const Message& msg)
+void MessageCache::EditMessage(Snowflake channel, const MessagePtr& msg)
 {
-	m_mapMessages[channel].EditMessage(msg);
+	MessageChunkList& lst = GetChannel(channel);
+	size_t oldBytes = lst.m_bytes;
+	lst.EditMessage(msg);
+	Account(lst, oldBytes);
+	EnforceBudget();
 }
 
 void MessageCache::DeleteMessage(Snowflake channel, Snowflake msg)
 {
-	m_mapMessages[channel].DeleteMessage(msg);
+	GetMessageStore()->Delete(channel, msg);
+
+	auto it = m_mapMessages.find(channel);
+	if (it == m_mapMessages.end())
+		return;
+
+	size_t oldBytes = it->second.m_bytes;
+	it->second.DeleteMessage(msg);
+	Account(it->second, oldBytes);
 }
 
 int MessageCache::GetMentionCountSince(Snowflake channel, Snowflake message, Snowflake user)
 {
-	return m_mapMessages[channel].GetMentionCountSince(message, user);
+	auto it = m_mapMessages.find(channel);
+	if (it == m_mapMessages.end())
+		return 0;
+
+	return it->second.GetMentionCountSince(message, user);
 }
 
 void MessageCache::ClearAllChannels()
 {
 	m_mapMessages.clear();
+	m_lru.clear();
+	m_bytes = 0;
+}
+
+MessageCache::ReconcileStats MessageCache::Reconcile(const std::map<Snowflake, Snowflake>& lastMessages)
+{
+	ReconcileStats stats;
+
+	for (auto it = m_mapMessages.begin(); it != m_mapMessages.end(); )
+	{
+		MessageChunkList& lst = it->second;
+		auto lmit = lastMessages.find(it->first);
+		if (lmit == lastMessages.end())
+		{
+			m_bytes -= lst.m_bytes;
+			m_lru.erase(lst.m_lruIter);
+			it = m_mapMessages.erase(it);
+			stats.m_dropped++;
+			continue;
+		}
+
+		size_t oldBytes = lst.m_bytes;
+		if (lst.Reconcile(lmit->second))
+			stats.m_gapped++;
+		else
+			stats.m_unchanged++;
+
+		Account(lst, oldBytes);
+		stats.m_keptMessages += lst.GetMessageCount();
+		++it;
+	}
+
+	return stats;
 }
 
 bool MessageCache::IsMessageLoaded(Snowflake channel, Snowflake message)
@@ -65,7 +147,109 @@ bool MessageCache::IsMessageLoaded(Snowflake channel, Snowflake message)
 
 MessagePtr MessageCache::GetLoadedMessage(Snowflake channel, Snowflake message)
 {
-	return m_mapMessages[channel].GetLoadedMessage(message);
+	auto it = m_mapMessages.find(channel);
+	if (it == m_mapMessages.end())
+		return nullptr;
+
+	return it->second.GetLoadedMessage(message);
+}
+
+void MessageCache::SetViewAnchor(Snowflake channel, Snowflake message)
+{
+	auto it = m_mapMessages.find(channel);
+	if (it != m_mapMessages.end())
+		it->second.m_viewAnchor = message;
+}
+
+void MessageCache::SetBudget(size_t bytes)
+{
+	m_budget = bytes;
+	EnforceBudget();
+}
+
+MessageCache::Stats MessageCache::GetStats() const
+{
+	Stats stats;
+	stats.m_bytes = m_bytes;
+	stats.m_budget = m_budget;
+	stats.m_trimmedMessages = m_trimmedMessages;
+	stats.m_evictedChannels = m_evictedChannels;
+
+	for (Snowflake channel : m_lru)
+	{
+		const MessageChunkList& lst = m_mapMessages.at(channel);
+
+		ChannelStats cs;
+		cs.m_channel = channel;
+		cs.m_messages = lst.GetMessageCount();
+		cs.m_bytes = lst.m_bytes;
+		stats.m_channels.push_back(cs);
+	}
+
+	return stats;
+}
+
+MessageChunkList& MessageCache::GetChannel(Snowflake channel)
+{
+	auto it = m_mapMessages.find(channel);
+	if (it != m_mapMessages.end())
+		return it->second;
+
+	MessageChunkList& lst = m_mapMessages[channel];
+	lst.m_lruIter = m_lru.insert(m_lru.begin(), channel);
+	m_bytes += lst.m_bytes;
+	return lst;
+}
+
+void MessageCache::Touch(MessageChunkList& lst)
+{
+	m_lru.splice(m_lru.begin(), m_lru, lst.m_lruIter);
+}
+
+void MessageCache::Account(MessageChunkList& lst, size_t oldBytes)
+{
+	m_bytes = m_bytes - oldBytes + lst.m_bytes;
+}
+
+void MessageCache::EnforceBudget()
+{
+	if (m_bytes <= m_budget)
+		return;
+
+	// The message list holds on to what it shows, leave that channel alone
+	Snowflake current = GetDiscordInstance() ? GetDiscordInstance()->GetCurrentChannelID() : 0;
+	size_t bytesBefore = m_bytes;
+
+	// First cut the least recently used channels down to what's around their last position
+	for (auto it = m_lru.rbegin(); it != m_lru.rend() && m_bytes > m_budget; ++it)
+	{
+		if (*it == current)
+			continue;
+
+		MessageChunkList& lst = m_mapMessages[*it];
+		size_t oldBytes = lst.m_bytes;
+		m_trimmedMessages += lst.Trim(TRIMMED_CHANNEL_MESSAGES);
+		Account(lst, oldBytes);
+	}
+
+	// Then drop whole channels.  They're loaded again when opened.
+	auto it = m_lru.end();
+	while (m_bytes > m_budget && it != m_lru.begin())
+	{
+		--it;
+		if (*it == current)
+			continue;
+
+		auto mit = m_mapMessages.find(*it);
+		m_bytes -= mit->second.m_bytes;
+		m_mapMessages.erase(mit);
+		it = m_lru.erase(it);
+		m_evictedChannels++;
+	}
+
+	// With only the current channel left nothing gets cut, and this runs for every message it receives
+	if (m_bytes != bytesBefore)
+		DbgPrintF("Message cache over budget, trimmed from %d KB to %d KB", int(bytesBefore / 1024), int(m_bytes / 1024));
 }
 
 MessageCache* GetMessageCache()
@@ -82,9 +266,58 @@ MessageChunkList::MessageChunkList()
 	msg->m_snowflake = 0;
 	msg->m_author = GetFrontend()->GetPleaseWaitText();
 	msg->m_message = "";
-	msg->m_dateFull = "";
-	msg->m_dateCompact = "";
-	m_messages[msg->m_snowflake] = msg;
+	PutMessage(msg);
+}
+
+void MessageChunkList::LoadFromStore(Snowflake channel)
+{
+	std::vector<json> stored;
+	if (!GetMessageStore()->Load(channel, MESSAGES_FROM_STORE, stored))
+		return;
+
+	// Replace the initial "please wait" placeholder
+	auto iter = m_messages.find(0);
+	if (iter != m_messages.end() && iter->second->IsLoadGap())
+		EraseMessage(iter->first);
+
+	Snowflake lowestMsg = (Snowflake) -1LL, highestMsg = 0;
+	for (json& data : stored)
+	{
+		auto msg = MakeMessage();
+		msg->Load(data, m_guild);
+		if (!msg->m_snowflake || m_messages.find(msg->m_snowflake) != m_messages.end())
+			continue;
+
+		PutMessage(msg);
+		m_unconfirmed.insert(msg->m_snowflake);
+
+		if (lowestMsg > msg->m_snowflake)
+			lowestMsg = msg->m_snowflake;
+		if (highestMsg < msg->m_snowflake)
+			highestMsg = msg->m_snowflake;
+	}
+
+	if (m_unconfirmed.empty())
+		return;
+
+	// Older history is fetched when scrolled to, like usual
+	auto msg = MakeMessage();
+	msg->m_author = GetFrontend()->GetPleaseWaitText();
+	msg->m_type = MessageType::GAP_UP;
+	msg->m_anchor = lowestMsg;
+	msg->m_snowflake = lowestMsg - 1;
+	PutMessage(msg);
+
+	// Right away fetch the latest messages.  They replace stored ones that
+	// were edited in the meantime and reveal those that were deleted.  If
+	// there are more new messages than one request returns, ProcessRequest
+	// leaves a gap in between.
+	msg = MakeMessage();
+	msg->m_author = GetFrontend()->GetPleaseWaitText();
+	msg->m_type = MessageType::GAP_AROUND;
+	msg->m_anchor = 0;
+	msg->m_snowflake = highestMsg + 1;
+	PutMessage(msg);
 }
 
 void MessageChunkList::ProcessRequest(ScrollDir::eScrollDir sd, Snowflake gap, json& j, const std::string& channelName)
@@ -98,11 +331,12 @@ void MessageChunkList::ProcessRequest(ScrollDir::eScrollDir sd, Snowflake gap, j
 	if (iter != m_messages.end())
 	{
 		if (iter->second->IsLoadGap())
-			m_messages.erase(iter);
+			EraseMessage(iter->first);
 	}
 
 	// for each message
 	int receivedMessages = 0;
+	std::set<Snowflake> receivedIds;
 	for (json& data : j)
 	{
 		auto msg = MakeMessage();
@@ -114,7 +348,8 @@ void MessageChunkList::ProcessRequest(ScrollDir::eScrollDir sd, Snowflake gap, j
 				addedMessages = true;
 		}
 
-		m_messages[msg->m_snowflake] = msg;
+		PutMessage(msg);
+		receivedIds.insert(msg->m_snowflake);
 		receivedMessages++;
 
 		if (lowestMsg > msg->m_snowflake)
@@ -123,6 +358,20 @@ void MessageChunkList::ProcessRequest(ScrollDir::eScrollDir sd, Snowflake gap, j
 			highestMsg = msg->m_snowflake;
 	}
 
+	// The server returns a contiguous range, so stored messages inside it that
+	// weren't returned have been deleted since they were stored.
+	if (receivedMessages && !m_unconfirmed.empty())
+	{
+		auto it = m_unconfirmed.lower_bound(lowestMsg);
+		while (it != m_unconfirmed.end() && *it <= highestMsg)
+		{
+			if (!receivedIds.count(*it))
+				EraseMessage(*it);
+
+			it = m_unconfirmed.erase(it);
+		}
+	}
+
 	bool addBefore = sd != ScrollDir::AFTER && receivedMessages >= MESSAGES_PER_REQUEST;
 	bool addAfter  = sd != ScrollDir::BEFORE;
 
@@ -132,7 +381,7 @@ void MessageChunkList::ProcessRequest(ScrollDir::eScrollDir sd, Snowflake gap, j
 		msg->m_type = MessageType::CHANNEL_HEADER;
 		msg->m_snowflake = 1;
 		msg->m_author = channelName;
-		m_messages[msg->m_snowflake] = msg;
+		PutMessage(msg);
 	}
 
 	if (addBefore && addedMessages)
@@ -142,7 +391,7 @@ void MessageChunkList::ProcessRequest(ScrollDir::eScrollDir sd, Snowflake gap, j
 		msg->m_type = MessageType::GAP_UP;
 		msg->m_anchor = lowestMsg;
 		msg->m_snowflake = lowestMsg - 1;
-		m_messages[msg->m_snowflake] = msg;
+		PutMessage(msg);
 	}
 
 	if (addAfter && addedMessages)
@@ -152,31 +401,30 @@ void MessageChunkList::ProcessRequest(ScrollDir::eScrollDir sd, Snowflake gap, j
 		msg->m_type = MessageType::GAP_DOWN;
 		msg->m_anchor = highestMsg;
 		msg->m_snowflake = highestMsg + 1;
-		m_messages[msg->m_snowflake] = std::move(msg);
+		PutMessage(msg);
 	}
 
 	GetDiscordInstance()->OnFetchedMessages(gap, sd);
 }
 
-void MessageChunkList::AddMessage(const Message& msg)
+void MessageChunkList::AddMessage(const MessagePtr& msg)
 {
-	if (msg.m_anchor)
-		DeleteMessage(msg.m_anchor);
+	if (msg->m_anchor)
+		DeleteMessage(msg->m_anchor);
 
-	m_messages[msg.m_snowflake] = std::make_shared<Message>(msg);
+	PutMessage(msg);
 }
 
-void MessageChunkList::EditMessage(const Message& msg)
+void MessageChunkList::EditMessage(const MessagePtr& msg)
 {
-	DeleteMessage(msg.m_snowflake);
-	m_messages[msg.m_snowflake] = std::make_shared<Message>(msg);
+	PutMessage(msg);
 }
 
 void MessageChunkList::DeleteMessage(Snowflake message)
 {
 	auto iter = m_messages.find(message);
 	if (m_messages.end() != iter)
-		m_messages.erase(iter);
+		EraseMessage(iter->first);
 }
 
 int MessageChunkList::GetMentionCountSince(Snowflake message, Snowflake user)
@@ -203,3 +451,185 @@ MessagePtr MessageChunkList::GetLoadedMessage(Snowflake message)
 
 	return iter->second;
 }
+
+// Rough amount of memory a message takes up, strings and containers included.
+static size_t StringSize(const std::string& str)
+{
+	// short strings live inside the object
+	return str.capacity() > 15 ? str.capacity() + 1 : 0;
+}
+
+static size_t EstimateSize(const Message& msg)
+{
+	// Author names and avatars are interned and shared between messages
+	size_t size = sizeof(Message) + 32; // shared_ptr control block and map node
+	size += StringSize(msg.m_message) + StringSize(msg.m_datePrefix);
+	size += (msg.m_userMentions.capacity() + msg.m_roleMentions.capacity()) * sizeof(Snowflake);
+
+	size += msg.m_attachments.capacity() * sizeof(Attachment);
+	for (auto& att : msg.m_attachments)
+		size += StringSize(att.m_fileName) + StringSize(att.m_proxyUrl) + StringSize(att.m_actualUrl);
+
+	size += msg.m_embeds.capacity() * sizeof(RichEmbed);
+	for (auto& emb : msg.m_embeds)
+	{
+		size += StringSize(emb.m_typeStr) + StringSize(emb.m_title) + StringSize(emb.m_url) + StringSize(emb.m_description);
+		size += StringSize(emb.m_providerName) + StringSize(emb.m_providerUrl);
+		size += StringSize(emb.m_authorName) + StringSize(emb.m_authorUrl) + StringSize(emb.m_authorIconUrl) + StringSize(emb.m_authorIconProxiedUrl);
+		size += StringSize(emb.m_footerText) + StringSize(emb.m_footerIconUrl) + StringSize(emb.m_footerIconProxiedUrl);
+		size += StringSize(emb.m_imageUrl) + StringSize(emb.m_imageProxiedUrl);
+		size += StringSize(emb.m_thumbnailUrl) + StringSize(emb.m_thumbnailProxiedUrl);
+
+		size += emb.m_fields.capacity() * sizeof(RichEmbedField);
+		for (auto& field : emb.m_fields)
+			size += StringSize(field.m_title) + StringSize(field.m_value);
+	}
+
+	if (msg.m_pReferencedMessage)
+	{
+		auto& ref = *msg.m_pReferencedMessage;
+		size += sizeof(ReferenceMessage) + StringSize(ref.m_message) + StringSize(ref.m_author) + StringSize(ref.m_avatar);
+		size += ref.m_userMentions.capacity() * sizeof(Snowflake);
+	}
+
+	if (msg.m_pMessagePoll)
+	{
+		auto& poll = *msg.m_pMessagePoll;
+		size += sizeof(MessagePoll) + StringSize(poll.m_question);
+		for (auto& opt : poll.m_options)
+			size += sizeof(opt) + 32 + StringSize(opt.second.m_text);
+	}
+
+	return size;
+}
+
+// Gaps, headers and messages still being sent aren't on the server (yet)
+static bool IsServerMessage(const Message& msg)
+{
+	return msg.m_type < MessageType::GAP_UP;
+}
+
+void MessageChunkList::PutMessage(const MessagePtr& msg)
+{
+	EraseMessage(msg->m_snowflake);
+	m_messages[msg->m_snowflake] = msg;
+	m_bytes += EstimateSize(*msg);
+}
+
+void MessageChunkList::EraseMessage(Snowflake message)
+{
+	auto iter = m_messages.find(message);
+	if (iter == m_messages.end())
+		return;
+
+	size_t size = EstimateSize(*iter->second);
+	m_bytes -= size < m_bytes ? size : m_bytes;
+	m_messages.erase(iter);
+}
+
+size_t MessageChunkList::GetMessageCount() const
+{
+	size_t count = 0;
+	for (auto& msg : m_messages) {
+		if (IsServerMessage(*msg.second))
+			count++;
+	}
+	return count;
+}
+
+bool MessageChunkList::Reconcile(Snowflake lastMessage)
+{
+	Snowflake newest = 0;
+	for (auto it = m_messages.rbegin(); it != m_messages.rend(); ++it)
+	{
+		// The tail is being fetched already
+		if (it->second->IsLoadGap())
+			return false;
+
+		if (IsServerMessage(*it->second)) {
+			newest = it->first;
+			break;
+		}
+	}
+
+	if (!newest || lastMessage <= newest)
+		return false;
+
+	auto msg = MakeMessage();
+	msg->m_author = GetFrontend()->GetPleaseWaitText();
+	msg->m_type = MessageType::GAP_DOWN;
+	msg->m_anchor = newest;
+	msg->m_snowflake = newest + 1;
+	PutMessage(msg);
+	return true;
+}
+
+size_t MessageChunkList::Trim(size_t keepCount)
+{
+	std::vector<Snowflake> ids;
+	for (auto& msg : m_messages) {
+		if (IsServerMessage(*msg.second))
+			ids.push_back(msg.first);
+	}
+
+	if (ids.size() <= keepCount || keepCount == 0)
+		return 0;
+
+	// Keep a window around the anchor, mostly below it since it was at the top
+	// of the screen.  Without an anchor, keep the newest messages.
+	size_t anchorIndex = ids.size();
+	if (m_viewAnchor)
+		anchorIndex = std::lower_bound(ids.begin(), ids.end(), m_viewAnchor) - ids.begin();
+
+	size_t start = anchorIndex > keepCount / 4 ? anchorIndex - keepCount / 4 : 0;
+	if (start + keepCount > ids.size())
+		start = ids.size() - keepCount;
+	size_t end = start + keepCount;
+
+	Snowflake keepLow = ids[start], keepHigh = ids[end - 1];
+	size_t dropped = ids.size() - keepCount;
+
+	std::vector<Snowflake> toErase;
+	for (auto& msg : m_messages)
+	{
+		if (msg.first >= keepLow && msg.first <= keepHigh)
+			continue;
+
+		// Leave the ends that weren't cut alone, along with their gaps and headers
+		if ((msg.first < keepLow && start == 0) || (msg.first > keepHigh && end == ids.size()))
+			continue;
+
+		if (msg.second->m_type == MessageType::UNSENT_MESSAGE || msg.second->m_type == MessageType::SENDING_MESSAGE)
+			continue;
+
+		toErase.push_back(msg.first);
+	}
+
+	for (Snowflake id : toErase) {
+		EraseMessage(id);
+		m_unconfirmed.erase(id);
+	}
+
+	// Leave gaps where messages were cut, so they are fetched again when scrolled to
+	if (start > 0)
+	{
+		auto msg = MakeMessage();
+		msg->m_author = GetFrontend()->GetPleaseWaitText();
+		msg->m_type = MessageType::GAP_UP;
+		msg->m_anchor = keepLow;
+		msg->m_snowflake = keepLow - 1;
+		PutMessage(msg);
+	}
+
+	if (end < ids.size())
+	{
+		auto msg = MakeMessage();
+		msg->m_author = GetFrontend()->GetPleaseWaitText();
+		msg->m_type = MessageType::GAP_DOWN;
+		msg->m_anchor = keepHigh;
+		msg->m_snowflake = keepHigh + 1;
+		PutMessage(msg);
+	}
+
+	return dropped;
+}
@@ -1,7 +1,9 @@
 #pragma once
 
 #include <map>
+#include <set>
 #include <list>
+#include <vector>
 #include <nlohmann/json.h>
 #include "../models/Snowflake.hpp"
 #include "../models/ScrollDir.hpp"
@@ -13,38 +15,133 @@ struct MessageChunkList
 	std::map<Snowflake, MessagePtr> m_messages;
 
 	bool m_lastMessagesLoaded = false;
+	bool m_bOpened = false;
 	Snowflake m_guild = 0;
 
+	// Messages that came from the message store and that the server hasn't
+	// confirmed yet.  If a fetched range doesn't contain them, they were deleted.
+	std::set<Snowflake> m_unconfirmed;
+
+	// Estimated memory used by the messages.
+	size_t m_bytes = 0;
+
+	// The first message that was on screen the last time the channel was shown.
+	// Trimming keeps the messages around it.
+	Snowflake m_viewAnchor = 0;
+
+	// Position in MessageCache::m_lru
+	std::list<Snowflake>::iterator m_lruIter;
+
 	MessageChunkList();
+	void LoadFromStore(Snowflake channel);
 	void ProcessRequest(ScrollDir::eScrollDir sd, Snowflake anchor, nlohmann::json& j, const std::string& channelName);
-	void AddMessage(const Message& msg);
-	void EditMessage(const Message& msg);
+	void AddMessage(const MessagePtr& msg);
+	void EditMessage(const MessagePtr& msg);
 	void DeleteMessage(Snowflake message);
 	int GetMentionCountSince(Snowflake message, Snowflake user);
 	MessagePtr GetLoadedMessage(Snowflake message);
+
+	// Checks the loaded messages against the channel's latest message after a
+	// reconnect.  If messages were posted since, adds a gap after the newest
+	// loaded one so that only the missing ones are fetched.  Returns true if a
+	// gap was added.
+	bool Reconcile(Snowflake lastMessage);
+
+	// Drops the messages that are far from the view anchor (or the newest
+	// messages, if the channel was never shown), leaving gaps to fetch them
+	// again.  Returns the number of messages dropped.
+	size_t Trim(size_t keepCount);
+
+	// Number of actual messages, not counting gaps and headers.
+	size_t GetMessageCount() const;
+
+private:
+	void PutMessage(const MessagePtr& msg);
+	void EraseMessage(Snowflake message);
 };
 
 class MessageCache
 {
 public:
+	static constexpr size_t DEFAULT_BUDGET = 64 * 1024 * 1024;
+
+	struct ChannelStats
+	{
+		Snowflake m_channel = 0;
+		size_t m_messages = 0;
+		size_t m_bytes = 0;
+	};
+
+	struct ReconcileStats
+	{
+		size_t m_unchanged = 0;    // channels that were up to date
+		size_t m_gapped = 0;       // channels that got a gap for the new messages
+		size_t m_dropped = 0;      // channels that don't exist anymore
+		size_t m_keptMessages = 0; // messages that don't have to be fetched again
+	};
+
+	struct Stats
+	{
+		size_t m_bytes = 0;
+		size_t m_budget = 0;
+		uint64_t m_trimmedMessages = 0;
+		uint64_t m_evictedChannels = 0;
+		std::vector<ChannelStats> m_channels; // most recently used first
+	};
+
 	MessageCache();
-	
+
 	void GetLoadedMessages(Snowflake channel, Snowflake guild, std::list<MessagePtr>& out);
 
 	// note: scroll dir used to add gap message
 	void ProcessRequest(Snowflake channel, ScrollDir::eScrollDir sd, Snowflake anchor, nlohmann::json& j, const std::string& channelName);
 
-	void AddMessage(Snowflake channel, const Message& msg);
-	void EditMessage(Snowflake channel, const Message& msg);
+	// The cache keeps the message itself, not a copy.  Loaded messages are
+	// shared with the UI, so never modify one: replace it with an edited copy.
+	void AddMessage(Snowflake channel, const MessagePtr& msg);
+	void EditMessage(Snowflake channel, const MessagePtr& msg);
 	void DeleteMessage(Snowflake channel, Snowflake message);
 	int GetMentionCountSince(Snowflake channel, Snowflake message, Snowflake user);
 	void ClearAllChannels();
+
+	// Brings the loaded channels up to date after the gateway session was started
+	// over, instead of throwing them away.  `lastMessages` maps every channel
+	// that still exists to its latest message ID.  Edits and deletions missed
+	// while disconnected aren't picked up until the messages are fetched again.
+	ReconcileStats Reconcile(const std::map<Snowflake, Snowflake>& lastMessages);
 	bool IsMessageLoaded(Snowflake channel, Snowflake message);
 
 	MessagePtr GetLoadedMessage(Snowflake channel, Snowflake message);
 
+	// Lets the cache know which message is at the top of the screen.
+	void SetViewAnchor(Snowflake channel, Snowflake message);
+
+	// Sets how much memory the loaded messages may take up.  When they go over,
+	// first the channels that weren't viewed recently are trimmed, then whole
+	// channels are dropped, least recently viewed first.  The current channel
+	// is left alone.
+	void SetBudget(size_t bytes);
+
+	Stats GetStats() const;
+
 private:
+	// Gets the channel's list, creating it if needed.
+	MessageChunkList& GetChannel(Snowflake channel);
+
+	// Marks the channel as the most recently used.
+	void Touch(MessageChunkList& lst);
+
+	// Updates the byte count after the list's size changed from `oldBytes`.
+	void Account(MessageChunkList& lst, size_t oldBytes);
+
+	void EnforceBudget();
+
 	std::map <Snowflake, MessageChunkList> m_mapMessages;
+	std::list<Snowflake> m_lru; // most recently used first
+	size_t m_bytes = 0;
+	size_t m_budget = DEFAULT_BUDGET;
+	uint64_t m_trimmedMessages = 0;
+	uint64_t m_evictedChannels = 0;
 };
 
 MessageCache* GetMessageCache();
@@ -0,0 +1,365 @@
+#include "MessageStore.hpp"
+#include "../utils/Util.hpp"
+#include "../utils/FileUtil.hpp"
+#include <algorithm>
+#include <iterator>
+#include <cstdio>
+#include <cstring>
+
+static MessageStore g_MessageStoreSingleton;
+
+MessageStore* GetMessageStore()
+{
+	return &g_MessageStoreSingleton;
+}
+
+static const char LOG_MAGIC[4] = { 'D', 'M', 'M', 'S' };
+static const uint32_t LOG_VERSION = 2;
+static const size_t LOG_HEADER_SIZE = sizeof LOG_MAGIC + sizeof LOG_VERSION;
+
+// type (1) + message ID (8) + data size (4)
+static const size_t RECORD_HEADER_SIZE = 13;
+
+static void WriteLE(std::string& buffer, uint64_t value, int bytes)
+{
+	for (int i = 0; i < bytes; i++)
+		buffer += char((value >> (i * 8)) & 0xFF);
+}
+
+static uint64_t ReadLE(const uint8_t* data, int bytes)
+{
+	uint64_t value = 0;
+	for (int i = 0; i < bytes; i++)
+		value |= uint64_t(data[i]) << (i * 8);
+	return value;
+}
+
+static std::string GetLogHeader()
+{
+	std::string header(LOG_MAGIC, sizeof LOG_MAGIC);
+	WriteLE(header, LOG_VERSION, 4);
+	return header;
+}
+
+void MessageStore::Init(const std::string& directory)
+{
+	m_directory = directory + PATH_SEP "messages";
+	MakeDirectory(m_directory);
+}
+
+void MessageStore::SetUser(Snowflake user)
+{
+	// What's waiting belongs to the previous user
+	Flush();
+
+	if (!user || m_directory.empty()) {
+		m_userDirectory.clear();
+		return;
+	}
+
+	m_userDirectory = m_directory + PATH_SEP + std::to_string(user);
+	MakeDirectory(m_userDirectory);
+}
+
+std::string MessageStore::GetChannelPath(Snowflake channel) const
+{
+	return m_userDirectory + PATH_SEP + std::to_string(channel) + ".log";
+}
+
+void MessageStore::AppendRecord(std::string& buffer, eRecordType type, Snowflake message, const std::string& data)
+{
+	WriteLE(buffer, type, 1);
+	WriteLE(buffer, message, 8);
+	WriteLE(buffer, data.size(), 4);
+	buffer += data;
+}
+
+void MessageStore::AppendRange(std::string& buffer, Snowflake first, Snowflake last)
+{
+	std::string data;
+	WriteLE(data, last, 8);
+	AppendRecord(buffer, RECORD_RANGE, first, data);
+}
+
+void MessageStore::AddRange(RangeMap& ranges, Snowflake first, Snowflake last)
+{
+	// Swallow the ranges that overlap or touch this one
+	auto iter = ranges.upper_bound(last);
+	while (iter != ranges.begin())
+	{
+		--iter;
+		if (iter->second < first)
+			break;
+
+		first = std::min(first, iter->first);
+		last = std::max(last, iter->second);
+		iter = ranges.erase(iter);
+	}
+
+	ranges[first] = last;
+}
+
+bool MessageStore::Append(Snowflake channel, const std::string& newRecords, bool create)
+{
+	if (m_userDirectory.empty())
+		return false;
+
+	// Keep the records in order
+	std::string records;
+	auto pendIter = m_pending.find(channel);
+	if (pendIter != m_pending.end()) {
+		records = std::move(pendIter->second);
+		m_pending.erase(pendIter);
+	}
+	records += newRecords;
+
+	if (records.empty())
+		return true;
+
+	std::string path = GetChannelPath(channel);
+
+	FILE* f = fopen(path.c_str(), "r+b");
+	if (!f)
+	{
+		if (!create)
+			return false;
+
+		f = fopen(path.c_str(), "wb");
+		if (!f)
+			return false;
+
+		std::string header = GetLogHeader();
+		fwrite(header.data(), 1, header.size(), f);
+	}
+
+	fseek(f, 0, SEEK_END);
+	bool ok = fwrite(records.data(), 1, records.size(), f) == records.size();
+	ok = fclose(f) == 0 && ok;
+
+	if (!ok)
+		DbgPrintF("Could not write to the message store of channel %llu", channel);
+
+	return ok;
+}
+
+void MessageStore::Queue(Snowflake channel, const std::string& records)
+{
+	m_pending[channel] += records;
+
+	if (GetTimeMs() - m_lastFlush >= FLUSH_INTERVAL_MS)
+		Flush();
+}
+
+void MessageStore::Flush()
+{
+	m_lastFlush = GetTimeMs();
+
+	if (m_userDirectory.empty()) {
+		m_pending.clear();
+		return;
+	}
+
+	while (!m_pending.empty())
+		Append(m_pending.begin()->first, "", false);
+}
+
+void MessageStore::PutMany(Snowflake channel, const nlohmann::json& messages, ScrollDir::eScrollDir sd, Snowflake source)
+{
+	if (m_userDirectory.empty() || !messages.is_array() || messages.empty())
+		return;
+
+	Snowflake first = (Snowflake) -1LL, last = 0;
+	std::string records;
+	for (auto& data : messages)
+	{
+		Snowflake message = GetSnowflake(data, "id");
+		if (!message)
+			continue;
+
+		AppendRecord(records, RECORD_PUT, message, data.dump());
+		first = std::min(first, message);
+		last = std::max(last, message);
+	}
+
+	if (!last)
+		return;
+
+	// The batch has no holes.  There is also nothing between it and the message
+	// it was fetched relative to, so extend it up to that one.
+	if (source && sd == ScrollDir::BEFORE && source > last)
+		last = source;
+	else if (source && sd == ScrollDir::AFTER && source < first)
+		first = source;
+
+	AppendRange(records, first, last);
+	Append(channel, records, true);
+}
+
+void MessageStore::Put(Snowflake channel, Snowflake message, const nlohmann::json& data, Snowflake previous)
+{
+	if (m_userDirectory.empty() || !message)
+		return;
+
+	std::string records;
+	AppendRecord(records, RECORD_PUT, message, data.dump());
+	if (previous && previous < message)
+		AppendRange(records, previous, message);
+
+	Queue(channel, records);
+}
+
+void MessageStore::Delete(Snowflake channel, Snowflake message)
+{
+	if (m_userDirectory.empty())
+		return;
+
+	std::string records;
+	AppendRecord(records, RECORD_DELETE, message, "");
+	Queue(channel, records);
+}
+
+bool MessageStore::Load(Snowflake channel, size_t maxCount, std::vector<nlohmann::json>& out)
+{
+	if (m_userDirectory.empty())
+		return false;
+
+	// Get the records still waiting to be written in there too
+	if (m_pending.count(channel))
+		Append(channel, "", false);
+
+	std::string path = GetChannelPath(channel);
+
+	MappedFile file;
+	if (!file.Open(path))
+		return false;
+
+	const uint8_t* data = file.Data();
+	const size_t size = file.Size();
+
+	if (size < LOG_HEADER_SIZE || memcmp(data, LOG_MAGIC, sizeof LOG_MAGIC) != 0 || ReadLE(data + sizeof LOG_MAGIC, 4) != LOG_VERSION)
+	{
+		DbgPrintF("Message store of channel %llu is unreadable, discarding it", channel);
+		file.Close();
+		remove(path.c_str());
+		return false;
+	}
+
+	// Replay the log
+	std::map<Snowflake, std::string> messages;
+	RangeMap ranges;
+	size_t recordCount = 0;
+	size_t offset = LOG_HEADER_SIZE;
+	bool damaged = false;
+
+	while (offset < size)
+	{
+		if (size - offset < RECORD_HEADER_SIZE) {
+			damaged = true;
+			break;
+		}
+
+		uint8_t type = data[offset];
+		Snowflake message = ReadLE(data + offset + 1, 8);
+		size_t dataSize = size_t(ReadLE(data + offset + 9, 4));
+		offset += RECORD_HEADER_SIZE;
+
+		// Cut short by a crash while appending
+		if (size - offset < dataSize) {
+			damaged = true;
+			break;
+		}
+
+		if (type == RECORD_PUT)
+			messages[message] = std::string((const char*) data + offset, dataSize);
+		else if (type == RECORD_DELETE)
+			messages.erase(message);
+		else if (type == RECORD_RANGE && dataSize == 8)
+			AddRange(ranges, message, ReadLE(data + offset, 8));
+
+		offset += dataSize;
+		recordCount++;
+	}
+
+	// Windows won't replace a file that's still mapped
+	file.Close();
+
+	if (damaged || messages.size() > MAX_MESSAGES_PER_CHANNEL || recordCount > messages.size() * 2 + ranges.size() + 32)
+		Compact(channel, messages, ranges);
+
+	out.clear();
+	if (messages.empty())
+		return false;
+
+	// Take the newest ones, but stop at the first hole.  If the newest message
+	// isn't part of any range, it is a run of its own.
+	auto end = messages.end();
+	Snowflake newest = std::prev(end)->first;
+	Snowflake runStart = newest;
+
+	auto rangeIter = ranges.upper_bound(newest);
+	if (rangeIter != ranges.begin() && std::prev(rangeIter)->second >= newest)
+		runStart = std::prev(rangeIter)->first;
+
+	auto iter = end;
+	size_t count = 0;
+	while (iter != messages.begin() && count < maxCount && std::prev(iter)->first >= runStart) {
+		--iter;
+		count++;
+	}
+
+	out.reserve(count);
+	for (; iter != end; ++iter)
+	{
+		try
+		{
+			out.push_back(nlohmann::json::parse(iter->second));
+		}
+		catch (nlohmann::json::exception& ex)
+		{
+			DbgPrintF("Stored message %llu is unreadable: %s", iter->first, ex.what());
+		}
+	}
+
+	return !out.empty();
+}
+
+void MessageStore::Compact(Snowflake channel, const std::map<Snowflake, std::string>& messages, const RangeMap& ranges)
+{
+	auto iter = messages.end();
+	size_t count = 0;
+	while (iter != messages.begin() && count < MAX_MESSAGES_PER_CHANNEL) {
+		--iter;
+		count++;
+	}
+
+	std::string contents = GetLogHeader();
+
+	// Cut the ranges down to the messages that are kept
+	if (iter != messages.end())
+	{
+		Snowflake oldestKept = iter->first;
+		for (auto& range : ranges)
+		{
+			if (range.second >= oldestKept)
+				AppendRange(contents, std::max(range.first, oldestKept), range.second);
+		}
+	}
+
+	for (; iter != messages.end(); ++iter)
+		AppendRecord(contents, RECORD_PUT, iter->first, iter->second);
+
+	std::string path = GetChannelPath(channel);
+	std::string tempPath = path + ".tmp";
+
+	FILE* f = fopen(tempPath.c_str(), "wb");
+	if (!f)
+		return;
+
+	bool ok = fwrite(contents.data(), 1, contents.size(), f) == contents.size();
+	ok = fclose(f) == 0 && ok;
+
+	if (!ok || !MoveFileOver(tempPath, path)) {
+		DbgPrintF("Could not compact the message store of channel %llu", channel);
+		remove(tempPath.c_str());
+	}
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstdint>
+#include <nlohmann/json.h>
+#include "../models/Snowflake.hpp"
+#include "../models/ScrollDir.hpp"
+
+// Keeps the most recent messages of the channels the user has opened on disk,
+// so that a channel can be shown right away after a restart while the real
+// history is fetched from the server.
+//
+// Every channel has its own log file (messages/<user id>/<channel id>.log).
+// Changes are appended as records holding the message's JSON exactly as
+// Discord sent it, a deletion marker, or a range of message IDs known to have
+// nothing else in between.  The log is replayed when the channel is opened,
+// and rewritten with only the newest MAX_MESSAGES_PER_CHANNEL messages once it
+// has gathered too many stale records.
+//
+// Stored messages can have holes in between, e.g. when messages were posted
+// while the client wasn't running.  The ranges tell where those are, and only
+// the newest run of messages without holes is handed out.
+//
+// A channel's log is created when its history is first fetched.  Gateway
+// traffic is only recorded for channels that have a log, so the messages of
+// channels the user never looks at don't end up on disk.  It is written in
+// batches, every FLUSH_INTERVAL_MS at most, so the thread receiving it doesn't
+// wait for the disk on every message.
+//
+// Not thread safe, meant to be used from the thread owning the MessageCache.
+class MessageStore
+{
+public:
+	static constexpr size_t MAX_MESSAGES_PER_CHANNEL = 250;
+	static constexpr uint64_t FLUSH_INTERVAL_MS = 10000;
+
+	// Sets where the store lives.  Nothing is read or written until a user is set.
+	void Init(const std::string& directory);
+
+	// Switches to the store of another user.  0 disables the store.
+	void SetUser(Snowflake user);
+
+	// Records a batch of messages, as returned by the messages endpoint when
+	// asked for the ones in direction `sd` of `source` (0 for the latest ones).
+	void PutMany(Snowflake channel, const nlohmann::json& messages, ScrollDir::eScrollDir sd, Snowflake source);
+
+	// Records a created or updated message, if the channel is stored.  For a
+	// new message, `previous` is the channel's last message before it, if known.
+	void Put(Snowflake channel, Snowflake message, const nlohmann::json& data, Snowflake previous = 0);
+
+	// Records the deletion of a message, if the channel is stored.
+	void Delete(Snowflake channel, Snowflake message);
+
+	// Reads up to `maxCount` of the newest stored messages of a channel, oldest
+	// first.  They're all from the same run, there are no messages missing in
+	// between.
+	bool Load(Snowflake channel, size_t maxCount, std::vector<nlohmann::json>& out);
+
+	// Writes the records that are waiting to be written.
+	void Flush();
+
+private:
+	enum eRecordType : uint8_t
+	{
+		RECORD_PUT = 1,
+		RECORD_DELETE = 2,
+		RECORD_RANGE = 3, // message ID is the start of the range, data holds the end
+	};
+
+	// Ranges of message IDs without holes, start -> end, both included
+	typedef std::map<Snowflake, Snowflake> RangeMap;
+
+	std::string GetChannelPath(Snowflake channel) const;
+
+	static void AppendRecord(std::string& buffer, eRecordType type, Snowflake message, const std::string& data);
+	static void AppendRange(std::string& buffer, Snowflake first, Snowflake last);
+
+	// Adds a range, merging it with the ones it overlaps or touches.
+	static void AddRange(RangeMap& ranges, Snowflake first, Snowflake last);
+
+	// Appends records to the channel's log, after the ones still waiting to be
+	// written.  If `create` is false, only does so if the log exists already.
+	bool Append(Snowflake channel, const std::string& records, bool create);
+
+	// Queues records for the next Flush.
+	void Queue(Snowflake channel, const std::string& records);
+
+	// Replaces the channel's log with the newest of `messages`.
+	void Compact(Snowflake channel, const std::map<Snowflake, std::string>& messages, const RangeMap& ranges);
+
+	std::string m_directory;
+	std::string m_userDirectory; // empty if disabled
+
+	std::map<Snowflake, std::string> m_pending; // records waiting to be written, by channel
+	uint64_t m_lastFlush = 0;
+};
+
+MessageStore* GetMessageStore();
@@ -303,41 +303,10 @@ void LoopbackCapture::SendOpusPacket(const uint8_t* data, int size, uint32_t tim
 	m_sequence++;
 	m_nonce++;
 
-	// Build RTP header (12 bytes) + encrypted payload + auth tag + 4-byte nonce
-	const size_t encryptedSize = size + crypto_aead_xchacha20poly1305_ietf_ABYTES;
-	std::vector<uint8_t> rtp(12 + encryptedSize + sizeof(uint32_t), 0);
-
-	// RTP header
-	rtp[0] = 0x80; // Version 2
-	rtp[1] = 0x78; // Payload type 120 (Opus)
-	rtp[2] = (m_sequence >> 8) & 0xFF;
-	rtp[3] = (m_sequence >> 0) & 0xFF;
-	rtp[4] = (timestamp >> 24) & 0xFF;
-	rtp[5] = (timestamp >> 16) & 0xFF;
-	rtp[6] = (timestamp >> 8) & 0xFF;
-	rtp[7] = (timestamp >> 0) & 0xFF;
-	rtp[8] = (m_audioSSRC >> 24) & 0xFF;
-	rtp[9] = (m_audioSSRC >> 16) & 0xFF;
-	rtp[10] = (m_audioSSRC >> 8) & 0xFF;
-	rtp[11] = (m_audioSSRC >> 0) & 0xFF;
-
-	// Nonce
-	std::array<uint8_t, crypto_aead_xchacha20poly1305_ietf_NPUBBYTES> nonceBytes{};
-	std::memcpy(nonceBytes.data(), &m_nonce, sizeof(uint32_t));
-
-	// Encrypt
-	unsigned long long ciphertextLen;
-	crypto_aead_xchacha20poly1305_ietf_encrypt(
-		rtp.data() + 12, &ciphertextLen,
-		data, size,
-		rtp.data(), 12,
-		nullptr,
-		nonceBytes.data(),
-		m_secretKey.data());
-
-	// Append nonce
-	rtp.resize(12 + static_cast<size_t>(ciphertextLen) + sizeof(uint32_t));
-	std::memcpy(rtp.data() + rtp.size() - sizeof(uint32_t), &m_nonce, sizeof(uint32_t));
-
-	m_udp->Send(rtp.data(), rtp.size());
+	// RTP header (12 bytes) + encrypted payload + auth tag + 4-byte nonce, payload type 120 (Opus)
+	auto packet = m_udp->GetPacketPool().Acquire();
+	if (!dv::SealRTPPacket(*packet, 0x78, m_sequence, timestamp, m_audioSSRC, m_nonce, m_secretKey, data, size))
+		return;
+
+	m_udp->Send(packet->data.data(), packet->size);
 }
@@ -58,8 +58,8 @@ void StreamViewer::Init(DiscordInstance* pDiscord)
 			uint32_t videoSSRC = audioSSRC + 1;
 			const auto& secretKey = m_impl->viewerVoiceClient.GetSecretKey();
 
-			// Initialize RTP receiver
-			m_impl->rtpReceiver.Init(videoSSRC, secretKey);
+			// Initialize RTP receiver.  RTX for the stream comes on the SSRC right after the video one.
+			m_impl->rtpReceiver.Init(videoSSRC, videoSSRC + 1, audioSSRC, secretKey);
 
 			// Initialize H.264 decoder
 			if (!m_impl->decoder.Init(1280, 720))
@@ -84,8 +84,13 @@ void StreamViewer::Init(DiscordInstance* pDiscord)
 
 			// Register UDP data callback to feed packets to RTP receiver
 			dv::UDPSocket& udp = m_impl->viewerVoiceClient.GetUDPSocket();
-			udp.SetDataCallback([this](const std::vector<uint8_t>& data) {
-				m_impl->rtpReceiver.Feed(data);
+			udp.SetDataCallback([this](const uint8_t* data, size_t len) {
+				m_impl->rtpReceiver.Feed(data, len);
+			});
+
+			// Send NACK/PLI feedback back through the same socket
+			m_impl->rtpReceiver.SetFeedbackCallback([&udp](const uint8_t* rtcp, size_t len) {
+				udp.SendEncryptedRTCP(rtcp, len);
 			});
 
 			// Send video opcode to indicate we want to receive video
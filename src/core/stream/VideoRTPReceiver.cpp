@@ -5,55 +5,350 @@
 #include <sodium.h>
 #include <cstring>
 
-void VideoRTPReceiver::Init(uint32_t videoSSRC, const std::array<uint8_t, 32>& secretKey)
+constexpr uint32_t VideoRTPReceiver::WINDOW;
+constexpr std::chrono::milliseconds VideoRTPReceiver::MAX_GAP_WAIT;
+constexpr std::chrono::milliseconds VideoRTPReceiver::NACK_RETRY;
+constexpr int VideoRTPReceiver::MAX_NACKS;
+constexpr std::chrono::milliseconds VideoRTPReceiver::PLI_INTERVAL;
+
+void VideoRTPReceiver::Init(uint32_t videoSSRC, uint32_t rtxSSRC, uint32_t localSSRC,
+                            const std::array<uint8_t, 32>& secretKey)
 {
+	std::lock_guard<std::mutex> lock(m_mutex);
+
 	m_videoSSRC = videoSSRC;
+	m_rtxSSRC = rtxSSRC;
+	m_localSSRC = localSSRC;
 	m_secretKey = secretKey;
-	m_currentTimestamp = 0;
-	m_hasTimestamp = false;
+	m_started = false;
+	m_pliSent = false;
+	ResetWindow();
 	m_frameBuffer.clear();
 	m_fuaBuffer.clear();
 	m_fuaInProgress = false;
 }
 
-void VideoRTPReceiver::Feed(const std::vector<uint8_t>& data)
+void VideoRTPReceiver::Feed(const uint8_t* data, size_t len)
 {
-	if (data.size() < 12)
+	if (len < 12)
 		return;
 
 	uint8_t payloadType;
 	uint16_t seq;
 	uint32_t timestamp, ssrc;
-	std::vector<uint8_t> payload;
 
-	if (!DecryptPacket(data.data(), data.size(), payloadType, seq, timestamp, ssrc, payload))
+	std::lock_guard<std::mutex> lock(m_mutex);
+
+	std::vector<uint8_t>& payload = m_payload;
+	if (!DecryptPacket(data, len, payloadType, seq, timestamp, ssrc, payload))
 		return;
 
-	// Filter by video SSRC
-	if (ssrc != m_videoSSRC)
+	const uint8_t* body = payload.data();
+	size_t bodyLen = payload.size();
+
+	if (payloadType == m_rtxPayloadType && (ssrc == m_rtxSSRC || ssrc == m_videoSSRC))
+	{
+		// RTX (RFC 4588): the original sequence number comes first, then the original payload
+		if (bodyLen <= 2)
+			return; // padding-only probe
+
+		seq = (body[0] << 8) | body[1];
+		body += 2;
+		bodyLen -= 2;
+	}
+	else if (ssrc != m_videoSSRC)
+	{
+		// Filter by video SSRC
 		return;
+	}
 
-	std::lock_guard<std::mutex> lock(m_mutex);
+	const auto now = Clock::now();
+	bool marker = (data[1] & 0x80) != 0;
+
+	InsertPacket(seq, timestamp, marker, body, bodyLen, now);
+	AssembleFrames(now);
+	SendNack(now);
+}
+
+VideoRTPReceiver::Slot* VideoRTPReceiver::FindHeld(uint32_t seq)
+{
+	Slot& slot = SlotFor(seq);
+	return (slot.used && slot.seq == seq) ? &slot : nullptr;
+}
+
+void VideoRTPReceiver::ResetWindow()
+{
+	for (auto& slot : m_slots)
+		slot.used = false;
 
-	// Check for new frame (timestamp changed)
-	if (m_hasTimestamp && timestamp != m_currentTimestamp)
+	m_nacks.clear();
+	m_gapOpen = false;
+}
+
+void VideoRTPReceiver::Resync(uint32_t seq, Clock::time_point now)
+{
+	ResetWindow();
+	m_nextSeq = seq;
+	m_highestSeq = seq;
+	SendPli(now);
+}
+
+void VideoRTPReceiver::InsertPacket(uint16_t seq, uint32_t timestamp, bool marker,
+                                    const uint8_t* payload, size_t len, Clock::time_point now)
+{
+	if (!m_started)
+	{
+		m_started = true;
+		// Leave room below so that the sequence can't underflow when unwrapped
+		m_nextSeq = 0x10000u | seq;
+		m_highestSeq = m_nextSeq;
+	}
+
+	// Unwrap relative to the next frame's first packet
+	const int16_t delta = static_cast<int16_t>(seq - static_cast<uint16_t>(m_nextSeq));
+	uint32_t ext = m_nextSeq + delta;
+
+	if (delta <= -static_cast<int>(WINDOW))
+	{
+		// Way behind us: the sender restarted its sequence numbers, and everything
+		// after this would be dropped as already played.  Start over from here,
+		// unwrapped like the first packet so that repeated restarts can't underflow.
+		ext = 0x10000u | seq;
+		Resync(ext, now);
+	}
+	else if (delta < 0)
+	{
+		return; // already played or given up on
+	}
+	else if (static_cast<uint32_t>(delta) >= WINDOW)
 	{
-		FlushFrame(m_currentTimestamp);
+		// Lost track completely, start over and ask for a keyframe
+		Resync(ext, now);
 	}
 
-	m_currentTimestamp = timestamp;
-	m_hasTimestamp = true;
+	Slot& slot = SlotFor(ext);
+	if (slot.used && slot.seq == ext)
+		return; // duplicate, e.g. a retransmission we no longer needed
 
-	ProcessPayload(payload.data(), payload.size(), seq, timestamp);
+	slot.used = true;
+	slot.marker = marker;
+	slot.seq = ext;
+	slot.timestamp = timestamp;
+	slot.payload.assign(payload, payload + len);
 
-	// Check marker bit (indicates end of access unit)
-	bool marker = (data[1] & 0x80) != 0;
-	if (marker)
+	m_nacks.erase(ext);
+
+	if (ext > m_highestSeq)
 	{
-		FlushFrame(timestamp);
+		// Everything we jumped over is missing (for now)
+		for (uint32_t s = m_highestSeq + 1; s < ext; s++)
+		{
+			if (!FindHeld(s))
+				m_nacks.emplace(s, NackState{});
+		}
+		m_highestSeq = ext;
 	}
 }
 
+void VideoRTPReceiver::AssembleFrames(Clock::time_point now)
+{
+	while (m_started)
+	{
+		// Walk forward from the start of the next frame until its marker or a hole
+		uint32_t s = m_nextSeq;
+		bool emitted = false;
+		while (s <= m_highestSeq)
+		{
+			Slot* slot = FindHeld(s);
+			if (!slot)
+				break;
+
+			if (slot->marker)
+			{
+				EmitFrame(m_nextSeq, s);
+				m_nextSeq = s + 1;
+				m_gapOpen = false;
+				emitted = true;
+				break;
+			}
+			s++;
+		}
+
+		if (emitted)
+			continue;
+
+		if (s > m_highestSeq)
+		{
+			// No hole, the rest of the frame just hasn't arrived yet
+			m_gapOpen = false;
+			return;
+		}
+
+		// There's a hole at `s` with newer packets behind it.  Give the NACKs a chance.
+		if (!m_gapOpen)
+		{
+			m_gapOpen = true;
+			m_gapSince = now;
+		}
+
+		const bool windowFull = m_highestSeq - m_nextSeq >= WINDOW * 3 / 4;
+		if (!windowFull && now - m_gapSince < MAX_GAP_WAIT)
+			return;
+
+		// Give up on this frame.  Resume at the first packet we know starts a frame:
+		// one right after a marker, or one whose timestamp differs from its predecessor.
+		uint32_t resume = 0;
+		for (uint32_t t = s + 1; t <= m_highestSeq + 1; t++)
+		{
+			Slot* prev = FindHeld(t - 1);
+			if (!prev)
+				continue;
+
+			Slot* cur = (t <= m_highestSeq) ? FindHeld(t) : nullptr;
+			if (prev->marker || (cur && cur->timestamp != prev->timestamp))
+			{
+				resume = t;
+				break;
+			}
+		}
+
+		if (resume == 0)
+		{
+			if (!windowFull)
+				return;
+
+			// Nothing usable in the whole window
+			resume = m_highestSeq + 1;
+		}
+
+		DropUntil(resume);
+		m_gapOpen = false;
+		SendPli(now);
+	}
+}
+
+void VideoRTPReceiver::EmitFrame(uint32_t first, uint32_t last)
+{
+	m_frameBuffer.clear();
+	m_fuaBuffer.clear();
+	m_fuaInProgress = false;
+
+	const uint32_t timestamp = SlotFor(last).timestamp;
+	for (uint32_t s = first; s <= last; s++)
+	{
+		Slot& slot = SlotFor(s);
+		ProcessPayload(slot.payload.data(), slot.payload.size());
+		slot.used = false;
+	}
+
+	FlushFrame(timestamp);
+}
+
+void VideoRTPReceiver::DropUntil(uint32_t seq)
+{
+	for (uint32_t s = m_nextSeq; s < seq; s++)
+	{
+		if (Slot* slot = FindHeld(s))
+			slot->used = false;
+	}
+
+	m_nacks.erase(m_nacks.begin(), m_nacks.lower_bound(seq));
+	m_nextSeq = seq;
+}
+
+void VideoRTPReceiver::SendNack(Clock::time_point now)
+{
+	// Forget about holes in frames that were already played or dropped
+	m_nacks.erase(m_nacks.begin(), m_nacks.lower_bound(m_nextSeq));
+
+	if (!m_feedbackCallback || m_nacks.empty())
+		return;
+
+	// Generic NACK (RFC 4585 section 6.2.1): PT=205, FMT=1, then PID/BLP pairs
+	m_rtcp.assign(12, 0);
+	m_rtcp[0] = 0x81;
+	m_rtcp[1] = 205;
+
+	size_t fciCount = 0;
+	uint32_t pid = 0;
+	uint16_t blp = 0;
+
+	auto flushFci = [&]() {
+		m_rtcp.push_back((pid >> 8) & 0xFF);
+		m_rtcp.push_back(pid & 0xFF);
+		m_rtcp.push_back((blp >> 8) & 0xFF);
+		m_rtcp.push_back(blp & 0xFF);
+		fciCount++;
+	};
+
+	bool haveFci = false;
+	for (auto& [seq, state] : m_nacks)
+	{
+		if (state.attempts >= MAX_NACKS)
+			continue;
+		if (state.attempts > 0 && now - state.lastSent < NACK_RETRY)
+			continue;
+
+		state.lastSent = now;
+		state.attempts++;
+
+		if (haveFci && seq - pid <= 16)
+		{
+			blp |= 1 << (seq - pid - 1);
+			continue;
+		}
+
+		if (haveFci)
+			flushFci();
+
+		pid = seq;
+		blp = 0;
+		haveFci = true;
+	}
+
+	if (!haveFci)
+		return;
+
+	flushFci();
+
+	// Length in 32-bit words minus one: 2 SSRCs + FCI entries
+	const uint16_t length = static_cast<uint16_t>(2 + fciCount);
+	m_rtcp[2] = (length >> 8) & 0xFF;
+	m_rtcp[3] = length & 0xFF;
+	for (int i = 0; i < 4; i++)
+	{
+		m_rtcp[4 + i] = (m_localSSRC >> (24 - i * 8)) & 0xFF;
+		m_rtcp[8 + i] = (m_videoSSRC >> (24 - i * 8)) & 0xFF;
+	}
+
+	m_feedbackCallback(m_rtcp.data(), m_rtcp.size());
+}
+
+void VideoRTPReceiver::SendPli(Clock::time_point now)
+{
+	if (!m_feedbackCallback)
+		return;
+
+	if (m_pliSent && now - m_lastPli < PLI_INTERVAL)
+		return;
+
+	m_pliSent = true;
+	m_lastPli = now;
+
+	// Picture Loss Indication (RFC 4585 section 6.3.1): PT=206, FMT=1, no FCI
+	m_rtcp.assign(12, 0);
+	m_rtcp[0] = 0x81;
+	m_rtcp[1] = 206;
+	m_rtcp[3] = 2;
+	for (int i = 0; i < 4; i++)
+	{
+		m_rtcp[4 + i] = (m_localSSRC >> (24 - i * 8)) & 0xFF;
+		m_rtcp[8 + i] = (m_videoSSRC >> (24 - i * 8)) & 0xFF;
+	}
+
+	m_feedbackCallback(m_rtcp.data(), m_rtcp.size());
+}
+
 bool VideoRTPReceiver::DecryptPacket(const uint8_t* data, size_t len,
                                       uint8_t& payloadType, uint16_t& seq,
                                       uint32_t& timestamp, uint32_t& ssrc,
@@ -99,7 +394,7 @@ bool VideoRTPReceiver::DecryptPacket(const uint8_t* data, size_t len,
 	return true;
 }
 
-void VideoRTPReceiver::ProcessPayload(const uint8_t* payload, size_t len, uint16_t seq, uint32_t timestamp)
+void VideoRTPReceiver::ProcessPayload(const uint8_t* payload, size_t len)
 {
 	if (len == 0)
 		return;
@@ -188,5 +483,4 @@ void VideoRTPReceiver::FlushFrame(uint32_t timestamp)
 		m_frameCallback(m_frameBuffer.data(), m_frameBuffer.size(), timestamp);
 
 	m_frameBuffer.clear();
-	m_hasTimestamp = false;
 }
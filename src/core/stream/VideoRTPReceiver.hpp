@@ -1,6 +1,7 @@
 #pragma once
 
 #include <array>
+#include <chrono>
 #include <cstdint>
 #include <functional>
 #include <map>
@@ -10,34 +11,97 @@
 class VideoRTPReceiver
 {
 public:
-	void Init(uint32_t videoSSRC, const std::array<uint8_t, 32>& secretKey);
+	void Init(uint32_t videoSSRC, uint32_t rtxSSRC, uint32_t localSSRC,
+	          const std::array<uint8_t, 32>& secretKey);
 
 	// Feed a raw UDP packet (encrypted RTP)
-	void Feed(const std::vector<uint8_t>& data);
+	void Feed(const uint8_t* data, size_t len);
 
 	// Callback: called when a complete H.264 access unit is reassembled
 	using FrameCallback = std::function<void(const uint8_t* h264Data, size_t len, uint32_t timestamp)>;
 	void SetFrameCallback(FrameCallback cb) { m_frameCallback = std::move(cb); }
 
+	// Callback: called with plain RTCP feedback (NACK, PLI) that should be sent to the server
+	using FeedbackCallback = std::function<void(const uint8_t* rtcp, size_t len)>;
+	void SetFeedbackCallback(FeedbackCallback cb) { m_feedbackCallback = std::move(cb); }
+
+	void SetPayloadTypes(uint8_t payloadType, uint8_t rtxPayloadType)
+	{
+		m_payloadType = payloadType;
+		m_rtxPayloadType = rtxPayloadType;
+	}
+
 private:
+	using Clock = std::chrono::steady_clock;
+
 	bool DecryptPacket(const uint8_t* data, size_t len,
 	                   uint8_t& payloadType, uint16_t& seq, uint32_t& timestamp, uint32_t& ssrc,
 	                   std::vector<uint8_t>& payload);
 
-	void ProcessPayload(const uint8_t* payload, size_t len, uint16_t seq, uint32_t timestamp);
+	// Reorder window
+	void InsertPacket(uint16_t seq, uint32_t timestamp, bool marker,
+	                  const uint8_t* payload, size_t len, Clock::time_point now);
+	void AssembleFrames(Clock::time_point now);
+	void EmitFrame(uint32_t first, uint32_t last);
+	void DropUntil(uint32_t seq);
+	void ResetWindow();
+	// Drops everything held, carries on from `seq` and asks for a keyframe.
+	void Resync(uint32_t seq, Clock::time_point now);
+
+	// Feedback
+	void SendNack(Clock::time_point now);
+	void SendPli(Clock::time_point now);
+
+	void ProcessPayload(const uint8_t* payload, size_t len);
 	void FlushFrame(uint32_t timestamp);
 
 	uint32_t m_videoSSRC = 0;
+	uint32_t m_rtxSSRC = 0;
+	uint32_t m_localSSRC = 0;
+	uint8_t m_payloadType = 101;   // H.264
+	uint8_t m_rtxPayloadType = 102;
 	std::array<uint8_t, 32> m_secretKey{};
 
-	// Reassembly state
-	struct Fragment {
-		uint16_t seq;
-		std::vector<uint8_t> data;
+	// Packets are held in slots indexed by their unwrapped sequence number.  Frames
+	// are handed to the decoder only once every packet up to the marker is present.
+	struct Slot {
+		bool used = false;
+		bool marker = false;
+		uint32_t seq = 0;
+		uint32_t timestamp = 0;
+		std::vector<uint8_t> payload;
+	};
+
+	static constexpr uint32_t WINDOW = 512;
+
+	// How long a hole may stay open before its frame is given up on
+	static constexpr auto MAX_GAP_WAIT = std::chrono::milliseconds(200);
+	// How long to wait for a retransmission before asking for the same packet again
+	static constexpr auto NACK_RETRY = std::chrono::milliseconds(50);
+	static constexpr int MAX_NACKS = 3;
+	// Keyframe requests are rate limited
+	static constexpr auto PLI_INTERVAL = std::chrono::milliseconds(500);
+
+	Slot& SlotFor(uint32_t seq) { return m_slots[seq % WINDOW]; }
+	Slot* FindHeld(uint32_t seq);
+
+	std::array<Slot, WINDOW> m_slots;
+	bool m_started = false;
+	uint32_t m_nextSeq = 0;    // first packet of the next frame to assemble
+	uint32_t m_highestSeq = 0; // highest sequence seen so far
+
+	bool m_gapOpen = false;
+	Clock::time_point m_gapSince;
+
+	// Missing sequence numbers we have asked for: seq -> (last request, attempts)
+	struct NackState {
+		Clock::time_point lastSent;
+		int attempts = 0;
 	};
+	std::map<uint32_t, NackState> m_nacks;
 
-	uint32_t m_currentTimestamp = 0;
-	bool m_hasTimestamp = false;
+	Clock::time_point m_lastPli;
+	bool m_pliSent = false;
 
 	// Accumulated NAL data for current frame
 	std::vector<uint8_t> m_frameBuffer;
@@ -46,6 +110,13 @@ private:
 	std::vector<uint8_t> m_fuaBuffer;
 	bool m_fuaInProgress = false;
 
+	// Decrypted payload of the packet being processed, reused between packets
+	std::vector<uint8_t> m_payload;
+
+	// Scratch space for outgoing RTCP
+	std::vector<uint8_t> m_rtcp;
+
 	FrameCallback m_frameCallback;
+	FeedbackCallback m_feedbackCallback;
 	std::mutex m_mutex;
 };
@@ -14,6 +14,7 @@ void VideoRTPSender::Init(dv::UDPSocket* udp, uint32_t videoSSRC,
 	m_secretKey = secretKey;
 	m_sequence = 0;
 	m_nonce = 0;
+	m_pending.reserve(MAX_PENDING);
 }
 
 void VideoRTPSender::SendFrame(const uint8_t* h264Data, size_t len, uint32_t timestamp)
@@ -22,7 +23,8 @@ void VideoRTPSender::SendFrame(const uint8_t* h264Data, size_t len, uint32_t tim
 		return;
 
 	// Parse H.264 bitstream: find NAL units separated by start codes (00 00 00 01 or 00 00 01)
-	std::vector<std::pair<const uint8_t*, size_t>> nalUnits;
+	auto& nalUnits = m_nalUnits;
+	nalUnits.clear();
 
 	size_t i = 0;
 	while (i < len)
@@ -73,6 +75,8 @@ void VideoRTPSender::SendFrame(const uint8_t* h264Data, size_t len, uint32_t tim
 		bool lastNAL = (n == nalUnits.size() - 1);
 		SendNALUnit(nalUnits[n].first, nalUnits[n].second, timestamp, lastNAL);
 	}
+
+	FlushPackets();
 }
 
 void VideoRTPSender::SendNALUnit(const uint8_t* nal, size_t len, uint32_t timestamp, bool lastNAL)
@@ -83,7 +87,8 @@ void VideoRTPSender::SendNALUnit(const uint8_t* nal, size_t len, uint32_t timest
 	if (len <= MAX_RTP_PAYLOAD)
 	{
 		// Single NAL unit packet — send as-is
-		SendRTPPacket(nal, len, timestamp, lastNAL);
+		auto packet = m_udp->GetPacketPool().Acquire();
+		SendRTPPacket(std::move(packet), nal, len, timestamp, lastNAL);
 	}
 	else
 	{
@@ -125,15 +130,17 @@ void VideoRTPSender::SendFUA(const uint8_t* nal, size_t len, uint32_t timestamp,
 		if (isLast)
 			fuHeader |= 0x40; // End bit
 
-		// Build FU-A packet: FU indicator + FU header + fragment
-		std::vector<uint8_t> fuPacket(2 + fragLen);
+		// Build FU-A packet: FU indicator + FU header + fragment, straight into the
+		// packet buffer so it can be encrypted in place
+		auto packet = m_udp->GetPacketPool().Acquire();
+		uint8_t* fuPacket = packet->PayloadData();
 		fuPacket[0] = fuIndicator;
 		fuPacket[1] = fuHeader;
-		std::memcpy(fuPacket.data() + 2, payload, fragLen);
+		std::memcpy(fuPacket + 2, payload, fragLen);
 
 		// Marker bit: set only on last packet of last NAL in access unit
 		bool marker = isLast && lastNAL;
-		SendRTPPacket(fuPacket.data(), fuPacket.size(), timestamp, marker);
+		SendRTPPacket(std::move(packet), fuPacket, 2 + fragLen, timestamp, marker);
 
 		payload += fragLen;
 		remaining -= fragLen;
@@ -141,51 +148,33 @@ void VideoRTPSender::SendFUA(const uint8_t* nal, size_t len, uint32_t timestamp,
 	}
 }
 
-void VideoRTPSender::SendRTPPacket(const uint8_t* payload, size_t len,
+void VideoRTPSender::SendRTPPacket(dv::PacketPool::Ptr packet, const uint8_t* payload, size_t len,
                                     uint32_t timestamp, bool marker)
 {
 	m_sequence++;
 	m_nonce++;
 
-	// Build RTP header (12 bytes) + encrypted payload + auth tag + 4-byte nonce
-	const size_t encryptedSize = len + crypto_aead_xchacha20poly1305_ietf_ABYTES;
-	std::vector<uint8_t> rtp(12 + encryptedSize + sizeof(uint32_t), 0);
-
-	// RTP header
-	rtp[0] = 0x80; // Version 2
-	rtp[1] = m_payloadType;
+	uint8_t payloadType = m_payloadType;
 	if (marker)
-		rtp[1] |= 0x80; // Marker bit
-
-	rtp[2] = (m_sequence >> 8) & 0xFF;
-	rtp[3] = (m_sequence >> 0) & 0xFF;
-	rtp[4] = (timestamp >> 24) & 0xFF;
-	rtp[5] = (timestamp >> 16) & 0xFF;
-	rtp[6] = (timestamp >> 8) & 0xFF;
-	rtp[7] = (timestamp >> 0) & 0xFF;
-	rtp[8] = (m_videoSSRC >> 24) & 0xFF;
-	rtp[9] = (m_videoSSRC >> 16) & 0xFF;
-	rtp[10] = (m_videoSSRC >> 8) & 0xFF;
-	rtp[11] = (m_videoSSRC >> 0) & 0xFF;
-
-	// Nonce: 4-byte counter in first 4 bytes, rest zeroed
-	std::array<uint8_t, crypto_aead_xchacha20poly1305_ietf_NPUBBYTES> nonceBytes{};
-	std::memcpy(nonceBytes.data(), &m_nonce, sizeof(uint32_t));
-
-	// Encrypt with AEAD XChaCha20-Poly1305
-	// AAD = RTP header (12 bytes)
-	unsigned long long ciphertextLen;
-	crypto_aead_xchacha20poly1305_ietf_encrypt(
-		rtp.data() + 12, &ciphertextLen,
-		payload, len,
-		rtp.data(), 12, // AAD = RTP header
-		nullptr,
-		nonceBytes.data(),
-		m_secretKey.data());
-
-	// Append 4-byte nonce counter at end
-	rtp.resize(12 + static_cast<size_t>(ciphertextLen) + sizeof(uint32_t));
-	std::memcpy(rtp.data() + rtp.size() - sizeof(uint32_t), &m_nonce, sizeof(uint32_t));
-
-	m_udp->Send(rtp.data(), rtp.size());
+		payloadType |= 0x80; // Marker bit
+
+	if (!dv::SealRTPPacket(*packet, payloadType, m_sequence, timestamp, m_videoSSRC, m_nonce, m_secretKey, payload, len))
+		return;
+
+	m_pending.push_back(std::move(packet));
+
+	// Don't let a huge keyframe hold the whole packet pool
+	if (m_pending.size() >= MAX_PENDING)
+		FlushPackets();
+}
+
+void VideoRTPSender::FlushPackets()
+{
+	if (m_pending.empty())
+		return;
+
+	m_udp->SendBatch(m_pending.data(), m_pending.size());
+
+	// Returns the buffers to the pool, keeps the vector's capacity
+	m_pending.clear();
 }
@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <array>
 #include <vector>
+#include <packet_pool.h>
 
 namespace dv { class UDPSocket; }
 
@@ -24,8 +25,12 @@ private:
 	// Send FU-A fragmented packets (RFC 6184) for NALUs > MTU
 	void SendFUA(const uint8_t* nal, size_t len, uint32_t timestamp, bool lastNAL);
 
-	// Send a single RTP packet with encryption
-	void SendRTPPacket(const uint8_t* payload, size_t len, uint32_t timestamp, bool marker);
+	// Seal `payload` into `packet` and queue it for sending.  The payload may already
+	// live at packet->PayloadData(), in which case it is encrypted in place.
+	void SendRTPPacket(dv::PacketPool::Ptr packet, const uint8_t* payload, size_t len, uint32_t timestamp, bool marker);
+
+	// Send everything queued by SendRTPPacket in as few syscalls as possible
+	void FlushPackets();
 
 	dv::UDPSocket* m_udp = nullptr;
 	uint32_t m_videoSSRC = 0;
@@ -35,5 +40,12 @@ private:
 	uint32_t m_nonce = 0;
 	uint8_t m_payloadType = 101; // H.264
 
+	// NAL units of the frame being sent, kept around to avoid reallocating per frame
+	std::vector<std::pair<const uint8_t*, size_t>> m_nalUnits;
+
+	// Sealed packets waiting for FlushPackets
+	std::vector<dv::PacketPool::Ptr> m_pending;
+	static constexpr size_t MAX_PENDING = 64;
+
 	static constexpr size_t MAX_RTP_PAYLOAD = 1200; // MTU-safe
 };
@@ -2,7 +2,7 @@
 #include "Util.hpp"
 #include "../state/ProfileCache.hpp"
 
-void Emoji::Load(const nlohmann::json& j)
+void Emoji::Load(const nlohmann::json& j, std::vector<nlohmann::json>* pUsers)
 {
 	m_id = GetSnowflake(j, "id");
 	m_name = GetFieldSafe(j, "name");
@@ -12,7 +12,12 @@ void Emoji::Load(const nlohmann::json& j)
 	m_bRequireColons = GetFieldSafeBool(j, "require_colons", true);
 
 	auto it = j.find("user");
-	if (it != j.end())
+	if (it != j.end() && pUsers)
+	{
+		m_user = GetSnowflake(it.value(), "id");
+		pUsers->push_back(it.value());
+	}
+	else if (it != j.end())
 	{
 		Profile* pf = GetProfileCache()->LoadProfile(0, it.value());
 		if (pf)
@@ -1,13 +1,16 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <nlohmann/json.h>
 #include "../models/Snowflake.hpp"
 
 class Emoji
 {
 public:
-	void Load(const nlohmann::json& j);
+	// If pUsers is given, the uploader's user object is added to it instead of being
+	// loaded into the profile cache.
+	void Load(const nlohmann::json& j, std::vector<nlohmann::json>* pUsers = nullptr);
 
 public:
 	Snowflake m_id = 0;
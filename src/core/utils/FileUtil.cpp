@@ -0,0 +1,146 @@
+#include "FileUtil.hpp"
+#include <cstdio>
+#include <utility>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#undef WIN32_LEAN_AND_MEAN
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+void MakeDirectory(const std::string& path)
+{
+#ifdef _WIN32
+	CreateDirectoryA(path.c_str(), NULL);
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+// rename() doesn't overwrite on Windows, and MoveFileEx isn't available on 9x
+bool MoveFileOver(const std::string& from, const std::string& to)
+{
+#ifdef _WIN32
+	remove(to.c_str());
+#endif
+	return rename(from.c_str(), to.c_str()) == 0;
+}
+
+bool WriteWholeFile(const std::string& path, const void* data, size_t size)
+{
+	FILE* f = fopen(path.c_str(), "wb");
+	if (!f)
+		return false;
+
+	bool ok = fwrite(data, 1, size, f) == size;
+	ok = fclose(f) == 0 && ok;
+
+	if (!ok)
+		remove(path.c_str());
+
+	return ok;
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+MappedFile::MappedFile(MappedFile&& other)
+{
+	*this = std::move(other);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& other)
+{
+	if (this == &other)
+		return *this;
+
+	Close();
+	std::swap(m_pData, other.m_pData);
+	std::swap(m_size, other.m_size);
+#ifdef _WIN32
+	std::swap(m_hFile, other.m_hFile);
+	std::swap(m_hMapping, other.m_hMapping);
+#endif
+	return *this;
+}
+
+bool MappedFile::Open(const std::string& path)
+{
+	Close();
+
+#ifdef _WIN32
+	HANDLE hFile = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (hFile == INVALID_HANDLE_VALUE)
+		return false;
+
+	DWORD size = GetFileSize(hFile, NULL);
+	if (size == 0 || size == INVALID_FILE_SIZE) {
+		CloseHandle(hFile);
+		return false;
+	}
+
+	HANDLE hMapping = CreateFileMappingA(hFile, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!hMapping) {
+		CloseHandle(hFile);
+		return false;
+	}
+
+	void* pData = MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0);
+	if (!pData) {
+		CloseHandle(hMapping);
+		CloseHandle(hFile);
+		return false;
+	}
+
+	m_hFile = hFile;
+	m_hMapping = hMapping;
+	m_pData = (const uint8_t*) pData;
+	m_size = size_t(size);
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size == 0) {
+		close(fd);
+		return false;
+	}
+
+	void* pData = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // the mapping keeps the file alive
+	if (pData == MAP_FAILED)
+		return false;
+
+	m_pData = (const uint8_t*) pData;
+	m_size = size_t(st.st_size);
+#endif
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (!m_pData)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(m_pData);
+	CloseHandle((HANDLE) m_hMapping);
+	CloseHandle((HANDLE) m_hFile);
+	m_hMapping = nullptr;
+	m_hFile = nullptr;
+#else
+	munmap((void*) m_pData, m_size);
+#endif
+
+	m_pData = nullptr;
+	m_size = 0;
+}
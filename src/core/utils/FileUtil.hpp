@@ -0,0 +1,55 @@
+#pragma once
+
+#include <string>
+#include <cstdint>
+
+#ifdef _WIN32
+#define PATH_SEP "\\"
+#else
+#define PATH_SEP "/"
+#endif
+
+// Creates a directory.  It's fine if it exists already.
+void MakeDirectory(const std::string& path);
+
+// Renames a file, replacing the destination if there's one.
+bool MoveFileOver(const std::string& from, const std::string& to);
+
+// Writes a file in one go.  On failure, nothing is left behind.
+bool WriteWholeFile(const std::string& path, const void* data, size_t size);
+
+// Read-only memory mapping of a whole file.
+class MappedFile
+{
+public:
+	MappedFile() {}
+	~MappedFile();
+
+	MappedFile(MappedFile&& other);
+	MappedFile& operator=(MappedFile&& other);
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	bool Open(const std::string& path);
+	void Close();
+
+	bool IsValid() const {
+		return m_pData != nullptr;
+	}
+	const uint8_t* Data() const {
+		return m_pData;
+	}
+	size_t Size() const {
+		return m_size;
+	}
+
+private:
+	const uint8_t* m_pData = nullptr;
+	size_t m_size = 0;
+
+#ifdef _WIN32
+	void* m_hFile = nullptr;
+	void* m_hMapping = nullptr;
+#endif
+};
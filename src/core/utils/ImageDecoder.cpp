@@ -0,0 +1,354 @@
+#include "ImageDecoder.hpp"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <cstring>
+
+#ifndef WEBP_DISABLED
+#include <webp/decode.h>
+#endif
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+// SSE2 is part of every x64 CPU.  32-bit builds only get it if the compiler was
+// told it may use it, since we still run on processors that predate it.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define IMAGE_DECODER_SSE2
+#include <emmintrin.h>
+#endif
+
+// x * a / 255 rounded down, without the divide.  Exact for all 8-bit x and a.
+static inline uint32_t MulDiv255(uint32_t x, uint32_t a)
+{
+	return ((x * a + 1) * 257) >> 16;
+}
+
+#ifndef WEBP_DISABLED
+
+static bool DecodeWebp(const uint8_t* pData, size_t size, DecodedImage& out)
+{
+	int width = 0, height = 0;
+	uint8_t* data = WebPDecodeBGRA(pData, size, &width, &height);
+	if (!data)
+		return false;
+
+	DecodedFrame frame;
+	frame.Pixels.resize(size_t(width) * size_t(height));
+	memcpy(frame.Pixels.data(), data, frame.Pixels.size() * sizeof(uint32_t));
+	WebPFree(data);
+
+	out.Width = width;
+	out.Height = height;
+	out.Frames.push_back(std::move(frame));
+	return true;
+}
+
+#else
+
+static bool DecodeWebp(const uint8_t* pData, size_t size, DecodedImage& out)
+{
+	return false;
+}
+
+#endif
+
+static bool DecodeWithStbImage(const uint8_t* pData, size_t size, DecodedImage& out)
+{
+	if (size > INT_MAX)
+		return false;
+
+	int x = 0, w = 0, h = 0;
+	stbi_uc* dataStbi = stbi_load_from_memory(pData, int(size), &w, &h, &x, 4);
+	if (!dataStbi)
+		return false;
+
+	DecodedFrame frame;
+	frame.Pixels.resize(size_t(w) * size_t(h));
+	memcpy(frame.Pixels.data(), dataStbi, frame.Pixels.size() * sizeof(uint32_t));
+	stbi_image_free(dataStbi);
+
+	// byte swap because stbi is annoying
+	ImageDecoder::SwapRedBlue(frame.Pixels.data(), frame.Pixels.size());
+
+	out.Width = w;
+	out.Height = h;
+	out.Frames.push_back(std::move(frame));
+	return true;
+}
+
+bool ImageDecoder::Decode(const uint8_t* pData, size_t size, DecodedImage& out, int width, int height)
+{
+	out = DecodedImage();
+
+	// try using stb_image if it's not a webp, probably a png/gif/jpg
+	if (!DecodeWebp(pData, size, out) && !DecodeWithStbImage(pData, size, out))
+		return false;
+
+	if (out.Width <= 0 || out.Height <= 0) {
+		out = DecodedImage();
+		return false;
+	}
+
+	for (auto& frame : out.Frames) {
+		if (PremultiplyAlpha(frame.Pixels.data(), frame.Pixels.size()))
+			out.HasAlpha = true;
+	}
+
+	if (!width)
+		width = out.Width;
+	if (!height)
+		height = out.Height;
+
+	Resize(out, width, height);
+	return true;
+}
+
+bool ImageDecoder::PremultiplyAlpha(uint32_t* pixels, size_t count)
+{
+	bool hasAlpha = false;
+	size_t i = 0;
+
+#ifdef IMAGE_DECODER_SSE2
+	const __m128i alphaMask = _mm_set1_epi32(int(0xFF000000));
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i one = _mm_set1_epi16(1);
+	const __m128i div255 = _mm_set1_epi16(257);
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i px = _mm_loadu_si128((const __m128i*) &pixels[i]);
+
+		// Most images are mostly opaque
+		__m128i opaque = _mm_cmpeq_epi32(_mm_and_si128(px, alphaMask), alphaMask);
+		if (_mm_movemask_epi8(opaque) == 0xFFFF)
+			continue;
+
+		hasAlpha = true;
+
+		// Two pixels per register, as 16-bit channels
+		__m128i lo = _mm_unpacklo_epi8(px, zero);
+		__m128i hi = _mm_unpackhi_epi8(px, zero);
+		__m128i alo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+		__m128i ahi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+
+		// Same as MulDiv255
+		lo = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(lo, alo), one), div255);
+		hi = _mm_mulhi_epu16(_mm_add_epi16(_mm_mullo_epi16(hi, ahi), one), div255);
+
+		__m128i res = _mm_packus_epi16(lo, hi);
+		res = _mm_or_si128(_mm_andnot_si128(alphaMask, res), _mm_and_si128(px, alphaMask));
+		_mm_storeu_si128((__m128i*) &pixels[i], res);
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		uint32_t px = pixels[i];
+		uint32_t a = px >> 24;
+		if (a == 0xFF)
+			continue;
+
+		hasAlpha = true;
+		uint32_t b = MulDiv255(px & 0xFF, a);
+		uint32_t g = MulDiv255((px >> 8) & 0xFF, a);
+		uint32_t r = MulDiv255((px >> 16) & 0xFF, a);
+		pixels[i] = b | (g << 8) | (r << 16) | (a << 24);
+	}
+
+	return hasAlpha;
+}
+
+void ImageDecoder::SwapRedBlue(uint32_t* pixels, size_t count)
+{
+	size_t i = 0;
+
+#ifdef IMAGE_DECODER_SSE2
+	const __m128i keepMask = _mm_set1_epi32(int(0xFF00FF00));
+	const __m128i lowMask = _mm_set1_epi32(0xFF);
+
+	for (; i + 4 <= count; i += 4)
+	{
+		__m128i px = _mm_loadu_si128((const __m128i*) &pixels[i]);
+		__m128i res = _mm_and_si128(px, keepMask);
+		res = _mm_or_si128(res, _mm_and_si128(_mm_srli_epi32(px, 16), lowMask));
+		res = _mm_or_si128(res, _mm_slli_epi32(_mm_and_si128(px, lowMask), 16));
+		_mm_storeu_si128((__m128i*) &pixels[i], res);
+	}
+#endif
+
+	for (; i < count; i++)
+	{
+		uint32_t px = pixels[i];
+		pixels[i] = (px & 0xFF00FF00) | ((px >> 16) & 0xFF) | ((px & 0xFF) << 16);
+	}
+}
+
+void ImageDecoder::Resize(DecodedImage& image, int width, int height)
+{
+	if (width <= 0 || height <= 0 || (width == image.Width && height == image.Height))
+		return;
+
+	std::vector<uint32_t> resized;
+	for (auto& frame : image.Frames)
+	{
+		resized.resize(size_t(width) * size_t(height));
+		ResizePixels(frame.Pixels.data(), image.Width, image.Height, resized.data(), width, height);
+		frame.Pixels.swap(resized);
+	}
+
+	image.Width = width;
+	image.Height = height;
+}
+
+namespace
+{
+	// For each destination pixel along one axis, the source pixels that
+	// contribute to it and their weights (which add up to 1).
+	struct ResampleTable
+	{
+		std::vector<int> First;    // index into Source/Weight
+		std::vector<int> Count;
+		std::vector<int> Source;
+		std::vector<float> Weight;
+
+		ResampleTable(int srcSize, int dstSize)
+		{
+			First.resize(dstSize);
+			Count.resize(dstSize);
+
+			const double scale = double(srcSize) / double(dstSize);
+			for (int o = 0; o < dstSize; o++)
+			{
+				First[o] = int(Source.size());
+
+				if (scale > 1.0)
+				{
+					// Shrinking: box filter over the covered source span
+					const double lo = o * scale, hi = (o + 1) * scale;
+					int s0 = int(lo), s1 = int(std::ceil(hi));
+					if (s1 > srcSize)
+						s1 = srcSize;
+
+					for (int s = s0; s < s1; s++) {
+						double cover = std::min(hi, double(s + 1)) - std::max(lo, double(s));
+						if (cover <= 0.0)
+							continue;
+						Source.push_back(s);
+						Weight.push_back(float(cover / scale));
+					}
+				}
+				else
+				{
+					// Enlarging: bilinear between the two nearest source pixels
+					double center = (o + 0.5) * scale - 0.5;
+					if (center < 0.0)
+						center = 0.0;
+
+					int s0 = int(center);
+					float frac = float(center - s0);
+					int s1 = s0 + 1 < srcSize ? s0 + 1 : s0;
+
+					Source.push_back(s0);
+					Weight.push_back(1.0f - frac);
+					Source.push_back(s1);
+					Weight.push_back(frac);
+				}
+
+				Count[o] = int(Source.size()) - First[o];
+			}
+		}
+	};
+}
+
+void ImageDecoder::ResizePixels(const uint32_t* src, int srcWidth, int srcHeight, uint32_t* dst, int dstWidth, int dstHeight)
+{
+	ResampleTable horz(srcWidth, dstWidth);
+	ResampleTable vert(srcHeight, dstHeight);
+
+	// Horizontal pass into a float buffer, dstWidth x srcHeight, 4 channels
+	std::vector<float> temp(size_t(dstWidth) * size_t(srcHeight) * 4);
+	for (int y = 0; y < srcHeight; y++)
+	{
+		const uint32_t* row = src + size_t(y) * srcWidth;
+		float* out = &temp[size_t(y) * dstWidth * 4];
+
+		for (int x = 0; x < dstWidth; x++)
+		{
+			const int first = horz.First[x], count = horz.Count[x];
+
+#ifdef IMAGE_DECODER_SSE2
+			// One pixel per register, a float per channel
+			const __m128i zero = _mm_setzero_si128();
+			__m128 acc = _mm_setzero_ps();
+			for (int i = 0; i < count; i++)
+			{
+				__m128i px = _mm_cvtsi32_si128(int(row[horz.Source[first + i]]));
+				px = _mm_unpacklo_epi16(_mm_unpacklo_epi8(px, zero), zero);
+				acc = _mm_add_ps(acc, _mm_mul_ps(_mm_cvtepi32_ps(px), _mm_set1_ps(horz.Weight[first + i])));
+			}
+
+			_mm_storeu_ps(out + x * 4, acc);
+#else
+			float acc[4] = { 0, 0, 0, 0 };
+			for (int i = 0; i < count; i++)
+			{
+				const uint32_t px = row[horz.Source[first + i]];
+				const float w = horz.Weight[first + i];
+				acc[0] += w * float(px & 0xFF);
+				acc[1] += w * float((px >> 8) & 0xFF);
+				acc[2] += w * float((px >> 16) & 0xFF);
+				acc[3] += w * float(px >> 24);
+			}
+
+			memcpy(out + x * 4, acc, sizeof acc);
+#endif
+		}
+	}
+
+	// Vertical pass into the destination
+	std::vector<float> acc(size_t(dstWidth) * 4);
+	for (int y = 0; y < dstHeight; y++)
+	{
+		std::fill(acc.begin(), acc.end(), 0.0f);
+
+		const int first = vert.First[y], count = vert.Count[y];
+		for (int i = 0; i < count; i++)
+		{
+			const float* row = &temp[size_t(vert.Source[first + i]) * dstWidth * 4];
+			const float w = vert.Weight[first + i];
+
+#ifdef IMAGE_DECODER_SSE2
+			// Rows are a whole number of pixels, so always a multiple of four floats
+			const __m128 wv = _mm_set1_ps(w);
+			for (int x = 0; x < dstWidth * 4; x += 4)
+				_mm_storeu_ps(&acc[x], _mm_add_ps(_mm_loadu_ps(&acc[x]), _mm_mul_ps(_mm_loadu_ps(&row[x]), wv)));
+#else
+			for (int x = 0; x < dstWidth * 4; x++)
+				acc[x] += w * row[x];
+#endif
+		}
+
+		uint32_t* out = dst + size_t(y) * dstWidth;
+		for (int x = 0; x < dstWidth; x++)
+		{
+#ifdef IMAGE_DECODER_SSE2
+			// Round, then clamp to 0..255 with the saturating packs
+			__m128i v = _mm_cvttps_epi32(_mm_add_ps(_mm_loadu_ps(&acc[x * 4]), _mm_set1_ps(0.5f)));
+			v = _mm_packs_epi32(v, v);
+			v = _mm_packus_epi16(v, v);
+			out[x] = uint32_t(_mm_cvtsi128_si32(v));
+#else
+			uint32_t px = 0;
+			for (int c = 0; c < 4; c++)
+			{
+				int v = int(acc[x * 4 + c] + 0.5f);
+				if (v < 0) v = 0;
+				if (v > 255) v = 255;
+				px |= uint32_t(v) << (c * 8);
+			}
+			out[x] = px;
+#endif
+		}
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+struct DecodedFrame
+{
+	int FrameTime = 0;
+	std::vector<uint32_t> Pixels; // BGRA, alpha premultiplied, top row first
+};
+
+struct DecodedImage
+{
+	std::vector<DecodedFrame> Frames;
+	int Width = 0;
+	int Height = 0;
+	bool HasAlpha = false; // false if every pixel is fully opaque
+
+	bool IsValid() const {
+		return !Frames.empty();
+	}
+};
+
+// Platform independent part of image loading: decoding (WebP, or anything
+// stb_image knows), alpha premultiplication and resampling.  Produces pixels
+// that the frontend only has to copy into a bitmap.  Safe to use from any thread.
+class ImageDecoder
+{
+public:
+	// Decodes an image and premultiplies its alpha.  If width or height is
+	// nonzero, the image is also resized to that.
+	static bool Decode(const uint8_t* pData, size_t size, DecodedImage& out, int width = 0, int height = 0);
+
+	// Resizes every frame of the image.  Shrinking averages all source pixels
+	// covered by a destination pixel, enlarging interpolates bilinearly.
+	static void Resize(DecodedImage& image, int width, int height);
+
+	// Premultiplies BGRA pixels in place.  Returns false if they were all opaque.
+	static bool PremultiplyAlpha(uint32_t* pixels, size_t count);
+
+	// Swaps the red and blue channels, i.e. converts between RGBA and BGRA.
+	static void SwapRedBlue(uint32_t* pixels, size_t count);
+
+	// Resamples a BGRA image.  `dst` must have room for dstWidth * dstHeight pixels.
+	static void ResizePixels(const uint32_t* src, int srcWidth, int srcHeight, uint32_t* dst, int dstWidth, int dstHeight);
+};
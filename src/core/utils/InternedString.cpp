@@ -0,0 +1,68 @@
+#include <unordered_set>
+#include <mutex>
+#include "InternedString.hpp"
+
+namespace
+{
+
+struct StringTable
+{
+	std::mutex m_mutex;
+
+	// Elements of an unordered_set don't move when it rehashes, so handing out
+	// pointers to them is fine.
+	std::unordered_set<std::string> m_strings;
+
+	const std::string* m_pEmpty;
+
+	StringTable() {
+		m_pEmpty = &*m_strings.insert(std::string()).first;
+	}
+
+	const std::string* Intern(const std::string& str)
+	{
+		if (str.empty())
+			return m_pEmpty;
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		return &*m_strings.insert(str).first;
+	}
+};
+
+}
+
+// Messages may be created while other globals are being constructed, so the
+// table is created on first use.
+static StringTable& GetStringTable()
+{
+	static StringTable table;
+	return table;
+}
+
+InternedString::InternedString() : m_pStr(GetStringTable().m_pEmpty)
+{
+}
+
+InternedString::InternedString(const std::string& str) : m_pStr(GetStringTable().Intern(str))
+{
+}
+
+InternedString::InternedString(const char* str) : m_pStr(GetStringTable().Intern(str ? str : ""))
+{
+}
+
+size_t InternedString::GetTableSize(size_t* pBytes)
+{
+	StringTable& table = GetStringTable();
+	std::lock_guard<std::mutex> lock(table.m_mutex);
+
+	if (pBytes)
+	{
+		size_t bytes = 0;
+		for (auto& str : table.m_strings)
+			bytes += sizeof(str) + str.capacity() + 1 + 2 * sizeof(void*); // plus the node
+		*pBytes = bytes;
+	}
+
+	return table.m_strings.size();
+}
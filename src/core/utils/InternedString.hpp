@@ -0,0 +1,45 @@
+#pragma once
+
+#include <string>
+
+// An immutable string that is stored once in a global table, so that all copies
+// of the same text share it and take up a pointer each.  Meant for values that
+// repeat all over the message cache, like author names and avatar hashes.
+// The table only grows: interned text lives until the program exits.
+//
+// Converts to `const std::string&` and offers the few std::string members the
+// code reading these values needs.
+class InternedString
+{
+public:
+	InternedString();
+	InternedString(const std::string& str);
+	InternedString(const char* str);
+
+	const std::string& str() const { return *m_pStr; }
+	operator const std::string&() const { return *m_pStr; }
+
+	const char* c_str() const { return m_pStr->c_str(); }
+	size_t size() const { return m_pStr->size(); }
+	bool empty() const { return m_pStr->empty(); }
+
+	// Equal texts are interned to the same string
+	bool operator==(const InternedString& other) const { return m_pStr == other.m_pStr; }
+	bool operator!=(const InternedString& other) const { return m_pStr != other.m_pStr; }
+
+	// Number of distinct strings and the bytes they take up, for diagnostics.
+	static size_t GetTableSize(size_t* pBytes = nullptr);
+
+private:
+	const std::string* m_pStr;
+};
+
+inline bool operator==(const InternedString& a, const std::string& b) { return a.str() == b; }
+inline bool operator==(const std::string& a, const InternedString& b) { return a == b.str(); }
+inline bool operator!=(const InternedString& a, const std::string& b) { return a.str() != b; }
+inline bool operator!=(const std::string& a, const InternedString& b) { return a != b.str(); }
+
+inline std::string operator+(const InternedString& a, const std::string& b) { return a.str() + b; }
+inline std::string operator+(const InternedString& a, const char* b) { return a.str() + b; }
+inline std::string operator+(const std::string& a, const InternedString& b) { return a + b.str(); }
+inline std::string operator+(const char* a, const InternedString& b) { return a + b.str(); }
@@ -0,0 +1,72 @@
+#include "LRUTracker.hpp"
+#include <cassert>
+
+LRUTracker::LRUTracker(size_t maxEntries, size_t maxBytes) :
+	m_maxEntries(maxEntries),
+	m_maxBytes(maxBytes)
+{
+}
+
+void LRUTracker::Insert(const std::string& key, size_t bytes)
+{
+	auto result = m_entries.insert(std::make_pair(key, Entry()));
+	Entry& entry = result.first->second;
+
+	if (result.second)
+	{
+		m_lru.push_front(key);
+		entry.m_lruIter = m_lru.begin();
+	}
+	else
+	{
+		m_lru.splice(m_lru.begin(), m_lru, entry.m_lruIter);
+		m_bytes -= entry.m_bytes;
+	}
+
+	entry.m_bytes = bytes;
+	m_bytes += bytes;
+}
+
+void LRUTracker::Remove(const std::string& key)
+{
+	auto iter = m_entries.find(key);
+	if (iter == m_entries.end())
+		return;
+
+	m_bytes -= iter->second.m_bytes;
+	m_lru.erase(iter->second.m_lruIter);
+	m_entries.erase(iter);
+}
+
+bool LRUTracker::Touch(const std::string& key)
+{
+	auto iter = m_entries.find(key);
+	if (iter == m_entries.end())
+		return false;
+
+	m_lru.splice(m_lru.begin(), m_lru, iter->second.m_lruIter);
+	return true;
+}
+
+bool LRUTracker::Contains(const std::string& key) const
+{
+	return m_entries.find(key) != m_entries.end();
+}
+
+bool LRUTracker::IsOverBudget() const
+{
+	return m_lru.size() > 1 && (m_lru.size() > m_maxEntries || m_bytes > m_maxBytes);
+}
+
+const std::string& LRUTracker::GetLeastRecent() const
+{
+	assert(!m_lru.empty());
+	return m_lru.back();
+}
+
+void LRUTracker::Clear()
+{
+	m_lru.clear();
+	m_entries.clear();
+	m_bytes = 0;
+}
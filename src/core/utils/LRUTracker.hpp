@@ -0,0 +1,61 @@
+#pragma once
+
+#include <string>
+#include <list>
+#include <unordered_map>
+#include <cstdint>
+
+// Keeps the use order and the sizes of the entries of a cache, and tells which
+// ones to evict once they go over a count or byte budget.  It doesn't hold the
+// entries themselves, the cache evicts them and then calls Remove.
+//
+// The most recently used entry is never picked, it's the one that's about to be
+// used.
+class LRUTracker
+{
+public:
+	LRUTracker(size_t maxEntries, size_t maxBytes);
+
+	// Adds the entry as the most recently used one.  If it's tracked already,
+	// its size is updated.
+	void Insert(const std::string& key, size_t bytes);
+
+	// Stops tracking the entry.  Does nothing if it isn't tracked.
+	void Remove(const std::string& key);
+
+	// Marks the entry as the most recently used one.  Returns false if it isn't tracked.
+	bool Touch(const std::string& key);
+
+	bool Contains(const std::string& key) const;
+
+	// Whether the entries are over budget, and there's one that may be evicted.
+	bool IsOverBudget() const;
+
+	// The least recently used entry, which is evicted next.  There must be one.
+	const std::string& GetLeastRecent() const;
+
+	void Clear();
+
+	size_t GetCount() const {
+		return m_lru.size();
+	}
+	size_t GetBytes() const {
+		return m_bytes;
+	}
+
+private:
+	typedef std::list<std::string> LRUList;
+
+	struct Entry
+	{
+		size_t m_bytes = 0;
+		LRUList::iterator m_lruIter;
+	};
+
+	// Most recently used first
+	LRUList m_lru;
+	std::unordered_map<std::string, Entry> m_entries;
+	size_t m_bytes = 0;
+	size_t m_maxEntries;
+	size_t m_maxBytes;
+};
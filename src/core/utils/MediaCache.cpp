@@ -0,0 +1,447 @@
+#include "MediaCache.hpp"
+#include "Util.hpp"
+#include <cstdio>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#undef WIN32_LEAN_AND_MEAN
+#else
+#include <dirent.h>
+#endif
+
+static MediaCache g_MediaCacheSingleton;
+
+MediaCache* GetMediaCache()
+{
+	return &g_MediaCacheSingleton;
+}
+
+static const char INDEX_MAGIC[4] = { 'D', 'M', 'M', 'C' };
+static const uint32_t INDEX_VERSION = 1;
+
+// Write the index this often while there are changes, in case we don't get to exit
+// cleanly.  The blobs written in the meantime are lost if we crash, but then they're
+// only a cache.
+static const uint64_t FLUSH_INTERVAL_MS = 60000;
+
+// Images used to be stored as loose files right in the cache directory, named after
+// their 32 character hex identifier.
+static bool IsLegacyCacheFileName(const char* name)
+{
+	size_t i = 0;
+	for (; name[i]; i++) {
+		if (i >= 32 || !((name[i] >= '0' && name[i] <= '9') || (name[i] >= 'a' && name[i] <= 'f')))
+			return false;
+	}
+	return i == 32;
+}
+
+// Deletes the files of the old layout, they aren't read anymore.  Returns how many were deleted.
+static int RemoveLegacyCacheFiles(const std::string& directory)
+{
+	std::vector<std::string> names;
+
+#ifdef _WIN32
+	WIN32_FIND_DATAA fd;
+	HANDLE hFind = FindFirstFileA((directory + PATH_SEP "*").c_str(), &fd);
+	if (hFind == INVALID_HANDLE_VALUE)
+		return 0;
+
+	do {
+		if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && IsLegacyCacheFileName(fd.cFileName))
+			names.push_back(fd.cFileName);
+	}
+	while (FindNextFileA(hFind, &fd));
+
+	FindClose(hFind);
+#else
+	DIR* pDir = opendir(directory.c_str());
+	if (!pDir)
+		return 0;
+
+	while (dirent* pEnt = readdir(pDir)) {
+		if (IsLegacyCacheFileName(pEnt->d_name))
+			names.push_back(pEnt->d_name);
+	}
+
+	closedir(pDir);
+#endif
+
+	int removed = 0;
+	for (auto& name : names) {
+		if (remove((directory + PATH_SEP + name).c_str()) == 0)
+			removed++;
+	}
+
+	return removed;
+}
+
+MediaCache::~MediaCache()
+{
+	Flush();
+}
+
+uint64_t MediaCache::HashContents(const uint8_t* data, size_t size)
+{
+	// FNV-1a
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	for (size_t i = 0; i < size; i++) {
+		hash ^= data[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
+std::string MediaCache::GetBlobName(uint64_t hash, uint32_t size)
+{
+	char buff[32];
+	snprintf(buff, sizeof buff, "%016llx%08x", (unsigned long long) hash, (unsigned) size);
+	return std::string(buff);
+}
+
+std::string MediaCache::GetBlobPath(const std::string& blobName) const
+{
+	return m_directory + PATH_SEP + blobName.substr(0, 2) + PATH_SEP + blobName;
+}
+
+void MediaCache::Init(const std::string& directory, uint64_t budget)
+{
+	std::vector<std::string> unusedBlobs;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_directory = directory + PATH_SEP "media";
+		m_budget = budget;
+		m_bInitialized = true;
+		m_lastFlush = GetTimeMs();
+
+		MakeDirectory(m_directory);
+
+		if (!LoadIndex())
+			DbgPrintF("Media cache index missing or unreadable, starting empty");
+
+		// Drop what hasn't been used for a while
+		time_t cutoff = time(NULL) - time_t(MAX_AGE_DAYS) * 24 * 60 * 60;
+		while (!m_lru.empty() && m_lru.back().m_lastUsed < cutoff) {
+			RemoveEntry(std::prev(m_lru.end()), unusedBlobs);
+			m_stats.m_evictions++;
+		}
+
+		EnforceBudget(unusedBlobs);
+
+		DbgPrintF("Media cache loaded: %d entries, %llu bytes", int(m_entries.size()), (unsigned long long) m_stats.m_bytes);
+	}
+
+	DeleteBlobs(unusedBlobs);
+
+	// Cheap once they're gone, so check every time rather than only when migrating
+	int legacyFiles = RemoveLegacyCacheFiles(directory);
+	if (legacyFiles)
+		DbgPrintF("Removed %d files left over from the old cache layout", legacyFiles);
+}
+
+void MediaCache::SetBudget(uint64_t budget)
+{
+	std::vector<std::string> unusedBlobs;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_budget = budget;
+		EnforceBudget(unusedBlobs);
+	}
+
+	DeleteBlobs(unusedBlobs);
+}
+
+bool MediaCache::LoadIndex()
+{
+	std::string path = m_directory + PATH_SEP "index.bin";
+	FILE* f = fopen(path.c_str(), "rb");
+	if (!f)
+		return false;
+
+	char magic[4];
+	uint32_t version = 0, count = 0;
+	if (fread(magic, sizeof magic, 1, f) != 1 ||
+		fread(&version, sizeof version, 1, f) != 1 ||
+		fread(&count, sizeof count, 1, f) != 1 ||
+		memcmp(magic, INDEX_MAGIC, sizeof magic) != 0 ||
+		version != INDEX_VERSION)
+	{
+		fclose(f);
+		return false;
+	}
+
+	// Stored most recently used first
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint16_t keyLength = 0;
+		uint64_t lastUsed = 0;
+		Entry entry;
+
+		if (fread(&keyLength, sizeof keyLength, 1, f) != 1)
+			break;
+
+		entry.m_key.resize(keyLength);
+		if ((keyLength && fread(&entry.m_key[0], keyLength, 1, f) != 1) ||
+			fread(&entry.m_hash, sizeof entry.m_hash, 1, f) != 1 ||
+			fread(&entry.m_size, sizeof entry.m_size, 1, f) != 1 ||
+			fread(&lastUsed, sizeof lastUsed, 1, f) != 1)
+			break;
+
+		entry.m_lastUsed = time_t(lastUsed);
+
+		if (m_entries.find(entry.m_key) != m_entries.end())
+			continue;
+
+		std::string blobName = GetBlobName(entry.m_hash, entry.m_size);
+		if (m_blobRefs[blobName]++ == 0)
+			m_stats.m_bytes += entry.m_size;
+
+		m_lru.push_back(entry);
+		m_entries[entry.m_key] = std::prev(m_lru.end());
+	}
+
+	fclose(f);
+	m_stats.m_entries = m_entries.size();
+	return true;
+}
+
+std::string MediaCache::SerializeIndex()
+{
+	std::string data;
+	uint32_t count = uint32_t(m_lru.size());
+
+	data.append(INDEX_MAGIC, sizeof INDEX_MAGIC);
+	data.append((const char*) &INDEX_VERSION, sizeof INDEX_VERSION);
+	data.append((const char*) &count, sizeof count);
+
+	for (auto& entry : m_lru)
+	{
+		uint16_t keyLength = uint16_t(entry.m_key.size());
+		uint64_t lastUsed = uint64_t(entry.m_lastUsed);
+
+		data.append((const char*) &keyLength, sizeof keyLength);
+		data.append(entry.m_key);
+		data.append((const char*) &entry.m_hash, sizeof entry.m_hash);
+		data.append((const char*) &entry.m_size, sizeof entry.m_size);
+		data.append((const char*) &lastUsed, sizeof lastUsed);
+	}
+
+	return data;
+}
+
+void MediaCache::Flush()
+{
+	// Only one writer of the index file at a time
+	std::lock_guard<std::mutex> flushLock(m_flushMutex);
+
+	std::string data;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_bInitialized || m_unsavedChanges == 0)
+			return;
+
+		data = SerializeIndex();
+		m_unsavedChanges = 0;
+		m_lastFlush = GetTimeMs();
+	}
+
+	// Write a copy and swap it in, so that a crash can't leave a torn index
+	std::string path = m_directory + PATH_SEP "index.bin";
+	std::string tempPath = path + ".tmp";
+
+	if (!WriteWholeFile(tempPath, data.data(), data.size()) || !MoveFileOver(tempPath, path))
+		DbgPrintF("ERROR: Could not write media cache index %s", path.c_str());
+}
+
+void MediaCache::Touch(EntryList::iterator iter)
+{
+	iter->m_lastUsed = time(NULL);
+	m_lru.splice(m_lru.begin(), m_lru, iter);
+	m_unsavedChanges++;
+}
+
+void MediaCache::RemoveEntry(EntryList::iterator iter, std::vector<std::string>& unusedBlobs)
+{
+	std::string blobName = GetBlobName(iter->m_hash, iter->m_size);
+
+	auto refIter = m_blobRefs.find(blobName);
+	if (refIter != m_blobRefs.end() && --refIter->second <= 0)
+	{
+		m_blobRefs.erase(refIter);
+		m_stats.m_bytes -= iter->m_size;
+		unusedBlobs.push_back(blobName);
+	}
+
+	m_entries.erase(iter->m_key);
+	m_lru.erase(iter);
+	m_stats.m_entries = m_entries.size();
+	m_unsavedChanges++;
+}
+
+void MediaCache::EnforceBudget(std::vector<std::string>& unusedBlobs)
+{
+	while (m_stats.m_bytes > m_budget && !m_lru.empty())
+	{
+		RemoveEntry(std::prev(m_lru.end()), unusedBlobs);
+		m_stats.m_evictions++;
+	}
+}
+
+void MediaCache::DeleteBlobs(const std::vector<std::string>& blobs)
+{
+	for (auto& blobName : blobs)
+		remove(GetBlobPath(blobName).c_str());
+}
+
+MappedFile MediaCache::Lookup(const std::string& key)
+{
+	MappedFile file;
+	std::string path;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto iter = m_entries.find(key);
+		if (iter == m_entries.end()) {
+			m_stats.m_misses++;
+			return file;
+		}
+
+		Touch(iter->second);
+		path = GetBlobPath(GetBlobName(iter->second->m_hash, iter->second->m_size));
+	}
+
+	if (file.Open(path))
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stats.m_hits++;
+		return file;
+	}
+
+	// Deleted behind our back.  Forget about it
+	DbgPrintF("Media cache file %s is gone", path.c_str());
+	Remove(key);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_stats.m_misses++;
+	return file;
+}
+
+bool MediaCache::Insert(const std::string& key, const uint8_t* data, size_t size)
+{
+	if (size == 0 || size > UINT32_MAX || key.size() > UINT16_MAX)
+		return false;
+
+	Entry entry;
+	entry.m_key = key;
+	entry.m_hash = HashContents(data, size);
+	entry.m_size = uint32_t(size);
+	entry.m_lastUsed = time(NULL);
+
+	std::string blobName = GetBlobName(entry.m_hash, entry.m_size);
+	std::string blobPath = GetBlobPath(blobName);
+	bool haveBlob;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (!m_bInitialized)
+			return false;
+
+		auto iter = m_entries.find(key);
+		if (iter != m_entries.end() && iter->second->m_hash == entry.m_hash && iter->second->m_size == entry.m_size) {
+			Touch(iter->second);
+			return true;
+		}
+
+		haveBlob = m_blobRefs.find(blobName) != m_blobRefs.end();
+	}
+
+	if (!haveBlob)
+	{
+		// Several threads may write the same blob at once.  Each writes its own
+		// copy and then swaps it in; the contents are the same anyway.
+		MakeDirectory(m_directory + PATH_SEP + blobName.substr(0, 2));
+
+		char suffix[32];
+		snprintf(suffix, sizeof suffix, ".%llu.tmp", (unsigned long long) GetTimeUs());
+		std::string tempPath = blobPath + suffix;
+
+		if (!WriteWholeFile(tempPath, data, size) || !MoveFileOver(tempPath, blobPath)) {
+			DbgPrintF("ERROR: Could not write media cache file %s", blobPath.c_str());
+			remove(tempPath.c_str());
+			return false;
+		}
+	}
+
+	std::vector<std::string> unusedBlobs;
+	bool flush = false;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto iter = m_entries.find(key);
+		if (iter != m_entries.end())
+			RemoveEntry(iter->second, unusedBlobs);
+
+		if (m_blobRefs[blobName]++ == 0)
+			m_stats.m_bytes += entry.m_size;
+
+		// If the old contents of this key were the only user of the blob we're
+		// adding, they were just queued for deletion.  Don't.
+		for (size_t i = 0; i < unusedBlobs.size(); i++) {
+			if (unusedBlobs[i] == blobName) {
+				unusedBlobs.erase(unusedBlobs.begin() + i);
+				break;
+			}
+		}
+
+		m_lru.push_front(entry);
+		m_entries[key] = m_lru.begin();
+		m_stats.m_entries = m_entries.size();
+		m_unsavedChanges++;
+
+		EnforceBudget(unusedBlobs);
+
+		// Never delete the blob of an entry that survived the eviction
+		for (size_t i = 0; i < unusedBlobs.size(); i++) {
+			if (m_blobRefs.find(unusedBlobs[i]) != m_blobRefs.end())
+				unusedBlobs.erase(unusedBlobs.begin() + i--);
+		}
+
+		flush = GetTimeMs() - m_lastFlush >= FLUSH_INTERVAL_MS;
+	}
+
+	DeleteBlobs(unusedBlobs);
+
+	if (flush)
+		Flush();
+
+	return true;
+}
+
+void MediaCache::Remove(const std::string& key)
+{
+	std::vector<std::string> unusedBlobs;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+
+		auto iter = m_entries.find(key);
+		if (iter == m_entries.end())
+			return;
+
+		RemoveEntry(iter->second, unusedBlobs);
+	}
+
+	DeleteBlobs(unusedBlobs);
+}
+
+MediaCache::Stats MediaCache::GetStats()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_stats;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <string>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <vector>
+#include <mutex>
+#include <ctime>
+#include <cstdint>
+#include "FileUtil.hpp"
+
+// Disk cache for downloaded images and attachments.
+//
+// Entries are looked up by the identifier the frontend already uses for the
+// resource.  Their contents are stored once per distinct content hash in a
+// "media" subdirectory, fanned out over 256 folders.  A single index file
+// keeps the key -> content mapping, sizes, and last use times, ordered by
+// last use.  When the contents go over the byte budget, the least recently
+// used entries are evicted.  Entries unused for MAX_AGE_DAYS are dropped on
+// load.
+//
+// Thread safe.  File I/O happens outside the lock.
+class MediaCache
+{
+public:
+	static constexpr int MAX_AGE_DAYS = 30;
+	static constexpr uint64_t DEFAULT_BUDGET = 256ULL * 1024 * 1024;
+
+	struct Stats
+	{
+		uint64_t m_hits = 0;
+		uint64_t m_misses = 0;
+		uint64_t m_evictions = 0;
+		size_t m_entries = 0;
+		uint64_t m_bytes = 0; // on disk, after deduplication
+	};
+
+	~MediaCache();
+
+	// Loads the index from `directory`.  Must be called before anything else.
+	// Also deletes the loose files that the old cache layout left in there.
+	void Init(const std::string& directory, uint64_t budget = DEFAULT_BUDGET);
+
+	void SetBudget(uint64_t budget);
+
+	// Maps the cached contents of `key`.  Returns an invalid file on a miss.
+	MappedFile Lookup(const std::string& key);
+
+	// Stores `data` as the contents of `key`, replacing what was there.
+	bool Insert(const std::string& key, const uint8_t* data, size_t size);
+
+	// Drops an entry, e.g. because its contents turned out to be corrupt.
+	void Remove(const std::string& key);
+
+	// Writes the index if anything changed since the last time.
+	void Flush();
+
+	Stats GetStats();
+
+private:
+	struct Entry
+	{
+		std::string m_key;
+		uint64_t m_hash = 0;
+		uint32_t m_size = 0;
+		time_t m_lastUsed = 0;
+	};
+	typedef std::list<Entry> EntryList;
+
+	static uint64_t HashContents(const uint8_t* data, size_t size);
+	static std::string GetBlobName(uint64_t hash, uint32_t size);
+	std::string GetBlobPath(const std::string& blobName) const;
+
+	bool LoadIndex();
+	std::string SerializeIndex();
+
+	// These are called with m_mutex held.  Blobs that are no longer referenced
+	// are added to `unusedBlobs`, for the caller to delete once it has unlocked.
+	void RemoveEntry(EntryList::iterator iter, std::vector<std::string>& unusedBlobs);
+	void EnforceBudget(std::vector<std::string>& unusedBlobs);
+	void Touch(EntryList::iterator iter);
+
+	void DeleteBlobs(const std::vector<std::string>& blobs);
+
+	std::mutex m_mutex;
+	std::mutex m_flushMutex;
+	std::string m_directory;
+	uint64_t m_budget = DEFAULT_BUDGET;
+	bool m_bInitialized = false;
+
+	EntryList m_lru; // most recently used first
+	std::unordered_map<std::string, EntryList::iterator> m_entries;
+	std::map<std::string, int> m_blobRefs; // blob name -> number of entries using it
+
+	int m_unsavedChanges = 0;
+	uint64_t m_lastFlush = 0;
+	Stats m_stats;
+};
+
+MediaCache* GetMediaCache();
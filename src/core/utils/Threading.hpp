@@ -0,0 +1,40 @@
+#pragma once
+
+// The threading primitives used by core.  The C++11 library of the mingw
+// toolchain used for the release builds doesn't have std::thread and friends,
+// so iprogsthreads stands in for them there, like it does for asio and
+// websocketpp.
+
+#ifdef MINGW_SPECIFIC_HACKS
+
+#include <iprog/mutex.hpp>
+#include <iprog/thread.hpp>
+#include <iprog/lock_guard.hpp>
+#include <iprog/unique_lock.hpp>
+#include <iprog/condition_variable.hpp>
+
+namespace threading
+{
+	using iprog::mutex;
+	using iprog::lock_guard;
+	using iprog::thread;
+	using iprog::unique_lock;
+	using iprog::condition_variable;
+}
+
+#else
+
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+namespace threading
+{
+	using std::mutex;
+	using std::lock_guard;
+	using std::thread;
+	using std::unique_lock;
+	using std::condition_variable;
+}
+
+#endif
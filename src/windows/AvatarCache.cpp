@@ -2,8 +2,15 @@
 #include "AvatarCache.hpp"
 #include "WinUtils.hpp"
 #include "ImageLoader.hpp"
+#include "utils/MediaCache.hpp"
+#include "ImageDecodePool.hpp"
 
 #define MAX_BITMAPS_KEEP_LOADED (256)
+#define MAX_BITMAP_BYTES (128 * 1024 * 1024)
+
+// Loading and error placeholders don't hold pixels, but there's one for every
+// resource that was ever looked at, so bound how many are remembered.
+#define MAX_PLACEHOLDERS_KEEP (1024)
 
 //#define DISABLE_AVATAR_LOADING_FOR_DEBUGGING
 
@@ -24,6 +31,12 @@ AvatarCache* GetAvatarCache() {
 	return &s_AvatarCacheSingleton;
 }
 
+AvatarCache::AvatarCache() :
+	m_lru(MAX_BITMAPS_KEEP_LOADED, MAX_BITMAP_BYTES),
+	m_placeholderLRU(MAX_PLACEHOLDERS_KEEP, SIZE_MAX)
+{
+}
+
 std::string AvatarCache::MakeIdentifier(const std::string& resource)
 {
 	if (!m_resourceNameToID[resource].empty())
@@ -56,26 +69,39 @@ void AvatarCache::SetImage(const std::string& resource, HImage* him, bool hasAlp
 {
 	std::string id = MakeIdentifier(resource);
 
-	// Remove the least recently used bitmap until the maximum amount is loaded.
-	while (m_profileToBitmap.size() > MAX_BITMAPS_KEEP_LOADED)
+	BitmapObject& bo = m_profileToBitmap[id];
+	if (bo.m_image != him)
+		DeleteImageIfNeeded(bo.m_image);
+
+	bo.m_image = him;
+	bo.m_bHasAlpha = hasAlpha;
+
+	if (IsRealImage(him))
 	{
-		if (!TrimBitmap())
-			break;
+		m_placeholderLRU.Remove(id);
+		m_lru.Insert(id, him->Frames.size() * size_t(him->Width) * size_t(him->Height) * 4);
+	}
+	else
+	{
+		m_lru.Remove(id);
+		m_placeholderLRU.Insert(id, 0);
 	}
 
-	AgeBitmaps();
+	EnforceBudget();
+}
 
-	auto iter = m_profileToBitmap.find(id);
-	if (iter != m_profileToBitmap.end())
+void AvatarCache::EnforceBudget()
+{
+	// The most recent ones are never evicted, they're about to be drawn.
+	while (m_lru.IsOverBudget())
+		TrimBitmap();
+
+	while (m_placeholderLRU.IsOverBudget())
 	{
-		DeleteImageIfNeeded(iter->second.m_image);
-		iter->second.m_image = him;
-		iter->second.m_age = 0;
-		iter->second.m_bHasAlpha = hasAlpha;
-		return;
+		// Copy it, Evict drops the tracker's entry
+		std::string id = m_placeholderLRU.GetLeastRecent();
+		Evict(id);
 	}
-
-	m_profileToBitmap[id] = BitmapObject(him, 0, hasAlpha);
 }
 
 ImagePlace AvatarCache::GetPlace(const std::string& resource)
@@ -104,11 +130,17 @@ HImage* AvatarCache::GetImageSpecial(const std::string& resource, bool& hasAlpha
 
 	auto iter = m_profileToBitmap.find(id);
 	if (iter != m_profileToBitmap.end()) {
-		iter->second.m_age = 0;
+		if (m_lru.Touch(id))
+			m_stats.m_hits++;
+		else
+			m_placeholderLRU.Touch(id);
+
 		hasAlphaOut = iter->second.m_bHasAlpha;
 		return iter->second.m_image;
 	}
 
+	m_stats.m_misses++;
+
 	auto iterIP = m_imagePlaces.find(id);
 	if (iterIP == m_imagePlaces.end()) {
 		// this shouldn't happen.  Just set to default
@@ -120,42 +152,22 @@ HImage* AvatarCache::GetImageSpecial(const std::string& resource, bool& hasAlpha
 	eImagePlace pla = iterIP->second.type;
 
 	// Check if we have already downloaded a cached version.
-	std::string final_path = GetCachePath() + "\\" + id;
-	if (FileExists(final_path))
+	MappedFile cached = GetMediaCache()->Lookup(id);
+	if (cached.IsValid())
 	{
 #ifndef DISABLE_AVATAR_LOADING_FOR_DEBUGGING
-		DbgPrintW("Loading image %s", final_path.c_str());
-		// load that instead.
-		FILE* f = fopen(final_path.c_str(), "rb");
-		if (!f) {
-			SetImage(id, HIMAGE_ERROR, false);
-			return GetImageSpecial(id, hasAlphaOut);
-		}
-
-		fseek(f, 0, SEEK_END);
-		int sz = int(ftell(f));
-		fseek(f, 0, SEEK_SET);
-
-		uint8_t* pData = new uint8_t[sz];
-		fread(pData, 1, sz, f);
-
-		fclose(f);
-
-		int nsz = pla == eImagePlace::ATTACHMENTS ? 0 : -1;
-		bool hasAlpha = false;
-		HImage* himg = ImageLoader::ConvertToBitmap(pData, size_t(sz), hasAlpha, false, nsz, nsz);
-		delete[] pData;
-
-		if (himg && himg->IsValid())
-		{
-			SetImage(id, himg, hasAlpha);
-			hasAlphaOut = hasAlpha;
-			return himg;
-		}
+		DbgPrintW("Loading image %s from the cache", id.c_str());
 
-		SAFE_DELETE(himg);
+		// Decoding is slow enough to make scrolling stutter, so do it in the background.
+		ImageDecodeJob job;
+		job.m_id = id;
+		job.m_file = std::move(cached);
+		job.m_bFromCache = true;
+		GetDecodeSize(pla, job.m_width, job.m_height);
 
-		DbgPrintW("Image %s could not be decoded!  Falling back to loading it from remote source", id.c_str());
+		SetImage(id, HIMAGE_LOADING, false);
+		GetImageDecodePool()->Submit(std::move(job));
+		return GetImageSpecial(id, hasAlphaOut);
 #else
 		SetImage(id, HIMAGE_ERROR, false);
 		return GetImageSpecial(id, hasAlphaOut);
@@ -202,6 +214,65 @@ HImage* AvatarCache::GetImageSpecial(const std::string& resource, bool& hasAlpha
 	return GetImageSpecial(id, hasAlphaOut);
 }
 
+void AvatarCache::DecodeAsync(const std::string& resource, const uint8_t* pData, size_t size)
+{
+	std::string id = MakeIdentifier(resource);
+
+	ImageDecodeJob job;
+	job.m_id = id;
+	job.m_data.assign(pData, pData + size);
+	GetDecodeSize(GetPlace(id).type, job.m_width, job.m_height);
+
+	GetImageDecodePool()->Submit(std::move(job));
+}
+
+void AvatarCache::OnImageDecoded(ImageDecodeResult& result)
+{
+	const std::string& id = result.m_id;
+
+	if (!result.m_image.IsValid())
+	{
+		// Don't keep serving the broken copy
+		GetMediaCache()->Remove(id);
+
+		if (result.m_bFromCache)
+		{
+			// Forget the loading placeholder, the next lookup fetches it from the remote source
+			DbgPrintW("Image %s could not be decoded!  Falling back to loading it from remote source", id.c_str());
+			EraseBitmap(id);
+			OnUpdateAvatar(id);
+		}
+		else
+		{
+			DbgPrintW("Failed to load convert image to bitmap! Unrecognized format?");
+		}
+		return;
+	}
+
+	bool hasAlpha = false;
+	HImage* himg = ImageLoader::ConvertToBitmap(result.m_image, hasAlpha, false);
+	if (!himg || !himg->IsValid())
+	{
+		SAFE_DELETE(himg);
+		SetImage(id, HIMAGE_ERROR, false);
+		OnUpdateAvatar(id);
+		return;
+	}
+
+	if (!result.m_bFromCache)
+		LoadedResource(id);
+
+	SetImage(id, himg, hasAlpha);
+	OnUpdateAvatar(id);
+}
+
+void AvatarCache::GetDecodeSize(eImagePlace place, int& width, int& height)
+{
+	// Attachments are shown at their original size, everything else as a profile picture.
+	int size = place == eImagePlace::ATTACHMENTS ? 0 : GetProfilePictureSize();
+	width = height = size;
+}
+
 HImage* AvatarCache::GetImageNullable(const std::string& resource, bool& hasAlphaOut)
 {
 	HImage* him = GetImageSpecial(resource, hasAlphaOut);
@@ -225,15 +296,20 @@ HImage* AvatarCache::GetImage(const std::string& resource, bool& hasAlphaOut)
 
 void AvatarCache::WipeBitmaps()
 {
-	for (auto b : m_profileToBitmap)
+	for (auto& b : m_profileToBitmap)
 		DeleteImageIfNeeded(b.second.m_image);
 
 	m_profileToBitmap.clear();
+	m_lru.Clear();
+	m_placeholderLRU.Clear();
 	m_imagePlaces.clear();
 }
 
 void AvatarCache::EraseBitmap(const std::string& resource)
 {
+	m_lru.Remove(resource);
+	m_placeholderLRU.Remove(resource);
+
 	auto iter = m_profileToBitmap.find(resource);
 	if (iter == m_profileToBitmap.end())
 		return;
@@ -242,34 +318,26 @@ void AvatarCache::EraseBitmap(const std::string& resource)
 	m_profileToBitmap.erase(iter);
 }
 
-bool AvatarCache::TrimBitmap()
+void AvatarCache::Evict(const std::string& id)
 {
-	int maxAge = 0;
-	std::string rid = "";
-
-	for (auto &b : m_profileToBitmap) {
-		if (maxAge < b.second.m_age &&
-			b.second.m_image != GetDefaultImage() &&
-			b.second.m_image != HIMAGE_ERROR &&
-			b.second.m_image != HIMAGE_LOADING) {
-			maxAge = b.second.m_age;
-			rid    = b.first;
-		}
-	}
-
-	if (rid.empty()) return false;
+	auto iter = m_imagePlaces.find(id);
+	if (iter != m_imagePlaces.end())
+		m_loadingResources.erase(iter->second.GetURL());
 
-	auto iter = m_profileToBitmap.find(rid);
-	assert(iter != m_profileToBitmap.end());
+	EraseBitmap(id);
+}
 
-	auto iter2 = m_loadingResources.find(m_imagePlaces[iter->first].GetURL());
+bool AvatarCache::TrimBitmap()
+{
+	if (!m_lru.GetCount())
+		return false;
 
-	if (iter2 != m_loadingResources.end())
-		m_loadingResources.erase(iter2);
+	// Copy it, Evict drops the tracker's entry
+	std::string rid = m_lru.GetLeastRecent();
 
 	DbgPrintW("Deleting bitmap %s", rid.c_str());
-	DeleteImageIfNeeded(iter->second.m_image);
-	m_profileToBitmap.erase(iter);
+	Evict(rid);
+	m_stats.m_evictions++;
 
 	return true;
 }
@@ -288,11 +356,12 @@ int AvatarCache::TrimBitmaps(int count)
 	return trimCount;
 }
 
-void AvatarCache::AgeBitmaps()
+AvatarCache::Stats AvatarCache::GetStats() const
 {
-	for (auto &b : m_profileToBitmap) {
-		b.second.m_age++;
-	}
+	Stats stats = m_stats;
+	stats.m_bitmaps = m_lru.GetCount();
+	stats.m_bytes = m_lru.GetBytes();
+	return stats;
 }
 
 void AvatarCache::ClearProcessingRequests()
@@ -302,10 +371,15 @@ void AvatarCache::ClearProcessingRequests()
 
 void AvatarCache::DeleteImageIfNeeded(HImage* him)
 {
-	if (him && him != HIMAGE_LOADING && him != HIMAGE_ERROR && him != GetDefaultImage())
+	if (IsRealImage(him))
 		delete him;
 }
 
+bool AvatarCache::IsRealImage(HImage* him)
+{
+	return him && him != HIMAGE_LOADING && him != HIMAGE_ERROR && him != GetDefaultImage();
+}
+
 std::string ImagePlace::GetURL() const
 {
 	bool bIsAttachment = false;
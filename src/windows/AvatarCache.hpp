@@ -3,11 +3,15 @@
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 #include <unordered_map>
+#include <list>
 #include <set>
 
 #include "models/Snowflake.hpp"
+#include "utils/LRUTracker.hpp"
 #include "ImageLoader.hpp"
 
+struct ImageDecodeResult;
+
 enum class eImagePlace
 {
 	NONE,
@@ -44,16 +48,25 @@ private:
 	struct BitmapObject
 	{
 		HImage* m_image = nullptr;
-		int m_age = 0;
 		bool m_bHasAlpha = false;
 
 		BitmapObject() {}
-		BitmapObject(HImage* him, int age, bool hasAlpha) : m_image(him), m_age(age), m_bHasAlpha(hasAlpha) {}
+		BitmapObject(HImage* him, bool hasAlpha) : m_image(him), m_bHasAlpha(hasAlpha) {}
 
 		~BitmapObject() {
 		}
 	};
 
+public:
+	struct Stats
+	{
+		uint64_t m_hits = 0;
+		uint64_t m_misses = 0;
+		uint64_t m_evictions = 0;
+		size_t m_bitmaps = 0;
+		size_t m_bytes = 0; // decoded pixels held by loaded bitmaps
+	};
+
 protected:
 	friend class Frontend_Win32;
 
@@ -62,6 +75,8 @@ protected:
 	void SetImage(const std::string& resource, HImage* him, bool hasAlpha);
 
 public:
+	AvatarCache();
+
 	// Create a 32-character identifier based on the resource name.  If a 32 character
 	// GUID was provided, return it, otherwise perform the MD5 hash of the string.
 	std::string MakeIdentifier(const std::string& resource);
@@ -76,6 +91,12 @@ public:
 	// Let the avatar cache know that the resource was loaded.
 	void LoadedResource(const std::string& resource);
 
+	// Hand an image to the decoder pool.  The resource shows as loading until it's done.
+	void DecodeAsync(const std::string& resource, const uint8_t* pData, size_t size);
+
+	// Called on the main thread when the decoder pool has finished with an image.
+	void OnImageDecoded(ImageDecodeResult& result);
+
 	// Get the bitmap associated with the resource.  If it isn't loaded, request it, and return special bitmap handles.
 	HImage* GetImageSpecial(const std::string& resource, bool& hasAlphaOut);
 
@@ -92,14 +113,13 @@ public:
 	// else is holding a reference to it.
 	void EraseBitmap(const std::string& resource);
 
-	// Trim a single bitmap slot.  This makes room for another.
+	// Evict the least recently used bitmap.  This makes room for another.
 	bool TrimBitmap();
 
-	// Trim X bitmap slots.  This makes room for others.
+	// Evict the X least recently used bitmaps.  This makes room for others.
 	int  TrimBitmaps(int num = 1);
 
-	// Age all loaded bitmaps.  This is used to determine which ones are least frequent and ripe to purge.
-	void AgeBitmaps();
+	Stats GetStats() const;
 
 	// Clear the processing requests set.  These requests will never be fulfilled.
 	void ClearProcessingRequests();
@@ -108,10 +128,15 @@ private:
 	// Cache for MakeIdentifier.  MD5 hashes aren't too cheap.
 	std::unordered_map<std::string, std::string> m_resourceNameToID;
 
-	// The value has two items: the bitmap itself and an 'age'. From time to time,
-	// bitmaps are 'aged'; GetBitmap resets the age of the specific bitmap to zero.
+	// The loaded bitmaps and placeholders, by resource ID.
 	std::unordered_map<std::string, BitmapObject> m_profileToBitmap;
 
+	// Use order of the loaded bitmaps, and of the placeholders.  Each kind is
+	// evicted when it goes over its own budget.
+	LRUTracker m_lru;
+	LRUTracker m_placeholderLRU;
+	Stats m_stats;
+
 	// The place where the resource with the specified ID can be found.
 	std::unordered_map<std::string, ImagePlace> m_imagePlaces;
 
@@ -120,6 +145,18 @@ private:
 
 	// Delete the image if it isn't the default one.
 	static void DeleteImageIfNeeded(HImage* hbm);
+
+	// Whether this is an actual image, as opposed to a placeholder or the default one.
+	static bool IsRealImage(HImage* him);
+
+	// Forget the resource's bitmap or placeholder, and the pending load of it.
+	void Evict(const std::string& id);
+
+	// Evict bitmaps and placeholders until the cache is within its budget again.
+	void EnforceBudget();
+
+	// The size images in this place are decoded to.
+	static void GetDecodeSize(eImagePlace place, int& width, int& height);
 };
 
 AvatarCache* GetAvatarCache();
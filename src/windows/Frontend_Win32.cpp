@@ -9,6 +9,8 @@
 #include "ShellNotification.hpp"
 #include "utils/UpdateChecker.hpp"
 #include "config/LocalSettings.hpp"
+#include "network/GatewayEventQueue.hpp"
+#include "utils/MediaCache.hpp"
 
 void Frontend_Win32::OnLoginAgain()
 {
@@ -35,7 +37,7 @@ void Frontend_Win32::OnConnected()
 	SendMessage(g_Hwnd, WM_CONNECTED, 0, 0);
 }
 
-void Frontend_Win32::OnAddMessage(Snowflake channelID, const Message& msg)
+void Frontend_Win32::OnAddMessage(Snowflake channelID, const MessagePtr& msg)
 {
 	AddMessageParams parms;
 	parms.channel = channelID;
@@ -43,7 +45,7 @@ void Frontend_Win32::OnAddMessage(Snowflake channelID, const Message& msg)
 	SendMessage(g_Hwnd, WM_ADDMESSAGE, 0, (LPARAM)&parms);
 }
 
-void Frontend_Win32::OnUpdateMessage(Snowflake channelID, const Message& msg)
+void Frontend_Win32::OnUpdateMessage(Snowflake channelID, const MessagePtr& msg)
 {
 	AddMessageParams parms;
 	parms.channel = channelID;
@@ -207,40 +209,12 @@ void Frontend_Win32::OnStreamStateChange()
 
 void Frontend_Win32::OnAttachmentDownloaded(bool bIsProfilePicture, const uint8_t* pData, size_t nSize, const std::string& additData)
 {
-	int nImSize = bIsProfilePicture ? -1 : 0;
-	bool bHasAlpha = false;
-	HImage* himg = ImageLoader::ConvertToBitmap(pData, nSize, bHasAlpha, false, nImSize, nImSize);
-
-	if (himg)
-	{
-		if (himg->IsValid())
-		{
-			GetAvatarCache()->LoadedResource(additData);
-			GetAvatarCache()->SetImage(additData, himg, bHasAlpha);
-			OnUpdateAvatar(additData);
-			// note: stole the resource so that the HImage destructor doesn't delete it.
-		}
-		else
-		{
-			delete himg;
-		}
-	}
-	else
-	{
-		DbgPrintW("Failed to load convert image to bitmap! Unrecognized format?");
-	}
+	// The bitmap is set once the decoder pool is done with it, see AvatarCache::OnImageDecoded
+	GetAvatarCache()->DecodeAsync(additData, pData, nSize);
 
 	// store the cached data..
-	std::string final_path = GetCachePath() + "\\" + additData;
-	FILE* f = fopen(final_path.c_str(), "wb");
-	if (!f) {
-		DbgPrintW("ERROR: Could not open %s for writing", final_path.c_str());
-		// TODO: error message
-		return;
-	}
-
-	fwrite(pData, 1, nSize, f);
-	fclose(f);
+	if (!GetMediaCache()->Insert(additData, pData, nSize))
+		DbgPrintW("ERROR: Could not cache %s", additData.c_str());
 
 }
 
@@ -341,6 +315,21 @@ void Frontend_Win32::JumpToMessage(Snowflake messageInCurrentChannel)
 
 void Frontend_Win32::OnWebsocketMessage(int gatewayID, const std::string& payload)
 {
+	// Main gateway messages can be huge (READY, GUILD_MEMBER_LIST_UPDATE storms), so
+	// parse them on this thread and only wake the main window up to apply them.
+	DiscordInstance* pDiscord = GetDiscordInstance();
+	if (pDiscord && pDiscord->GetGatewayID() == gatewayID)
+	{
+		GatewayEvent ev;
+		if (!GatewayEvent::Digest(gatewayID, payload, ev))
+			return;
+
+		if (GetGatewayEventQueue()->Push(std::move(ev)))
+			PostMessage(g_Hwnd, WM_GATEWAYEVENTS, 0, 0);
+
+		return;
+	}
+
 	WebsocketMessageParams* pParm = new WebsocketMessageParams;
 	pParm->m_gatewayId = gatewayID;
 	pParm->m_payload = payload;
@@ -351,16 +340,25 @@ void Frontend_Win32::OnWebsocketMessage(int gatewayID, const std::string& payloa
 
 void Frontend_Win32::OnWebsocketClose(int gatewayID, int errorCode, const std::string& message)
 {
-	if (GetDiscordInstance()->GetGatewayID() == gatewayID)
-		GetDiscordInstance()->GatewayClosed(errorCode);
+	DiscordInstance* pDiscord = GetDiscordInstance();
+
+	// The session state belongs to the main thread, let it handle the close.  It goes
+	// through the event queue so that it comes after the messages still waiting there.
+	if (pDiscord && pDiscord->GetGatewayID() == gatewayID)
+	{
+		if (GetGatewayEventQueue()->Push(GatewayEvent::Closed(gatewayID, errorCode)))
+			PostMessage(g_Hwnd, WM_GATEWAYEVENTS, 0, 0);
+	}
 	else if (GetQRCodeDialog()->GetGatewayID() == gatewayID)
 		GetQRCodeDialog()->HandleGatewayClose(errorCode);
-	else if (GetDiscordInstance()->GetVoiceManager().GetVoiceConnectionID() == gatewayID)
-		GetDiscordInstance()->GetVoiceManager().OnWebSocketClose(gatewayID, errorCode, message);
-	else if (GetDiscordInstance()->GetStreamManager().GetStreamConnectionID() == gatewayID)
-		GetDiscordInstance()->GetStreamManager().OnWebSocketClose(gatewayID, errorCode, message);
-	else if (GetDiscordInstance()->GetStreamViewer().GetViewerConnectionID() == gatewayID)
-		GetDiscordInstance()->GetStreamViewer().OnWebSocketClose(gatewayID, errorCode, message);
+	else if (!pDiscord)
+		DbgPrintW("Connection %d closed with no instance: %d", gatewayID, errorCode);
+	else if (pDiscord->GetVoiceManager().GetVoiceConnectionID() == gatewayID)
+		pDiscord->GetVoiceManager().OnWebSocketClose(gatewayID, errorCode, message);
+	else if (pDiscord->GetStreamManager().GetStreamConnectionID() == gatewayID)
+		pDiscord->GetStreamManager().OnWebSocketClose(gatewayID, errorCode, message);
+	else if (pDiscord->GetStreamViewer().GetViewerConnectionID() == gatewayID)
+		pDiscord->GetStreamViewer().OnWebSocketClose(gatewayID, errorCode, message);
 	else
 		DbgPrintW("Unknown gateway connection %d closed: %d", gatewayID, errorCode);
 }
@@ -464,6 +462,11 @@ void Frontend_Win32::SetHeartbeatInterval(int timeMs)
 	::SetHeartbeatInterval(timeMs);
 }
 
+void Frontend_Win32::ReconnectGatewayIn(int timeMs)
+{
+	::TryConnectAgainIn(timeMs);
+}
+
 void Frontend_Win32::LaunchURL(const std::string& url)
 {
 	::LaunchURL(url);
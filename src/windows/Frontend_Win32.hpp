@@ -13,8 +13,8 @@ public:
 	void OnSessionClosed(int errorCode) override;
 	void OnConnecting() override;
 	void OnConnected() override;
-	void OnAddMessage(Snowflake channelID, const Message& msg) override;
-	void OnUpdateMessage(Snowflake channelID, const Message& msg) override;
+	void OnAddMessage(Snowflake channelID, const MessagePtr& msg) override;
+	void OnUpdateMessage(Snowflake channelID, const MessagePtr& msg) override;
 	void OnDeleteMessage(Snowflake messageInCurrentChannel) override;
 	void OnStartTyping(Snowflake userID, Snowflake guildID, Snowflake channelID, time_t startTime) override;
 	void OnRequestDone(NetRequest* pRequest) override;
@@ -55,6 +55,7 @@ public:
 	void OnWebsocketClose(int gatewayID, int errorCode, const std::string& message) override;
 	void OnWebsocketFail(int gatewayID, int errorCode, const std::string& message, bool isTLSError, bool mayRetry) override;
 	void SetHeartbeatInterval(int timeMs) override;
+	void ReconnectGatewayIn(int timeMs) override;
 	void LaunchURL(const std::string& url) override;
 	void RegisterIcon(Snowflake sf, const std::string& avatarlnk) override;
 	void RegisterAvatar(Snowflake sf, const std::string& avatarlnk) override;
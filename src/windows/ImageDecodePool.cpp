@@ -0,0 +1,150 @@
+#include "ImageDecodePool.hpp"
+#include "Main.hpp"
+
+static ImageDecodePool s_imageDecodePool;
+ImageDecodePool* GetImageDecodePool() {
+	return &s_imageDecodePool;
+}
+
+ImageDecodePool::~ImageDecodePool()
+{
+	Kill();
+}
+
+void ImageDecodePool::Init()
+{
+	if (m_nThreads)
+		return;
+
+	// Leave a core for the UI and the networker threads
+	SYSTEM_INFO si{};
+	GetSystemInfo(&si);
+	int nThreads = int(si.dwNumberOfProcessors) - 1;
+	if (nThreads > C_MAX_DECODE_THREADS)
+		nThreads = C_MAX_DECODE_THREADS;
+	if (nThreads < 1)
+		nThreads = 1;
+
+	m_bQuitting = false;
+	m_hSemaphore = CreateSemaphore(NULL, 0, MAXLONG, NULL);
+	assert(m_hSemaphore);
+
+	for (int i = 0; i < nThreads; i++)
+	{
+		DWORD threadId = 0;
+		HANDLE hThread = CreateThread(NULL, 0, ThreadProc, this, 0, &threadId);
+		if (!hThread) {
+			DbgPrintW("Could not start image decoder thread: %d", GetLastError());
+			continue;
+		}
+
+		m_threads[m_nThreads++] = hThread;
+	}
+}
+
+void ImageDecodePool::Kill()
+{
+	if (!m_hSemaphore)
+		return;
+
+	m_jobLock.lock();
+	m_bQuitting = true;
+	m_jobs.clear();
+	m_jobLock.unlock();
+
+	ReleaseSemaphore(m_hSemaphore, m_nThreads, NULL);
+	if (m_nThreads)
+		WaitForMultipleObjects(m_nThreads, m_threads, TRUE, INFINITE);
+
+	for (int i = 0; i < m_nThreads; i++)
+		CloseHandle(m_threads[i]);
+
+	m_nThreads = 0;
+	CloseHandle(m_hSemaphore);
+	m_hSemaphore = NULL;
+
+	m_resultLock.lock();
+	m_results.clear();
+	m_resultLock.unlock();
+}
+
+void ImageDecodePool::Submit(ImageDecodeJob&& job)
+{
+	m_jobLock.lock();
+	m_jobs.push_back(std::move(job));
+	m_jobLock.unlock();
+
+	ReleaseSemaphore(m_hSemaphore, 1, NULL);
+}
+
+bool ImageDecodePool::PopJob(ImageDecodeJob& job)
+{
+	m_jobLock.lock();
+	if (m_jobs.empty())
+	{
+		m_jobLock.unlock();
+		return false;
+	}
+
+	job = std::move(m_jobs.front());
+	m_jobs.pop_front();
+	m_jobLock.unlock();
+	return true;
+}
+
+bool ImageDecodePool::PopResult(ImageDecodeResult& result)
+{
+	m_resultLock.lock();
+	if (m_results.empty())
+	{
+		m_resultLock.unlock();
+		return false;
+	}
+
+	result = std::move(m_results.front());
+	m_results.pop_front();
+	m_resultLock.unlock();
+	return true;
+}
+
+DWORD WINAPI ImageDecodePool::ThreadProc(LPVOID that)
+{
+	((ImageDecodePool*)that)->Run();
+	return 0;
+}
+
+void ImageDecodePool::Run()
+{
+	while (true)
+	{
+		WaitForSingleObject(m_hSemaphore, INFINITE);
+		if (m_bQuitting)
+			break;
+
+		ImageDecodeJob job;
+		if (!PopJob(job))
+			continue;
+
+		ImageDecodeResult result;
+		result.m_id = job.m_id;
+		result.m_bFromCache = job.m_bFromCache;
+
+		const uint8_t* pData = job.m_file.IsValid() ? job.m_file.Data() : job.m_data.data();
+		size_t size = job.m_file.IsValid() ? job.m_file.Size() : job.m_data.size();
+
+		if (!ImageDecoder::Decode(pData, size, result.m_image, job.m_width, job.m_height))
+			DbgPrintW("Image %s could not be decoded!", job.m_id.c_str());
+
+		// Let go of the mapping before the main thread gets a chance to evict it
+		job.m_file.Close();
+
+		m_resultLock.lock();
+		bool wasEmpty = m_results.empty();
+		m_results.push_back(std::move(result));
+		m_resultLock.unlock();
+
+		// If there were results queued already, the main window has been told about them
+		if (wasEmpty)
+			PostMessage(g_Hwnd, WM_IMAGESDECODED, 0, 0);
+	}
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#include <string>
+#include <vector>
+#include <deque>
+
+#ifdef MINGW_SPECIFIC_HACKS
+#include <iprog/mutex.hpp>
+#else
+#include <mutex>
+#endif
+
+#include "utils/ImageDecoder.hpp"
+#include "utils/FileUtil.hpp"
+
+#define C_MAX_DECODE_THREADS (4)
+
+struct ImageDecodeJob
+{
+	std::string m_id;
+	MappedFile m_file;           // contents from the media cache, or...
+	std::vector<uint8_t> m_data; // ...contents that were just downloaded
+	int m_width = 0;             // 0 = keep the original size
+	int m_height = 0;
+	bool m_bFromCache = false;
+};
+
+struct ImageDecodeResult
+{
+	std::string m_id;
+	DecodedImage m_image;        // invalid if the image could not be decoded
+	bool m_bFromCache = false;
+};
+
+// Decodes and resizes images on a few background threads, so that scrolling
+// through a channel full of avatars and attachments doesn't stall the UI.
+// Finished images are queued up and the main window is notified with
+// WM_IMAGESDECODED.  Turning them into bitmaps is left to the main thread.
+class ImageDecodePool
+{
+public:
+#ifdef MINGW_SPECIFIC_HACKS
+	using nmutex = iprog::mutex;
+#else
+	using nmutex = std::mutex;
+#endif
+
+	~ImageDecodePool();
+
+	void Init();
+
+	// Stops the threads.  Jobs that haven't been picked up are dropped.
+	void Kill();
+
+	void Submit(ImageDecodeJob&& job);
+
+	// Takes a finished image off the queue.  Returns false if there are none.
+	bool PopResult(ImageDecodeResult& result);
+
+private:
+	static DWORD WINAPI ThreadProc(LPVOID that);
+	void Run();
+
+	bool PopJob(ImageDecodeJob& job);
+
+	nmutex m_jobLock;
+	std::deque<ImageDecodeJob> m_jobs;
+	HANDLE m_hSemaphore = NULL;
+
+	nmutex m_resultLock;
+	std::deque<ImageDecodeResult> m_results;
+
+	HANDLE m_threads[C_MAX_DECODE_THREADS];
+	int m_nThreads = 0;
+	volatile bool m_bQuitting = false;
+};
+
+ImageDecodePool* GetImageDecodePool();
@@ -3,6 +3,7 @@
 #include <windows.h>
 #include <cstdint>
 #include <vector>
+#include "utils/ImageDecoder.hpp"
 
 struct HImageFrame
 {
@@ -51,6 +52,9 @@ public:
 	// loadAllFrames - If false, loads only the first frame.
 	static HImage* ConvertToBitmap(const uint8_t* pData, size_t size, bool& outHasAlphaChannel, bool loadAllFrames = true, int width = 0, int height = 0);
 
+	// Same, for an image that was already decoded and resized by ImageDecoder.
+	static HImage* ConvertToBitmap(const DecodedImage& image, bool& outHasAlphaChannel, bool loadAllFrames = true);
+
 	static HBITMAP LoadFromFile(const char* pFileName, bool& outHasAlphaChannel);
 
 	static bool ConvertToPNG(std::vector<uint8_t>* outData, void* pBits, int width, int height, int widthBytes, int bpp, bool forceOpaque, bool flipVerticallyWhenSaving);
@@ -32,7 +32,11 @@
 #include "MemberListOld.hpp"
 #include "config/LocalSettings.hpp"
 #include "network/WebsocketClient.hpp"
+#include "network/GatewayEventQueue.hpp"
 #include "utils/UpdateChecker.hpp"
+#include "utils/MediaCache.hpp"
+#include "state/MessageStore.hpp"
+#include "ImageDecodePool.hpp"
 
 #include <system_error>
 #include <shellapi.h>
@@ -66,6 +70,9 @@ bool g_bBlockDoubleBufferingForThisInstance = false;
 
 constexpr int MIN_MEMORY_TO_BLOCK_DOUBLE_BUFFERING = 128 * 1024 * 1024;
 
+// How long WM_GATEWAYEVENTS may spend applying gateway events before letting other messages in.
+constexpr uint64_t GATEWAY_EVENTS_TIME_BUDGET = 30;
+
 bool ShouldBlockDoubleBuffering()
 {
 	return true;
@@ -793,18 +800,10 @@ void AddOrRemoveAppFromStartup()
 	}
 }
 
-int g_agerCounter = 0;
-
 LRESULT CALLBACK WindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 {
 	KeepOverridingTheFilter();
 
-	g_agerCounter++;
-	if (g_agerCounter >= 50) {
-		g_agerCounter = 0;
-		GetAvatarCache()->AgeBitmaps();
-	}
-
 	switch (uMsg)
 	{
 		case WM_UPDATEEMOJI:
@@ -1106,8 +1105,8 @@ LRESULT CALLBACK WindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 
 			if (g_pMessageList->GetCurrentChannel() == pParms->channel)
 			{
-				g_pMessageList->AddMessage(pParms->msg.m_snowflake, GetForegroundWindow() == hWnd);
-				OnStopTyping(pParms->channel, pParms->msg.m_author_snowflake);
+				g_pMessageList->AddMessage(pParms->msg->m_snowflake, GetForegroundWindow() == hWnd);
+				OnStopTyping(pParms->channel, pParms->msg->m_author_snowflake);
 			}
 
 			Channel* pChan = GetDiscordInstance()->GetChannel(pParms->channel);
@@ -1128,7 +1127,7 @@ LRESULT CALLBACK WindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 			GetMessageCache()->EditMessage(pParms->channel, pParms->msg);
 
 			if (g_pMessageList->GetCurrentChannel() == pParms->channel)
-				g_pMessageList->EditMessage(pParms->msg.m_snowflake);
+				g_pMessageList->EditMessage(pParms->msg->m_snowflake);
 
 			break;
 		}
@@ -1165,6 +1164,34 @@ LRESULT CALLBACK WindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 			delete pParm;
 			break;
 		}
+		case WM_GATEWAYEVENTS:
+		{
+			// Apply the events that the websocket thread already parsed.  Don't hog the
+			// window if a lot of them piled up, come back for the rest after painting.
+			uint64_t startTime = GetTimeMs();
+
+			GatewayEvent ev;
+			while (GetGatewayEventQueue()->Pop(ev))
+			{
+				// Events from an old connection are stale.  That includes its close, if a
+				// new connection was started in the meantime.
+				if (GetDiscordInstance()->GetGatewayID() == ev.m_gatewayId)
+					GetDiscordInstance()->HandleGatewayEvent(ev);
+
+				if (GetTimeMs() - startTime >= GATEWAY_EVENTS_TIME_BUDGET) {
+					PostMessage(hWnd, WM_GATEWAYEVENTS, 0, 0);
+					break;
+				}
+			}
+			break;
+		}
+		case WM_IMAGESDECODED:
+		{
+			ImageDecodeResult result;
+			while (GetImageDecodePool()->PopResult(result))
+				GetAvatarCache()->OnImageDecoded(result);
+			break;
+		}
 		case WM_REFRESHMEMBERS:
 		{
 			auto* memsToUpdate = (std::set<Snowflake>*)lParam;
@@ -1584,8 +1611,6 @@ LRESULT CALLBACK WindowProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 			m->m_message = psmap->m_message;
 			m->m_type = MessageType::SENDING_MESSAGE;
 			m->SetTime(time(NULL));
-			m->m_dateFull = "Sending...";
-			m->m_dateCompact = "Sending...";
 			g_pMessageList->AddMessage(m, true);
 			return 0;
 		}
@@ -2081,6 +2106,18 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR pCmdLin
 
 	SetUserScale(GetLocalSettings()->GetUserScale());
 
+	int mediaCacheSizeMB = pSettings->GetMediaCacheSizeMB();
+	if (mediaCacheSizeMB < 1)
+		mediaCacheSizeMB = 1;
+	GetMediaCache()->Init(GetCachePath(), uint64_t(mediaCacheSizeMB) * 1024 * 1024);
+	GetImageDecodePool()->Init();
+	GetMessageStore()->Init(GetCachePath());
+
+	int messageCacheSizeMB = pSettings->GetMessageCacheSizeMB();
+	if (messageCacheSizeMB < 1)
+		messageCacheSizeMB = 1;
+	GetMessageCache()->SetBudget(size_t(messageCacheSizeMB) * 1024 * 1024);
+
 	int wndWidth = 0, wndHeight = 0;
 	bool startMaximized = false;
 	GetLocalSettings()->GetWindowSize(wndWidth, wndHeight);
@@ -2232,11 +2269,14 @@ int APIENTRY WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR pCmdLin
 		TextToSpeech::Deinitialize();
 	}
 
+	GetImageDecodePool()->Kill();
 	g_Hwnd = NULL;
 	UnregisterClass(wc.lpszClassName, hInstance);
 	GetLocalSettings()->Save();
 	GetWebsocketClient()->Kill();
 	GetHTTPClient()->Kill();
+	GetMediaCache()->Flush();
+	GetMessageStore()->Flush();
 	delete g_pFrontEnd;
 	delete g_pHTTPClient;
 	return (int)msg.wParam;
@@ -153,6 +153,7 @@ void OnUpdateAvatar(const std::string& resid);
 DiscordInstance* GetDiscordInstance();
 void WantQuit();
 void SetHeartbeatInterval(int timeMs);
+void TryConnectAgainIn(int time);
 int GetProfilePictureSize();
 HBITMAP GetDefaultBitmap();
 bool ShouldBlockDoubleBuffering();
@@ -504,7 +504,6 @@ void MessageItem::Update(Snowflake guildID)
 	bool isAction = MessageList::IsActionMessage(m_msg->m_type);
 
 	Clear();
-	m_msg->UpdateTimestamp();
 
 	m_bIsBlockedMessage = GetDiscordInstance()->IsUserBlocked(m_msg->m_author_snowflake);
 	std::string blockedSuffix = m_bIsBlockedMessage ? " [blocked]" : "";
@@ -514,8 +513,8 @@ void MessageItem::Update(Snowflake guildID)
 
 	m_bNeedUpdate = false;
 	m_author = ConvertCppStringToTString(m_msg->m_author + blockedSuffix);
-	m_date = ConvertCppStringToTString(isCompact ? m_msg->m_dateCompact : m_msg->m_dateFull);
-	m_dateEdited = ConvertCppStringToTString(isCompact ? m_msg->m_editedTextCompact : m_msg->m_editedText);
+	m_date = ConvertCppStringToTString(isCompact ? m_msg->GetDateCompact() : m_msg->GetDateFull());
+	m_dateEdited = ConvertCppStringToTString(isCompact ? m_msg->GetEditedTextCompact() : m_msg->GetEditedText());
 
 	if (m_msg->m_pReferencedMessage)
 	{
@@ -1690,7 +1689,7 @@ void MessageList::DetermineMessageData(
 	Snowflake refMsgGuildID,          /* IN */
 	Snowflake refMsgChannelID,        /* IN */
 	Snowflake refMsgMessageID,        /* IN */
-	const std::set<Snowflake>& ments, /* IN */
+	const SnowflakeSet& ments, /* IN */
 	const std::string& content,	      /* IN */
 	LPCTSTR& messagePart1,		      /* OUT */
 	LPCTSTR& messagePart2,		      /* OUT */
@@ -2258,7 +2257,7 @@ void MessageList::DrawMessage(HDC hdc, MessageItem& item, RECT& msgRect, RECT& c
 		rc.top += DATE_GAP_HEIGHT;
 		msgRect.top += DATE_GAP_HEIGHT;
 
-		LPTSTR strDateGap = ConvertCppStringToTString("  " + item.m_msg->m_dateOnly + "  ");
+		LPTSTR strDateGap = ConvertCppStringToTString("  " + item.m_msg->GetDateOnly() + "  ");
 
 		COLORREF clrText = InvertIfNeeded(bDrawNewMarker ? NEW_MARKER_COLOR : GetSysColor(COLOR_GRAYTEXT));
 		COLORREF oldTextClr = SetTextColor(hdc, clrText);
@@ -3250,6 +3249,10 @@ void MessageList::Paint(HDC hdc, RECT& paintRect)
 		SelectObject(hdc, gdiObj);
 	}
 
+	// Let the cache know where we are, it trims away from here when we're gone
+	if (m_firstShownMessage)
+		GetMessageCache()->SetViewAnchor(m_channelID, m_firstShownMessage);
+
 	Channel* pChan = GetDiscordInstance()->GetChannel(m_channelID);
 
 	if (pChan &&
@@ -3372,7 +3375,7 @@ void MessageList::HandleRightClickMenuCommandMessage(int command, MessageItem* p
 		case ID_DUMMYPOPUP_DELETEMESSAGE:
 		{
 			static char buffer[8192];
-			snprintf(buffer, sizeof buffer, TmGetString(IDS_CONFIRM_DELETE).c_str(), pMsg->m_msg->m_author.c_str(), pMsg->m_msg->m_dateFull.c_str(), pMsg->m_msg->m_message.c_str());
+			snprintf(buffer, sizeof buffer, TmGetString(IDS_CONFIRM_DELETE).c_str(), pMsg->m_msg->m_author.c_str(), pMsg->m_msg->GetDateFull().c_str(), pMsg->m_msg->m_message.c_str());
 			LPCTSTR xstr = ConvertCppStringToTString(buffer);
 			if (MessageBox(g_Hwnd, xstr, TmGetTString(IDS_CONFIRM_DELETE_TITLE), MB_YESNO | MB_ICONQUESTION) == IDYES)
 			{
@@ -3410,7 +3413,7 @@ void MessageList::HandleRightClickMenuCommandMessage(int command, MessageItem* p
 				break;
 
 			static char buffer[8192];
-			snprintf(buffer, sizeof buffer, TmGetString(IDS_CONFIRM_PIN).c_str(), pChan->m_name.c_str(), pMsg->m_msg->m_author.c_str(), pMsg->m_msg->m_dateFull.c_str(), pMsg->m_msg->m_message.c_str());
+			snprintf(buffer, sizeof buffer, TmGetString(IDS_CONFIRM_PIN).c_str(), pChan->m_name.c_str(), pMsg->m_msg->m_author.c_str(), pMsg->m_msg->GetDateFull().c_str(), pMsg->m_msg->m_message.c_str());
 
 			LPCTSTR xstr = ConvertCppStringToTString(buffer);
 
@@ -3435,7 +3438,7 @@ void MessageList::HandleRightClickMenuCommandMessage(int command, MessageItem* p
 				break;
 
 			static char buffer[8192];
-			snprintf(buffer, sizeof buffer, TmGetString(IDS_CONFIRM_UNPIN).c_str(), pMsg->m_msg->m_author.c_str(), pMsg->m_msg->m_dateFull.c_str(), pMsg->m_msg->m_message.c_str());
+			snprintf(buffer, sizeof buffer, TmGetString(IDS_CONFIRM_UNPIN).c_str(), pMsg->m_msg->m_author.c_str(), pMsg->m_msg->GetDateFull().c_str(), pMsg->m_msg->m_message.c_str());
 
 			LPCTSTR xstr = ConvertCppStringToTString(buffer);
 
@@ -4950,7 +4953,6 @@ void MessageList::OnFailedToSendMessage(Snowflake sf)
 			continue;
 
 		msg.m_msg->m_type = MessageType::UNSENT_MESSAGE;
-		msg.m_msg->SetTime(msg.m_msg->m_dateTime);
 		msg.m_date = NULL;
 		msg.Update(m_guildID);
 
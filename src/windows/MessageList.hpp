@@ -594,7 +594,7 @@ private:
 		Snowflake refMsgGuildID,          /* IN */
 		Snowflake refMsgChannelID,        /* IN */
 		Snowflake refMsgMessageID,        /* IN */
-		const std::set<Snowflake>& ments, /* IN */
+		const SnowflakeSet& ments, /* IN */
 		const std::string& content,	      /* IN */
 		LPCTSTR& messagePart1,		      /* OUT */
 		LPCTSTR& messagePart2,		      /* OUT */
@@ -15,8 +15,20 @@
 #define CPPHTTPLIB_NO_EXCEPTIONS
 #include <httplib/httplib.h>
 
+#include <map>
+#include <memory>
+#include <vector>
+
 constexpr size_t REPORT_PROGRESS_EVERY_BYTES = 15360; // arbitrary
 
+// How long an idle connection is kept around before being closed.
+constexpr DWORD CLIENT_IDLE_TIMEOUT_MS = 60000;
+// At most one idle connection per networker thread and host.
+constexpr size_t MAX_IDLE_CLIENTS_PER_HOST = C_AMT_NETWORKER_THREADS;
+
+// Give up on a request that keeps being rate limited after this many retries.
+constexpr int MAX_RATE_LIMIT_RETRIES = 5;
+
 void LoadSystemCertsOnWindows(SSL_CTX* ctx)
 {
 	X509_STORE* store = X509_STORE_new();
@@ -36,6 +48,24 @@ bool AddExtraHeaders()
 	return GetLocalSettings()->AddExtraHeaders();
 }
 
+static RateLimitHeaders GetRateLimitHeaders(const httplib::Response& res)
+{
+	RateLimitHeaders headers;
+	headers.m_bucket = res.get_header_value("X-RateLimit-Bucket");
+
+	if (res.has_header("X-RateLimit-Limit"))
+		headers.m_limit = atoi(res.get_header_value("X-RateLimit-Limit").c_str());
+	if (res.has_header("X-RateLimit-Remaining"))
+		headers.m_remaining = atoi(res.get_header_value("X-RateLimit-Remaining").c_str());
+	if (res.has_header("X-RateLimit-Reset-After"))
+		headers.m_resetAfter = atof(res.get_header_value("X-RateLimit-Reset-After").c_str());
+	if (res.has_header("Retry-After"))
+		headers.m_retryAfter = atof(res.get_header_value("Retry-After").c_str());
+
+	headers.m_global = res.get_header_value("X-RateLimit-Global") == "true";
+	return headers;
+}
+
 int NetRequest::Priority() const
 {
 	int prio = 0;
@@ -111,7 +141,7 @@ bool NetworkerThread::ProcessResult(NetRequest& req, const httplib::Result& res)
 		else if (isSSLError && (result == IDCONTINUE || result == IDIGNORE))
 		{
 			GetLocalSettings()->SetEnableTLSVerification(false);
-			PrepareQuit();
+			m_pManager->PrepareQuit();
 
 			g_bQuittingFromSSLError = true;
 			SendMessage(g_Hwnd, WM_FORCERESTART, 0, 0);
@@ -132,13 +162,27 @@ bool NetworkerThread::ProcessResult(NetRequest& req, const httplib::Result& res)
 	}
 	else
 	{
+		RateLimiter& limiter = m_pManager->GetRateLimiter();
+		uint64_t retryAt = limiter.OnResponse(RateLimiter::GetRoute(req), res->status, GetRateLimitHeaders(res.value()), GetTimeMs());
+
 		req.result = res->status;
 		req.response = res->body;
+
+		if (res->status == HTTP_TOOMANYREQS && req.m_rateLimitRetries < MAX_RATE_LIMIT_RETRIES)
+		{
+			// Try again once the limit has passed.  The handler doesn't hear about this.
+			NetRequest retry = req;
+			retry.result = 0;
+			retry.response.clear();
+			retry.m_rateLimitRetries++;
+			m_pManager->DeferRequest(retry, m_pCurrentQueue, retryAt);
+			return false;
+		}
 	}
 
-	// Call the handler function.
+	// Call the handler function, and those of the requests coalesced into this one.
 	// N.B.  Don't return unless you're absolutely done with the request!
-	req.pFunc(&req);
+	m_pManager->FinishRequest(req);
 
 	// Return false to let the runner know that it shouldn't retry.
 	return false;
@@ -150,10 +194,113 @@ std::string NetworkerThreadManager::ErrorMessage(int code) const
 	return std::string(httplib::detail::status_message(code));
 }
 
-void NetworkerThread::IdleWait()
+// Keep-alive clients shared by all networker threads, keyed by scheme + host.
+// A client is owned by one thread while it's servicing a request, and goes back
+// to the pool afterwards so that the next request to the same host skips the
+// TCP and TLS handshakes.  When the server has closed the connection in the
+// meantime, httplib reconnects and resumes the TLS session it remembered.
+class ClientPool
 {
-	Sleep(100);
-}
+public:
+	typedef std::unique_ptr<httplib::Client> ClientPtr;
+
+	ClientPtr Acquire(const std::string& hostName)
+	{
+		ClientPtr client;
+
+		m_lock.lock();
+		EvictIdle();
+
+		auto iter = m_idle.find(hostName);
+		if (iter != m_idle.end() && !iter->second.empty())
+		{
+			// Most recently used first, it's the least likely to have been closed
+			client = std::move(iter->second.back().client);
+			iter->second.pop_back();
+		}
+		m_lock.unlock();
+
+		if (!client)
+		{
+			client.reset(new httplib::Client(hostName));
+			client->set_keep_alive(true);
+
+			// Follow redirects.  Used by GitHub auto-update service
+			client->set_follow_location(true);
+		}
+
+		// on Windows XP, enabling this doesn't actually work for some reason.
+		// Probably outdated certs. I mean, this would allow attackers to host
+		// a self-instance of Discord to intercept packets, but this is fine
+		// for now.....
+		client->enable_server_certificate_verification(GetLocalSettings()->EnableTLSVerification());
+
+		return client;
+	}
+
+	void Release(const std::string& hostName, ClientPtr client)
+	{
+		m_lock.lock();
+
+		std::vector<IdleClient>& clients = m_idle[hostName];
+		if (clients.size() < MAX_IDLE_CLIENTS_PER_HOST)
+		{
+			IdleClient idle;
+			idle.client = std::move(client);
+			idle.lastUsed = GetTickCount();
+			clients.push_back(std::move(idle));
+		}
+
+		m_lock.unlock();
+
+		// If the pool was full, the client is destroyed here, outside the lock.
+	}
+
+	void Clear()
+	{
+		std::map<std::string, std::vector<IdleClient> > idle;
+
+		m_lock.lock();
+		idle.swap(m_idle);
+		m_lock.unlock();
+	}
+
+private:
+	struct IdleClient
+	{
+		ClientPtr client;
+		DWORD lastUsed = 0;
+	};
+
+	// Called with m_lock held.
+	void EvictIdle()
+	{
+		DWORD now = GetTickCount();
+
+		for (auto iter = m_idle.begin(); iter != m_idle.end(); )
+		{
+			std::vector<IdleClient>& clients = iter->second;
+
+			// Sorted by last use, oldest first
+			size_t stale = 0;
+			while (stale < clients.size() && now - clients[stale].lastUsed > CLIENT_IDLE_TIMEOUT_MS)
+				stale++;
+
+			if (stale)
+				clients.erase(clients.begin(), clients.begin() + stale);
+
+			if (clients.empty())
+				iter = m_idle.erase(iter);
+			else
+				++iter;
+		}
+	}
+
+	NetworkerThread::nmutex m_lock;
+	std::map<std::string, std::vector<IdleClient> > m_idle;
+};
+
+static ClientPool g_clientPool;
 
 // Custom Content Provider to track progress
 class ProgressContentProvider {
@@ -184,8 +331,21 @@ private:
 	ProgressFunction progfunc;
 };
 
+bool NetworkerThread::DeferIfRateLimited(NetRequest& req)
+{
+	uint64_t readyAt = m_pManager->GetRateLimiter().Acquire(RateLimiter::GetRoute(req), !req.authorization.empty(), GetTimeMs());
+	if (!readyAt)
+		return false;
+
+	m_pManager->DeferRequest(req, m_pCurrentQueue, readyAt);
+	return true;
+}
+
 void NetworkerThread::FulfillRequest(NetRequest& req)
 {
+	if (DeferIfRateLimited(req))
+		return;
+
 	std::string& url = req.url;
 	DbgPrintF("Accessing URL: %s", url.c_str());
 
@@ -204,16 +364,8 @@ void NetworkerThread::FulfillRequest(NetRequest& req)
 	}
 
 	using namespace httplib;
-	Client client(hostName);
-
-	// on Windows XP, enabling this doesn't actually work for some reason.
-	// Probably outdated certs. I mean, this would allow attackers to host
-	// a self-instance of Discord to intercept packets, but this is fine
-	// for now.....
-	client.enable_server_certificate_verification(GetLocalSettings()->EnableTLSVerification());
-
-	// Follow redirects.  Used by GitHub auto-update service
-	client.set_follow_location(true);
+	ClientPool::ClientPtr pClient = g_clientPool.Acquire(hostName);
+	Client& client = *pClient;
 
 	Headers headers;
 	headers.insert(std::make_pair("User-Agent", GetClientConfig()->GetUserAgent()));
@@ -313,25 +465,58 @@ void NetworkerThread::FulfillRequest(NetRequest& req)
 		}
 	}
 	while (retry);
+
+	// Only hand the connection to the next request if this one went through
+	// normally.  After an error or a cancelled transfer its state is unknown.
+	if (req.result > 0 && req.result < HTTP_CANCELED)
+		g_clientPool.Release(hostName, std::move(pClient));
 }
 
-void NetworkerThread::Run()
+NetRequest NetworkerThread::WaitForRequest()
 {
+	HANDLE handles[2];
+	DWORD nhandles = 0;
+
+	handles[nhandles++] = m_pQueue->GetSemaphore();
+	if (m_pStealQueue)
+		handles[nhandles++] = m_pStealQueue->GetSemaphore();
+
+	NetRequest request;
 	while (true)
 	{
-		// lock the mutex
-		m_requestLock.lock();
-		if (m_requests.empty())
-		{
-			m_requestLock.unlock();
-			IdleWait();
+		// Also wake up when a rate limited request may go again.
+		DWORD timeout = m_pManager->ReleaseDeferredRequests();
+
+		// If both are signalled, this returns the first one, so our own queue wins.
+		DWORD result = WaitForMultipleObjects(nhandles, handles, FALSE, timeout);
+		if (result == WAIT_TIMEOUT)
 			continue;
+
+		NetRequestQueue* pFirst = m_pQueue;
+		NetRequestQueue* pSecond = m_pStealQueue;
+		if (result == WAIT_OBJECT_0 + 1)
+			std::swap(pFirst, pSecond);
+		else if (result != WAIT_OBJECT_0)
+			assert(!"WaitForMultipleObjects failed");
+
+		// The request we were woken for may be gone already, take whatever there is.
+		if (pFirst->Pop(request)) {
+			m_pCurrentQueue = pFirst;
+			return request;
+		}
+		if (pSecond && pSecond->Pop(request)) {
+			m_pCurrentQueue = pSecond;
+			return request;
 		}
+	}
+}
 
+void NetworkerThread::Run()
+{
+	while (true)
+	{
+		NetRequest request = WaitForRequest();
 		DbgPrintW("Thread %u processing request", m_ThreadID);
-		NetRequest request = std::move(m_requests.top());
-		m_requests.pop();
-		m_requestLock.unlock();
 
 		// Service the request.
 		if (request.type == NetRequest::QUIT)
@@ -351,44 +536,48 @@ DWORD WINAPI NetworkerThread::Init(LPVOID that)
 	return 0;
 }
 
-void NetworkerThread::AddRequest(
-	NetRequest::eType type,
-	const std::string& url,
-	int itype,
-	uint64_t requestKey,
-	std::string params,
-	std::string authorization,
-	std::string additional_data,
-	NetRequest::NetworkResponseFunc pRespFunc,
-	uint8_t* stream_bytes,
-	size_t stream_size)
+NetRequestQueue::NetRequestQueue()
 {
-	NetRequest rq(0, itype, requestKey, type, url, "", params, authorization, additional_data, pRespFunc, stream_bytes, stream_size);
+	m_hSemaphore = CreateSemaphore(NULL, 0, MAXLONG, NULL);
+	assert(m_hSemaphore);
+}
 
-	m_requestLock.lock();
-	m_requests.push(rq);
-	m_requestLock.unlock();
+NetRequestQueue::~NetRequestQueue()
+{
+	CloseHandle(m_hSemaphore);
 }
 
-void NetworkerThread::StopAllRequests()
+void NetRequestQueue::Push(const NetRequest& request)
 {
-	m_requestLock.lock();
-	while (!m_requests.empty())
-		m_requests.pop();
-	m_requestLock.unlock();
+	m_lock.lock();
+	m_requests.push(request);
+	m_lock.unlock();
+
+	ReleaseSemaphore(m_hSemaphore, 1, NULL);
 }
 
-void NetworkerThread::PrepareQuit()
+bool NetRequestQueue::Pop(NetRequest& request)
 {
-	m_requestLock.lock();
+	m_lock.lock();
+	if (m_requests.empty())
+	{
+		m_lock.unlock();
+		return false;
+	}
+
+	request = m_requests.top();
+	m_requests.pop();
+	m_lock.unlock();
+	return true;
+}
 
+void NetRequestQueue::Clear()
+{
+	// Leaves the semaphore count alone.  The extra wake-ups find nothing and are harmless.
+	m_lock.lock();
 	while (!m_requests.empty())
 		m_requests.pop();
-
-	for (int i = 0; i < C_AMT_NETWORKER_THREADS; i++)
-		m_requests.push(NetRequest(0, 0, 0, NetRequest::QUIT));
-
-	m_requestLock.unlock();
+	m_lock.unlock();
 }
 
 bool NetworkerThread::ProgressFunction(NetRequest* pRequest, uint64_t offset, uint64_t length)
@@ -406,7 +595,10 @@ bool NetworkerThread::ProgressFunction(NetRequest* pRequest, uint64_t offset, ui
 	return !pRequest->m_bCancelOp;
 }
 
-NetworkerThread::NetworkerThread()
+NetworkerThread::NetworkerThread(NetworkerThreadManager* pManager, NetRequestQueue* pQueue, NetRequestQueue* pStealQueue) :
+	m_pManager(pManager),
+	m_pQueue(pQueue),
+	m_pStealQueue(pStealQueue)
 {
 	m_ThreadHandle = CreateThread(
 		NULL,
@@ -430,10 +622,9 @@ NetworkerThread::NetworkerThread()
 
 NetworkerThread::~NetworkerThread()
 {
-	PrepareQuit();
-
-	// wait for the thread to go away
-	WaitForSingleObject(m_ThreadHandle, INFINITE);
+	// The manager has told the thread to quit already, wait for it to go away
+	if (m_ThreadHandle)
+		WaitForSingleObject(m_ThreadHandle, INFINITE);
 }
 
 NetworkerThreadManager::~NetworkerThreadManager()
@@ -445,24 +636,68 @@ NetworkerThreadManager::~NetworkerThreadManager()
 void NetworkerThreadManager::Init()
 {
 	m_bKilled = false;
-	for (int i = 0; i < C_AMT_NETWORKER_THREADS; i++)
-		m_pNetworkThreads[i] = new NetworkerThread();
+	for (int i = 0; i < C_INTERACTIVE_NETWORKER_THREADS; i++)
+		m_pNetworkThreads[i] = new NetworkerThread(this, &m_interactiveQueue, nullptr);
+	for (int i = C_INTERACTIVE_NETWORKER_THREADS; i < C_AMT_NETWORKER_THREADS; i++)
+		m_pNetworkThreads[i] = new NetworkerThread(this, &m_backgroundQueue, &m_interactiveQueue);
 }
 
 void NetworkerThreadManager::StopAllRequests()
 {
-	for (int i = 0; i < C_AMT_NETWORKER_THREADS; i++) {
-		if (m_pNetworkThreads[i])
-			m_pNetworkThreads[i]->StopAllRequests();
-	}
+	m_interactiveQueue.Clear();
+	m_backgroundQueue.Clear();
+
+	m_deferredLock.lock();
+	m_deferred.clear();
+	m_deferredLock.unlock();
+
+	ClearInFlightRequests();
+}
+
+void NetworkerThreadManager::DeferRequest(const NetRequest& request, NetRequestQueue* pQueue, uint64_t readyAt)
+{
+	DeferredRequest deferred;
+	deferred.m_request = request;
+	deferred.m_pQueue = pQueue;
+
+	m_deferredLock.lock();
+	m_deferred.insert(std::make_pair(readyAt, deferred));
+	m_deferredLock.unlock();
+}
+
+DWORD NetworkerThreadManager::ReleaseDeferredRequests()
+{
+	std::vector<DeferredRequest> ready;
+	DWORD timeout = INFINITE;
+	uint64_t now = GetTimeMs();
+
+	m_deferredLock.lock();
+
+	auto iter = m_deferred.begin();
+	for (; iter != m_deferred.end() && iter->first <= now; ++iter)
+		ready.push_back(iter->second);
+
+	m_deferred.erase(m_deferred.begin(), iter);
+
+	if (!m_deferred.empty())
+		timeout = DWORD(m_deferred.begin()->first - now);
+
+	m_deferredLock.unlock();
+
+	for (auto& deferred : ready)
+		deferred.m_pQueue->Push(deferred.m_request);
+
+	return timeout;
 }
 
 void NetworkerThreadManager::PrepareQuit()
 {
-	for (int i = 0; i < C_AMT_NETWORKER_THREADS; i++) {
-		if (m_pNetworkThreads[i])
-			m_pNetworkThreads[i]->PrepareQuit();
-	}
+	StopAllRequests();
+
+	// Every thread watches the interactive queue, and each one leaves after
+	// taking a single QUIT, so this reaches all of them.
+	for (int i = 0; i < C_AMT_NETWORKER_THREADS; i++)
+		m_interactiveQueue.Push(NetRequest(0, 0, 0, NetRequest::QUIT));
 }
 
 void NetworkerThreadManager::Kill()
@@ -494,6 +729,8 @@ void NetworkerThreadManager::Kill()
 		m_pNetworkThreads[i] = NULL;
 	}
 
+	g_clientPool.Clear();
+
 	m_bKilled = true;
 }
 
@@ -510,15 +747,13 @@ void NetworkerThreadManager::PerformRequest(
 	uint8_t* stream_bytes,
 	size_t stream_size)
 {
-	int idx;
-	if (interactive) {
-		m_nextInteractiveId = (m_nextInteractiveId + 1) % C_INTERACTIVE_NETWORKER_THREADS;
-		idx = m_nextInteractiveId;
-	}
-	else {
-		m_nextBackgroundId = C_INTERACTIVE_NETWORKER_THREADS + (m_nextBackgroundId + 1) % (C_AMT_NETWORKER_THREADS - C_INTERACTIVE_NETWORKER_THREADS);
-		idx = m_nextBackgroundId;
-	}
+	NetRequest rq(0, itype, requestKey, type, url, "", params, authorization, additional_data, pRespFunc, stream_bytes, stream_size);
 
-	m_pNetworkThreads[idx]->AddRequest(type, url, itype, requestKey, params, authorization, additional_data, pRespFunc, stream_bytes, stream_size);
+	if (JoinInFlightRequest(rq))
+		return;
+
+	if (interactive)
+		m_interactiveQueue.Push(rq);
+	else
+		m_backgroundQueue.Push(rq);
 }
@@ -11,6 +11,7 @@
 #endif
 
 #include <queue>
+#include <map>
 #include <cassert>
 
 #ifdef MINGW_SPECIFIC_HACKS
@@ -20,6 +21,7 @@
 #endif
 
 #include "network/HTTPClient.hpp"
+#include "network/RateLimiter.hpp"
 
 struct NetworkResponse
 {
@@ -29,6 +31,9 @@ struct NetworkResponse
 #define C_AMT_NETWORKER_THREADS (4)
 #define C_INTERACTIVE_NETWORKER_THREADS (2)
 
+class NetRequestQueue;
+class NetworkerThreadManager;
+
 class NetworkerThread
 {
 public:
@@ -39,15 +44,27 @@ public:
 #endif
 
 private:
-	std::priority_queue<NetRequest> m_requests;
-	nmutex m_requestLock;
+	NetworkerThreadManager* m_pManager;
+
+	// The queue this thread serves, and another queue whose requests it
+	// picks up when its own has nothing to do (may be null).
+	NetRequestQueue* m_pQueue;
+	NetRequestQueue* m_pStealQueue;
+
+	// The queue the request being serviced came from
+	NetRequestQueue* m_pCurrentQueue = nullptr;
 
 	HANDLE m_ThreadHandle;
 	DWORD  m_ThreadID;
 
 	bool ProcessResult(NetRequest& req, const httplib::Result& res);
 
-	void IdleWait();
+	// Blocks until a request is available.
+	NetRequest WaitForRequest();
+
+	// Hands the request back to the manager if its rate limit bucket is empty.
+	// Returns true if it was deferred.
+	bool DeferIfRateLimited(NetRequest& req);
 	
 protected:
 	friend class NetworkerThreadManager;
@@ -62,31 +79,41 @@ public:
 	void FulfillRequest(NetRequest& request);
 	void Run();
 
-	NetworkerThread();
+	NetworkerThread(NetworkerThreadManager* pManager, NetRequestQueue* pQueue, NetRequestQueue* pStealQueue);
 	~NetworkerThread();
 
-	// Safely adds a request to the network worker thread's queue.
-	// * The requestKey is an identifier for what type of request was made. It can be a pointer, enum etc.
-	// * Note: The response function will be run within the context of the networker thread, so
-	//   that's where you send messages back to the main thread.
-	// * Note: The stream_bytes array is owned by the HTTP client after being passed in.
-	void AddRequest(
-		NetRequest::eType type,
-		const std::string& url,
-		int itype,
-		uint64_t requestKey,
-		std::string params = "",
-		std::string authorization = "",
-		std::string additional_data = "",
-		NetRequest::NetworkResponseFunc pRespFunc = nullptr,
-		uint8_t* stream_bytes = nullptr,
-		size_t stream_size = 0
-	);
+	bool ProgressFunction(NetRequest* pRequest, uint64_t offset, uint64_t length);
+};
 
-	void StopAllRequests();
-	void PrepareQuit();
+// Priority queue of requests shared by a pool of networker threads.  The
+// semaphore is released once for every request pushed, so idle threads sleep
+// on it and a new request is picked up straight away.  Windows XP has no
+// condition variables, hence the semaphore.
+//
+// A thread woken by the semaphore may find the queue empty because the request
+// was cleared, or taken by a thread stealing work from another pool; it just
+// goes back to sleep.
+class NetRequestQueue
+{
+public:
+	NetRequestQueue();
+	~NetRequestQueue();
 
-	bool ProgressFunction(NetRequest* pRequest, uint64_t offset, uint64_t length);
+	void Push(const NetRequest& request);
+
+	// Takes the highest priority request.  Returns false if there isn't one.
+	bool Pop(NetRequest& request);
+
+	void Clear();
+
+	HANDLE GetSemaphore() const {
+		return m_hSemaphore;
+	}
+
+private:
+	std::priority_queue<NetRequest> m_requests;
+	NetworkerThread::nmutex m_lock;
+	HANDLE m_hSemaphore;
 };
 
 class NetworkerThreadManager : public HTTPClient
@@ -117,11 +144,39 @@ public:
 
 	std::string ErrorMessage(int errorCode) const;
 
+	RateLimiter& GetRateLimiter() {
+		return m_rateLimiter;
+	}
+
+	// Puts a request aside until `readyAt` (GetTimeMs() clock).  It's then
+	// pushed back to `pQueue`.
+	void DeferRequest(const NetRequest& request, NetRequestQueue* pQueue, uint64_t readyAt);
+
+	// Requeues the deferred requests that are due.  Returns how many
+	// milliseconds until the next one is, or INFINITE.
+	DWORD ReleaseDeferredRequests();
+
 private:
 	NetworkerThread* m_pNetworkThreads[C_AMT_NETWORKER_THREADS] = { nullptr };
 
-	int m_nextInteractiveId = 0;
-	int m_nextBackgroundId  = 0;
+	// Interactive requests are served by the first C_INTERACTIVE_NETWORKER_THREADS
+	// threads.  The others serve background requests, and help out with interactive
+	// ones when they have no background work.
+	NetRequestQueue m_interactiveQueue;
+	NetRequestQueue m_backgroundQueue;
+
+	// Requests held back by the rate limiter, by the time they may go.  Requests
+	// for the same bucket end up with the same time, and go out together.
+	struct DeferredRequest
+	{
+		NetRequest m_request;
+		NetRequestQueue* m_pQueue;
+	};
+	std::multimap<uint64_t, DeferredRequest> m_deferred;
+	NetworkerThread::nmutex m_deferredLock;
+
+	RateLimiter m_rateLimiter;
+
 	bool m_bKilled = true;
 };
 
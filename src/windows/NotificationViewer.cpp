@@ -101,9 +101,7 @@ void NotificationViewer::Initialize(HWND hWnd)
 			details += "(" + guildName + ")";
 		}
 
-		msg->m_dateFull    = details + " - " + msg->m_dateFull;
-		msg->m_dateCompact = details + " - " + msg->m_dateCompact;
-		msg->m_dateOnly    = details + " - " + msg->m_dateOnly;
+		msg->m_datePrefix = details + " - ";
 
 		m_pMessageList->AddMessage(msg);
 	}
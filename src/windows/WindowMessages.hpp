@@ -71,6 +71,8 @@ enum eWmUserMsgs
 	WM_VOICESTATECHANGE,
 	WM_STREAMSTATECHANGE,
 	WM_STREAMVIEWERFRAME,
+	WM_GATEWAYEVENTS,
+	WM_IMAGESDECODED,
 
 	WM_UPDATETEXTSIZE = WM_APP, // used by the MessageEditor
 	WM_RESTOREAPP,
@@ -0,0 +1,21 @@
+// The frontend provides these.  Nothing the tests run calls them, but the core
+// library refers to them.
+
+class Frontend;
+class HTTPClient;
+class DiscordInstance;
+
+Frontend* GetFrontend()
+{
+	return nullptr;
+}
+
+HTTPClient* GetHTTPClient()
+{
+	return nullptr;
+}
+
+DiscordInstance* GetDiscordInstance()
+{
+	return nullptr;
+}
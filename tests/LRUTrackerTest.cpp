@@ -0,0 +1,156 @@
+// Checks the eviction policy AvatarCache uses for its bitmaps and placeholders.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+#include "utils/LRUTracker.hpp"
+
+static int g_failures = 0;
+
+#define CHECK(cond) do { \
+	if (!(cond)) { \
+		fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+		g_failures++; \
+	} \
+} while (0)
+
+// Evicts like AvatarCache::EnforceBudget does, returns the evicted keys in order.
+static std::vector<std::string> Enforce(LRUTracker& lru)
+{
+	std::vector<std::string> evicted;
+	while (lru.IsOverBudget()) {
+		std::string key = lru.GetLeastRecent();
+		evicted.push_back(key);
+		lru.Remove(key);
+	}
+	return evicted;
+}
+
+static void TestCountBudget()
+{
+	LRUTracker lru(3, SIZE_MAX);
+	lru.Insert("a", 0);
+	lru.Insert("b", 0);
+	lru.Insert("c", 0);
+	CHECK(!lru.IsOverBudget());
+
+	lru.Insert("d", 0);
+	CHECK(lru.IsOverBudget());
+
+	std::vector<std::string> evicted = Enforce(lru);
+	CHECK(evicted.size() == 1 && evicted[0] == "a");
+	CHECK(lru.GetCount() == 3);
+	CHECK(!lru.Contains("a"));
+}
+
+static void TestTouchReorders()
+{
+	LRUTracker lru(3, SIZE_MAX);
+	lru.Insert("a", 0);
+	lru.Insert("b", 0);
+	lru.Insert("c", 0);
+
+	CHECK(lru.Touch("a"));
+	CHECK(!lru.Touch("missing"));
+
+	lru.Insert("d", 0);
+	std::vector<std::string> evicted = Enforce(lru);
+	CHECK(evicted.size() == 1 && evicted[0] == "b");
+	CHECK(lru.Contains("a"));
+}
+
+static void TestByteBudget()
+{
+	LRUTracker lru(100, 1000);
+	lru.Insert("a", 400);
+	lru.Insert("b", 400);
+	CHECK(lru.GetBytes() == 800);
+	CHECK(!lru.IsOverBudget());
+
+	lru.Insert("c", 500);
+	std::vector<std::string> evicted = Enforce(lru);
+	CHECK(evicted.size() == 1 && evicted[0] == "a");
+	CHECK(lru.GetBytes() == 900);
+}
+
+static void TestReinsertUpdatesSize()
+{
+	LRUTracker lru(100, 1000);
+	lru.Insert("a", 600);
+	lru.Insert("b", 100);
+
+	// "a" gets replaced by a bigger copy, and becomes the most recent one
+	lru.Insert("a", 800);
+	CHECK(lru.GetCount() == 2);
+	CHECK(lru.GetBytes() == 900);
+
+	lru.Insert("a", 950);
+	std::vector<std::string> evicted = Enforce(lru);
+	CHECK(evicted.size() == 1 && evicted[0] == "b");
+	CHECK(lru.GetBytes() == 950);
+}
+
+static void TestMostRecentIsKept()
+{
+	// A single entry over the byte budget stays, it's about to be drawn
+	LRUTracker lru(100, 1000);
+	lru.Insert("a", 100);
+	lru.Insert("huge", 5000);
+
+	std::vector<std::string> evicted = Enforce(lru);
+	CHECK(evicted.size() == 1 && evicted[0] == "a");
+	CHECK(lru.GetCount() == 1);
+	CHECK(lru.Contains("huge"));
+	CHECK(!lru.IsOverBudget());
+}
+
+static void TestRemoveAndClear()
+{
+	LRUTracker lru(100, 1000);
+	lru.Insert("a", 100);
+	lru.Insert("b", 200);
+
+	lru.Remove("a");
+	lru.Remove("missing");
+	CHECK(lru.GetCount() == 1);
+	CHECK(lru.GetBytes() == 200);
+	CHECK(lru.GetLeastRecent() == "b");
+
+	lru.Clear();
+	CHECK(lru.GetCount() == 0);
+	CHECK(lru.GetBytes() == 0);
+	CHECK(!lru.Contains("b"));
+}
+
+static void TestPlaceholdersAreBounded()
+{
+	// Placeholders take no bytes, only their count bounds them
+	LRUTracker lru(1024, SIZE_MAX);
+	for (int i = 0; i < 100000; i++) {
+		lru.Insert("placeholder" + std::to_string(i), 0);
+		Enforce(lru);
+	}
+
+	CHECK(lru.GetCount() == 1024);
+	CHECK(lru.Contains("placeholder99999"));
+	CHECK(!lru.Contains("placeholder0"));
+}
+
+int main()
+{
+	TestCountBudget();
+	TestTouchReorders();
+	TestByteBudget();
+	TestReinsertUpdatesSize();
+	TestMostRecentIsKept();
+	TestRemoveAndClear();
+	TestPlaceholdersAreBounded();
+
+	if (g_failures) {
+		fprintf(stderr, "%d checks failed\n", g_failures);
+		return 1;
+	}
+
+	printf("All checks passed\n");
+	return 0;
+}
@@ -0,0 +1,254 @@
+// Measures ReadyParser on synthetic READY payloads:
+// - parse time and peak memory for 50 to 1000 guilds, streamed and as a plain DOM
+// - how parsing 500 guilds scales with the number of guild parser threads
+//
+// Each measurement runs in its own process, so that the peak RSS of one doesn't
+// hide the next.  Pass --quick to run a single small case, as the test does.
+
+#include <cstdio>
+#include <cstdarg>
+#include <cstring>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include "network/ReadyParser.hpp"
+
+using Json = nlohmann::json;
+
+static const int CHANNELS_PER_GUILD = 40;
+static const int ROLES_PER_GUILD = 20;
+static const int EMOJIS_PER_GUILD = 15;
+
+static void Append(std::string& str, const char* fmt, ...) __attribute__((format(printf, 2, 3)));
+
+static void Append(std::string& str, const char* fmt, ...)
+{
+	char buffer[512];
+	va_list vl;
+	va_start(vl, fmt);
+	int len = vsnprintf(buffer, sizeof buffer, fmt, vl);
+	va_end(vl);
+	str.append(buffer, len);
+}
+
+static unsigned long long GuildId(int guild)
+{
+	return 100000000000000000ULL + guild * 1000ULL;
+}
+
+static void AppendGuild(std::string& out, int guild)
+{
+	unsigned long long id = GuildId(guild);
+
+	Append(out, "{\"id\":\"%llu\",\"properties\":{\"name\":\"Guild %d\",\"owner_id\":\"%llu\","
+		"\"icon\":\"0123456789abcdef0123456789abcdef\",\"default_message_notifications\":1,"
+		"\"description\":\"A guild made up for the benchmark\",\"preferred_locale\":\"en-US\"},",
+		id, guild, id + 999);
+
+	out += "\"channels\":[";
+	for (int i = 0; i < CHANNELS_PER_GUILD; i++)
+	{
+		unsigned long long cid = id + 1 + i;
+		int type = i % 10 == 0 ? 4 : (i % 10 == 9 ? 2 : 0);
+		std::string parent = type == 4 ? "null" : "\"" + std::to_string(id + 1 + (i / 10) * 10) + "\"";
+
+		if (i) out += ',';
+		Append(out, "{\"id\":\"%llu\",\"type\":%d,\"name\":\"channel-%d\",\"position\":%d,"
+			"\"parent_id\":%s,\"last_message_id\":\"%llu\",\"topic\":\"Topic of channel %d\","
+			"\"permission_overwrites\":[{\"id\":\"%llu\",\"type\":0,\"allow\":\"1024\",\"deny\":\"2048\"}]}",
+			cid, type, i, i, parent.c_str(), cid + 5000000, i, id);
+	}
+
+	out += "],\"roles\":[";
+	for (int i = 0; i < ROLES_PER_GUILD; i++)
+	{
+		if (i) out += ',';
+		Append(out, "{\"id\":\"%llu\",\"name\":\"Role %d\",\"color\":%d,\"hoist\":%s,\"managed\":false,"
+			"\"mentionable\":true,\"permissions\":\"104324673\",\"position\":%d}",
+			i ? id + 100 + i : id, i, i * 1000, i % 4 ? "false" : "true", i);
+	}
+
+	out += "],\"emojis\":[";
+	for (int i = 0; i < EMOJIS_PER_GUILD; i++)
+	{
+		if (i) out += ',';
+		Append(out, "{\"id\":\"%llu\",\"name\":\"emoji_%d\",\"animated\":%s,\"available\":true,"
+			"\"managed\":false,\"require_colons\":true", id + 200 + i, i, i % 3 ? "false" : "true");
+
+		if (i % 5 == 0)
+			Append(out, ",\"user\":{\"id\":\"%llu\",\"username\":\"user%d\",\"global_name\":\"User %d\","
+				"\"avatar\":\"fedcba9876543210fedcba9876543210\",\"discriminator\":\"0\"}", id + 300 + i, i, i);
+
+		out += '}';
+	}
+
+	out += "]}";
+}
+
+static std::string MakeReadyPayload(int guilds)
+{
+	std::string out;
+	out += "{\"op\":0,\"s\":1,\"t\":\"READY\",\"d\":{\"v\":9,\"session_id\":\"0123456789abcdef\","
+		"\"user\":{\"id\":\"42\",\"username\":\"bench\"},\"guilds\":[";
+
+	for (int i = 0; i < guilds; i++)
+	{
+		if (i) out += ',';
+		AppendGuild(out, i);
+	}
+
+	out += "],\"read_state\":{\"version\":1,\"partial\":false,\"entries\":[";
+	for (int i = 0; i < guilds * CHANNELS_PER_GUILD; i++)
+	{
+		if (i) out += ',';
+		Append(out, "{\"id\":\"%llu\",\"last_message_id\":\"%llu\",\"mention_count\":0,\"flags\":0,\"last_viewed\":0}",
+			GuildId(i / CHANNELS_PER_GUILD) + 1 + i % CHANNELS_PER_GUILD, 5000000ULL + i);
+	}
+
+	out += "]}}}";
+	return out;
+}
+
+static long GetPeakRSSKB()
+{
+	rusage usage{};
+	getrusage(RUSAGE_SELF, &usage);
+	return usage.ru_maxrss;
+}
+
+static bool CheckGuilds(const ReadyData& ready, int guilds)
+{
+	if (int(ready.m_guilds.size()) != guilds || int(ready.m_readStates.size()) != guilds * CHANNELS_PER_GUILD)
+		return false;
+
+	for (int i = 0; i < guilds; i++)
+	{
+		const Guild& g = ready.m_guilds[i];
+		if (g.m_snowflake != GuildId(i) || g.m_channels.size() != size_t(CHANNELS_PER_GUILD) || g.m_roles.size() != size_t(ROLES_PER_GUILD))
+			return false;
+	}
+
+	return true;
+}
+
+enum eMode
+{
+	STREAMED,
+	DOM,
+};
+
+// Runs in a child process.  Returns the exit code.
+static int Measure(eMode mode, int guilds, int parseThreads, int runs)
+{
+	std::string payload = MakeReadyPayload(guilds);
+	long baseRSS = GetPeakRSSKB();
+	double bestMs = 1e30;
+
+	for (int run = 0; run < runs; run++)
+	{
+		Json json;
+		ReadyData ready;
+		std::string error;
+
+		auto start = std::chrono::steady_clock::now();
+
+		if (mode == STREAMED)
+		{
+			std::unique_ptr<ReadyData> pReady;
+			if (!ReadyParser::Parse(payload, json, pReady, error, parseThreads) || !pReady) {
+				fprintf(stderr, "Parse failed: %s\n", error.c_str());
+				return 1;
+			}
+			ready = std::move(*pReady);
+		}
+		else
+		{
+			json = Json::parse(payload);
+			ReadyParser::Collect(json["d"], ready);
+		}
+
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		if (bestMs > ms)
+			bestMs = ms;
+
+		if (!CheckGuilds(ready, guilds)) {
+			fprintf(stderr, "The parsed guilds don't match the payload\n");
+			return 1;
+		}
+	}
+
+	long peakRSS = GetPeakRSSKB();
+	printf("%-8s %6d %7d %9.1f %10.1f %10.1f %10.1f\n",
+		mode == STREAMED ? "streamed" : "dom", guilds, parseThreads,
+		payload.size() / 1048576.0, bestMs, peakRSS / 1024.0, (peakRSS - baseRSS) / 1024.0);
+	return 0;
+}
+
+static bool RunMeasurement(eMode mode, int guilds, int parseThreads, int runs)
+{
+	fflush(stdout);
+
+	pid_t pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return false;
+	}
+
+	if (pid == 0)
+	{
+		int code = Measure(mode, guilds, parseThreads, runs);
+		fflush(stdout);
+		_exit(code);
+	}
+
+	int status = 0;
+	waitpid(pid, &status, 0);
+	return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+static void PrintHeader(const char* title)
+{
+	printf("\n%s\n", title);
+	printf("%-8s %6s %7s %9s %10s %10s %10s\n", "mode", "guilds", "workers", "input MB", "best ms", "peak MB", "parse MB");
+}
+
+int main(int argc, char** argv)
+{
+	bool quick = argc > 1 && strcmp(argv[1], "--quick") == 0;
+	bool ok = true;
+
+	if (quick)
+	{
+		PrintHeader("Smoke test");
+		ok &= RunMeasurement(STREAMED, 50, 0, 1);
+		ok &= RunMeasurement(STREAMED, 50, 2, 1);
+		ok &= RunMeasurement(DOM, 50, 2, 1);
+		return ok ? 0 : 1;
+	}
+
+	// Peak RSS includes the payload itself, "parse MB" is what the parse added on top.
+	PrintHeader("Guild count (default workers)");
+	const int guildCounts[] = { 50, 100, 250, 500, 1000 };
+	for (int guilds : guildCounts)
+	{
+		ok &= RunMeasurement(STREAMED, guilds, -1, 3);
+		ok &= RunMeasurement(DOM, guilds, -1, 3);
+	}
+
+	// One core parses the payload, the workers parse the guilds.  0 parses them inline.
+	int maxWorkers = int(std::thread::hardware_concurrency()) - 1;
+	if (maxWorkers > ReadyParser::MAX_PARSE_THREADS)
+		maxWorkers = ReadyParser::MAX_PARSE_THREADS;
+	if (maxWorkers < 1)
+		maxWorkers = 1;
+
+	PrintHeader("Scaling on 500 guilds");
+	for (int workers = 0; workers <= maxWorkers; workers++)
+		ok &= RunMeasurement(STREAMED, 500, workers, 5);
+
+	printf("\n%u hardware threads\n", std::thread::hardware_concurrency());
+	return ok ? 0 : 1;
+}
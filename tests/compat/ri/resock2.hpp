@@ -0,0 +1,12 @@
+#pragma once
+
+// The asio in deps/ is patched to pull in mwas' socket layer for old Windows
+// versions, even when it isn't building for Windows.  These are the few names
+// it then uses outside of the Windows specific parts.
+
+inline void OutputDebugStringA(const char*) {}
+
+#define WSAHOST_NOT_FOUND 11001
+#define WSATRY_AGAIN      11002
+#define WSAEDISCON        10101
+#define WSAETIMEDOUT      10060
@@ -5,14 +5,16 @@
 #include <array>
 #include <atomic>
 #include <cstdint>
-#include <deque>
 #include <functional>
+#include <memory>
 #include <mutex>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
 #include "voice_types.h"
 #include "audio_devices.h"
+#include "jitter_buffer.h"
+#include "spsc_ring.h"
 
 // Forward declarations - Opus types are structs
 struct OpusEncoder;
@@ -50,8 +52,11 @@ public:
     void RemoveSSRC(uint32_t ssrc);
     void RemoveAllSSRCs();
 
-    // Feed received Opus data for playback
-    void FeedMeOpus(uint32_t ssrc, const std::vector<uint8_t> &data);
+    // Feed received Opus data for playback.  Sequence and timestamp come from the RTP header.
+    void FeedMeOpus(uint32_t ssrc, uint16_t sequence, uint32_t timestamp, const uint8_t *data, size_t size);
+
+    // Jitter buffer counters for a stream, returns false if the SSRC is unknown
+    bool GetJitterStats(uint32_t ssrc, JitterBuffer::Stats &stats) const;
 
     // Volume controls
     void SetCaptureGain(double gain);
@@ -99,7 +104,7 @@ private:
 
     bool CheckVADVoiceGate();
     void UpdateCaptureVolume(const int16_t *pcm, uint32_t frames);
-    void UpdateReceiveVolume(uint32_t ssrc, const int16_t *pcm, int frames);
+    void UpdateReceiveVolume(uint32_t ssrc, const float *pcm, int frames);
 
     void Log(int level, const std::string &msg);
 
@@ -114,12 +119,39 @@ private:
     mutable std::mutex m_mutex;
     mutable std::mutex m_enc_mutex;
 
-    // Per-SSRC: decoded PCM buffer + Opus decoder
+    // Per-SSRC stream.  The jitter buffer and decoder are only touched by the receive
+    // side under m_mutex.  Decoded PCM is handed to the playback callback through a
+    // lock-free ring, so the callback never waits on a decode.
     struct SSRCSource {
-        std::deque<int16_t> buffer;
+        SSRCSource() : ring(RING_CAPACITY) {}
+
+        JitterBuffer jitter;
+        std::vector<JitterBuffer::Frame> ready;
         OpusDecoder *decoder = nullptr;
+
+        SPSCRing<float> ring;          // interleaved stereo
+        std::atomic<float> volume{1.0f};
     };
-    std::unordered_map<uint32_t, SSRCSource> m_sources;
+    std::unordered_map<uint32_t, std::unique_ptr<SSRCSource>> m_sources;
+
+    // Enough for a full jitter buffer flush plus the drift allowance below
+    static constexpr size_t RING_CAPACITY = 32768;
+
+    // Decoded audio beyond the jitter buffer's depth plus this many frames means we're
+    // receiving faster than we play (clock drift) and new frames get dropped.
+    static constexpr int MAX_PCM_FRAMES = 3;
+
+    void DecodeReadyFrames(uint32_t ssrc, SSRCSource &src);
+
+    // RCU-style snapshot of m_sources for the playback callback.  Writers swap in a new
+    // list under m_mutex and wait for the callback to leave the old one before freeing it.
+    struct PlaybackList {
+        std::vector<SSRCSource *> sources;
+    };
+    std::atomic<PlaybackList *> m_playback_list{nullptr};
+    std::atomic<int> m_playback_readers{0};
+
+    void PublishSources();
 
     // Opus encoder
     OpusEncoder *m_encoder = nullptr;
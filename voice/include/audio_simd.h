@@ -0,0 +1,33 @@
+#pragma once
+#ifndef DISCORD_VOICE_AUDIO_SIMD_H
+#define DISCORD_VOICE_AUDIO_SIMD_H
+
+#include <cstddef>
+#include <cstdint>
+
+namespace dv {
+namespace simd {
+
+// Sample kernels used by the capture and playback paths.  Each one has an SSE2 version
+// (always available on x64), an AVX2 version when the compiler targets it (/arch:AVX2,
+// -mavx2), and a scalar fallback.  Buffers don't need any particular alignment.
+
+// dst[i] += src[i] * gain
+void MixScaled(float *dst, const float *src, size_t count, float gain);
+
+// dst[i] = saturate(trunc(src[i] * gain)), may run in place
+void GainInt16(const int16_t *src, int16_t *dst, size_t count, float gain);
+
+// Interleaved stereo: replace both channels with their average, in place
+void DownmixMonoInt16(int16_t *stereo, size_t frames);
+
+// Interleaved stereo to a mono float buffer at int16 scale (what RNNoise wants)
+void StereoToMonoFloat(const int16_t *stereo, float *mono, size_t frames);
+
+// Mono float at int16 scale back to interleaved stereo int16, saturating
+void MonoFloatToStereoInt16(const float *mono, int16_t *stereo, size_t frames);
+
+} // namespace simd
+} // namespace dv
+
+#endif // DISCORD_VOICE_AUDIO_SIMD_H
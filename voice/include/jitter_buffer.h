@@ -0,0 +1,113 @@
+#pragma once
+#ifndef DISCORD_VOICE_JITTER_BUFFER_H
+#define DISCORD_VOICE_JITTER_BUFFER_H
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace dv {
+
+// Per-SSRC reorder buffer for incoming Opus packets.
+//
+// Packets are held until the buffer is `target depth` packets deep, then released in
+// RTP sequence order.  The target depth follows the RFC 3550 interarrival jitter
+// estimate.  Holes that are still missing when their turn comes are reported as
+// either FEC (the next packet is available, decode its in-band redundancy) or PLC
+// (nothing to go on, let the decoder conceal).
+//
+// This class only decides what to play.  Decoding is left to the caller.  Packets live
+// in a fixed window of slots whose storage is reused, so steady state doesn't allocate.
+class JitterBuffer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class FrameKind {
+        Normal,  // decode `data` as usual
+        FEC,     // decode `data` with decode_fec=1 to recover the previous packet
+        PLC,     // decode with no data to conceal a lost packet
+    };
+
+    // `data` points into the jitter buffer and stays valid until the next Push/Reset
+    struct Frame {
+        FrameKind kind = FrameKind::Normal;
+        int samples = 0; // per channel, 48kHz
+        const uint8_t *data = nullptr;
+        size_t size = 0;
+    };
+
+    struct Stats {
+        uint64_t received = 0;
+        uint64_t late = 0;        // arrived after their slot was played or concealed
+        uint64_t duplicate = 0;
+        uint64_t fec_recovered = 0;
+        uint64_t concealed = 0;   // PLC frames
+        uint64_t skipped = 0;     // lost frames beyond the concealment limit
+        double jitter_ms = 0.0;
+        int target_depth = 0;     // in packets
+    };
+
+    static constexpr int DEFAULT_FRAME_SAMPLES = 960;
+    static constexpr int MIN_DEPTH = 1;
+    static constexpr int MAX_DEPTH = 10;
+    // Never conceal more than this many frames in a row; a longer hole is a resync.
+    static constexpr int MAX_CONCEAL = 5;
+    // Packets further ahead than this resynchronise the buffer
+    static constexpr uint32_t WINDOW = 64;
+
+    JitterBuffer() = default;
+
+    // Queues a packet.  Everything that is ready to be played afterwards is appended to `out`.
+    void Push(uint16_t sequence, uint32_t timestamp, const uint8_t *data, size_t size,
+              Clock::time_point arrival, std::vector<Frame> &out);
+
+    // Releases every held packet in order, concealing holes as usual.
+    void Flush(std::vector<Frame> &out);
+
+    void Reset();
+
+    const Stats &GetStats() const noexcept { return m_stats; }
+    int GetFrameSamples() const noexcept { return m_frame_samples; }
+
+    // Opus "silence" frame.  Discord sends a few of these at the end of a talk spurt.
+    static bool IsSilenceFrame(const uint8_t *data, size_t size);
+
+private:
+    struct Slot {
+        bool used = false;
+        uint32_t sequence = 0; // unwrapped
+        uint32_t timestamp = 0;
+        std::vector<uint8_t> data;
+    };
+
+    Slot &SlotFor(uint32_t seq) { return m_slots[seq % WINDOW]; }
+    Slot *FindHeld(uint32_t seq);
+
+    // Drops everything held and carries on from `seq`.
+    void Resync(uint32_t seq, uint32_t timestamp);
+    void UpdateJitter(uint32_t timestamp, Clock::time_point arrival);
+    void Drain(bool flush, std::vector<Frame> &out);
+    void Conceal(std::vector<Frame> &out);
+
+    // Indexed by the unwrapped (32-bit) sequence modulo WINDOW.  Everything held is
+    // within [m_next_seq, m_next_seq + WINDOW) so slots never collide.
+    std::array<Slot, WINDOW> m_slots;
+    size_t m_held = 0;
+
+    bool m_started = false;
+    uint32_t m_next_seq = 0;       // unwrapped sequence of the next packet to release
+    uint32_t m_last_timestamp = 0; // timestamp of the last released packet
+    int m_frame_samples = DEFAULT_FRAME_SAMPLES;
+
+    bool m_have_transit = false;
+    uint32_t m_last_arrival_ts = 0;
+    Clock::time_point m_last_arrival;
+
+    Stats m_stats;
+};
+
+} // namespace dv
+
+#endif // DISCORD_VOICE_JITTER_BUFFER_H
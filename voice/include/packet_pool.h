@@ -0,0 +1,76 @@
+#pragma once
+#ifndef DISCORD_VOICE_PACKET_POOL_H
+#define DISCORD_VOICE_PACKET_POOL_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace dv {
+
+// One outgoing UDP datagram.  The RTP payload is written at PayloadData() and then
+// sealed in place, so a packet is built without any intermediate copies.
+struct PacketBuffer {
+    static constexpr size_t CAPACITY = 1500; // Ethernet MTU, nothing we send is bigger
+    static constexpr size_t RTP_HEADER_SIZE = 12;
+    static constexpr size_t NONCE_SIZE = sizeof(uint32_t);
+    static constexpr size_t TAG_SIZE = 16; // crypto_aead_xchacha20poly1305_ietf_ABYTES
+
+    // Largest plaintext payload that still fits after sealing
+    static constexpr size_t MAX_PAYLOAD = CAPACITY - RTP_HEADER_SIZE - TAG_SIZE - NONCE_SIZE;
+
+    uint8_t *PayloadData() { return data.data() + RTP_HEADER_SIZE; }
+
+    size_t size = 0;
+    std::array<uint8_t, CAPACITY> data;
+};
+
+// Free list of PacketBuffers.  Acquire only allocates when every buffer is in flight,
+// so once the pool has warmed up to the peak burst size the send path stops allocating.
+// Safe to use from multiple threads.
+class PacketPool {
+public:
+    struct Releaser {
+        PacketPool *pool = nullptr;
+        void operator()(PacketBuffer *buf) const { if (pool) pool->Release(buf); }
+    };
+    using Ptr = std::unique_ptr<PacketBuffer, Releaser>;
+
+    explicit PacketPool(size_t initial_count = 16);
+
+    PacketPool(const PacketPool &) = delete;
+    PacketPool &operator=(const PacketPool &) = delete;
+
+    Ptr Acquire();
+
+    // Total buffers ever created (grows only when the pool runs dry)
+    size_t GetAllocatedCount() const;
+
+private:
+    void Release(PacketBuffer *buf);
+
+    mutable std::mutex m_mutex;
+    std::vector<std::unique_ptr<PacketBuffer>> m_storage;
+    std::vector<PacketBuffer *> m_free;
+};
+
+// Writes the RTP header into `buf`, encrypts `payload` behind it with
+// XChaCha20-Poly1305 (the header is the AAD) and appends the 4-byte nonce counter.
+// `payload` may point at buf.PayloadData() to encrypt in place.  `payload_type` is
+// the whole second header byte, so callers OR in the marker bit themselves.
+// Returns false if the payload doesn't fit.
+bool SealRTPPacket(PacketBuffer &buf, uint8_t payload_type, uint16_t sequence, uint32_t timestamp,
+                   uint32_t ssrc, uint32_t nonce, const std::array<uint8_t, 32> &key,
+                   const uint8_t *payload, size_t len);
+
+// Same for an RTCP packet: the first 8 bytes (header + sender SSRC) stay in the clear
+// as AAD, the rest of `rtcp` is encrypted behind them.
+bool SealRTCPPacket(PacketBuffer &buf, uint32_t nonce, const std::array<uint8_t, 32> &key,
+                    const uint8_t *rtcp, size_t len);
+
+} // namespace dv
+
+#endif // DISCORD_VOICE_PACKET_POOL_H
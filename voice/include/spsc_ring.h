@@ -0,0 +1,94 @@
+#pragma once
+#ifndef DISCORD_VOICE_SPSC_RING_H
+#define DISCORD_VOICE_SPSC_RING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+
+namespace dv {
+
+// Fixed-size single-producer/single-consumer ring buffer.
+//
+// One thread may call Write, one other thread may call Read/Consume.  Neither side
+// ever blocks or allocates, which makes the consumer side safe to use from a
+// real-time audio callback.  Capacity is rounded up to a power of two.
+template <typename T>
+class SPSCRing {
+    static_assert(std::is_trivially_copyable<T>::value, "SPSCRing only holds trivially copyable types");
+
+public:
+    explicit SPSCRing(size_t capacity) {
+        m_capacity = 1;
+        while (m_capacity < capacity) m_capacity <<= 1;
+        m_mask = m_capacity - 1;
+        m_data = std::make_unique<T[]>(m_capacity);
+    }
+
+    SPSCRing(const SPSCRing &) = delete;
+    SPSCRing &operator=(const SPSCRing &) = delete;
+
+    size_t Capacity() const noexcept { return m_capacity; }
+
+    // Approximate from either side, exact from the producer for free space and from
+    // the consumer for available data.
+    size_t Size() const noexcept {
+        return m_head.load(std::memory_order_acquire) - m_tail.load(std::memory_order_acquire);
+    }
+
+    // Producer.  Returns how many elements fit.
+    size_t Write(const T *src, size_t count) noexcept {
+        const size_t head = m_head.load(std::memory_order_relaxed);
+        const size_t tail = m_tail.load(std::memory_order_acquire);
+        count = std::min(count, m_capacity - (head - tail));
+
+        const size_t start = head & m_mask;
+        const size_t first = std::min(count, m_capacity - start);
+        std::memcpy(&m_data[start], src, first * sizeof(T));
+        std::memcpy(&m_data[0], src + first, (count - first) * sizeof(T));
+
+        m_head.store(head + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer.  Hands up to `count` elements to fn(const T *data, size_t len, size_t offset)
+    // as at most two contiguous spans, then releases them.  Returns the number consumed.
+    template <typename Fn>
+    size_t Consume(size_t count, Fn &&fn) noexcept {
+        const size_t tail = m_tail.load(std::memory_order_relaxed);
+        const size_t head = m_head.load(std::memory_order_acquire);
+        count = std::min(count, head - tail);
+        if (count == 0) return 0;
+
+        const size_t start = tail & m_mask;
+        const size_t first = std::min(count, m_capacity - start);
+        fn(&m_data[start], first, size_t(0));
+        if (count > first) fn(&m_data[0], count - first, first);
+
+        m_tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+    // Consumer.
+    size_t Read(T *dst, size_t count) noexcept {
+        return Consume(count, [dst](const T *data, size_t len, size_t offset) {
+            std::memcpy(dst + offset, data, len * sizeof(T));
+        });
+    }
+
+private:
+    std::unique_ptr<T[]> m_data;
+    size_t m_capacity = 0;
+    size_t m_mask = 0;
+
+    // Kept on separate cache lines so the two threads don't false-share
+    alignas(64) std::atomic<size_t> m_head{0}; // written by producer
+    alignas(64) std::atomic<size_t> m_tail{0}; // written by consumer
+};
+
+} // namespace dv
+
+#endif // DISCORD_VOICE_SPSC_RING_H
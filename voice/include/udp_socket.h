@@ -21,6 +21,7 @@
 #include <thread>
 #include <vector>
 #include "voice_types.h"
+#include "packet_pool.h"
 
 namespace dv {
 
@@ -37,17 +38,27 @@ public:
     void SetSSRC(uint32_t ssrc);
 
     void SendEncrypted(const uint8_t *data, size_t len, uint32_t timestamp);
+    // Encrypts and sends a complete RTCP packet (feedback like NACK/PLI)
+    void SendEncryptedRTCP(const uint8_t *rtcp, size_t len);
     void Send(const uint8_t *data, size_t len);
+
+    // Sends several finished packets at once (sendmmsg on Linux, a loop elsewhere)
+    void SendBatch(const PacketPool::Ptr *packets, size_t count);
     std::vector<uint8_t> Receive();
 
-    // Callback for received UDP data
-    using DataCallback = std::function<void(const std::vector<uint8_t> &data)>;
+    // Buffers for building outgoing packets without allocating
+    PacketPool &GetPacketPool() { return m_pool; }
+
+    // Callback for received UDP data.  `data` is only valid for the duration of the call.
+    using DataCallback = std::function<void(const uint8_t *data, size_t len)>;
     void SetDataCallback(DataCallback cb);
 
     void SetLogCallback(LogCallback cb);
 
 private:
     void ReadThread();
+    void ReceiveBatch();
+    bool IsFromServer(const sockaddr_in &from) const;
     void Log(int level, const std::string &msg);
 
 #ifdef _WIN32
@@ -63,7 +74,14 @@ private:
     std::array<uint8_t, 32> m_secret_key{};
     uint32_t m_ssrc = 0;
     uint16_t m_sequence = 0;
-    uint32_t m_nonce = 0;
+    std::atomic<uint32_t> m_nonce{0}; // shared by the RTP and RTCP send paths
+
+    PacketPool m_pool;
+
+    // Datagrams pulled off the socket per wakeup
+    static constexpr size_t RECV_BATCH = 16;
+    static constexpr size_t SEND_BATCH = 64;
+    std::array<std::array<uint8_t, 4096>, RECV_BATCH> m_recv_buffers;
 
     DataCallback m_data_callback;
     LogCallback m_log_callback;
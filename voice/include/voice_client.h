@@ -111,7 +111,7 @@ private:
     void HeartbeatThread();
     void KeepaliveThread();
 
-    void OnUDPData(const std::vector<uint8_t> &data);
+    void OnUDPData(const uint8_t *data, size_t len);
 
     void SetState(VoiceState state);
     void Log(int level, const std::string &msg);
@@ -138,6 +138,9 @@ private:
 
     // Session data
     std::array<uint8_t, 32> m_secret_key{};
+
+    // Only touched by the UDP read thread
+    std::array<uint8_t, 4096> m_decrypt_buffer{};
     uint32_t m_ssrc = 0;
     std::string m_server_ip;
     uint16_t m_server_port = 0;
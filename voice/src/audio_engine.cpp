@@ -1,9 +1,11 @@
 #include "../include/audio_engine.h"
+#include "../include/audio_simd.h"
 #include "../deps/miniaudio.h"
 #include <opus/opus.h>
 #include <algorithm>
 #include <cstring>
 #include <sstream>
+#include <thread>
 
 #include "rnnoise.h"
 
@@ -307,6 +309,25 @@ void AudioEngine::SetPlaybackEnabled(bool enabled) {
 
 // --- SSRC management ---
 
+void AudioEngine::PublishSources() {
+    PlaybackList *list = nullptr;
+    if (!m_sources.empty()) {
+        list = new PlaybackList;
+        list->sources.reserve(m_sources.size());
+        for (auto &[ssrc, src] : m_sources)
+            list->sources.push_back(src.get());
+    }
+
+    PlaybackList *old = m_playback_list.exchange(list);
+
+    // Grace period: once the callback is out, nobody can still be looking at `old`
+    // (or at a source that was just dropped from the map).
+    while (m_playback_readers.load() != 0)
+        std::this_thread::yield();
+
+    delete old;
+}
+
 void AudioEngine::AddSSRC(uint32_t ssrc) {
     std::lock_guard<std::mutex> lk(m_mutex);
     if (m_sources.find(ssrc) == m_sources.end()) {
@@ -316,49 +337,98 @@ void AudioEngine::AddSSRC(uint32_t ssrc) {
             Log(LOG_ERROR, "Failed to create Opus decoder for SSRC " + std::to_string(ssrc));
             return;
         }
-        SSRCSource src;
-        src.decoder = decoder;
+        auto src = std::make_unique<SSRCSource>();
+        src->decoder = decoder;
+        if (auto it = m_volume_ssrc.find(ssrc); it != m_volume_ssrc.end()) {
+            src->volume = static_cast<float>(it->second);
+        }
         m_sources[ssrc] = std::move(src);
+        PublishSources();
     }
 }
 
 void AudioEngine::RemoveSSRC(uint32_t ssrc) {
     std::lock_guard<std::mutex> lk(m_mutex);
     if (auto it = m_sources.find(ssrc); it != m_sources.end()) {
-        opus_decoder_destroy(it->second.decoder);
+        auto src = std::move(it->second);
         m_sources.erase(it);
+        PublishSources();
+        opus_decoder_destroy(src->decoder);
     }
 }
 
 void AudioEngine::RemoveAllSSRCs() {
     std::lock_guard<std::mutex> lk(m_mutex);
-    for (auto &[ssrc, src] : m_sources) {
-        if (src.decoder) opus_decoder_destroy(src.decoder);
-    }
+    auto sources = std::move(m_sources);
     m_sources.clear();
+    PublishSources();
+    for (auto &[ssrc, src] : sources) {
+        if (src->decoder) opus_decoder_destroy(src->decoder);
+    }
 }
 
-void AudioEngine::FeedMeOpus(uint32_t ssrc, const std::vector<uint8_t> &data) {
+void AudioEngine::FeedMeOpus(uint32_t ssrc, uint16_t sequence, uint32_t timestamp, const uint8_t *data, size_t size) {
     if (!m_playback_enabled) return;
     if (!m_playback_ptr) return;
 
     auto *dev = static_cast<ma_device *>(m_playback_ptr);
     if (ma_device_get_state(dev) != ma_device_state_started) return;
 
+    const auto now = JitterBuffer::Clock::now();
+
     std::lock_guard<std::mutex> lk(m_mutex);
     if (m_muted_ssrcs.count(ssrc)) return;
 
-    opus_int16 pcm[120 * 48 * 2]; // Max frame size
     if (auto it = m_sources.find(ssrc); it != m_sources.end()) {
-        int decoded = opus_decode(it->second.decoder, data.data(),
-                                  static_cast<opus_int32>(data.size()),
-                                  pcm, 120 * 48, 0);
+        auto &src = *it->second;
+        src.jitter.Push(sequence, timestamp, data, size, now, src.ready);
+        DecodeReadyFrames(ssrc, src);
+    }
+}
+
+void AudioEngine::DecodeReadyFrames(uint32_t ssrc, SSRCSource &src) {
+    float pcm[120 * 48 * 2]; // Max frame size
+
+    // Drift correction: if the sender's clock runs faster than our output device the
+    // decoded backlog keeps growing.  Drop frames rather than let latency creep up.
+    const size_t frame_len = static_cast<size_t>(src.jitter.GetFrameSamples()) * 2;
+    const size_t max_backlog = frame_len * (src.jitter.GetStats().target_depth + MAX_PCM_FRAMES);
+
+    for (auto &frame : src.ready) {
+        int decoded = 0;
+        switch (frame.kind) {
+            case JitterBuffer::FrameKind::Normal:
+                decoded = opus_decode_float(src.decoder, frame.data,
+                                            static_cast<opus_int32>(frame.size),
+                                            pcm, 120 * 48, 0);
+                break;
+            case JitterBuffer::FrameKind::FEC:
+                // frame_size must match the lost packet exactly for LBRR to kick in
+                decoded = opus_decode_float(src.decoder, frame.data,
+                                            static_cast<opus_int32>(frame.size),
+                                            pcm, frame.samples, 1);
+                break;
+            case JitterBuffer::FrameKind::PLC:
+                decoded = opus_decode_float(src.decoder, nullptr, 0, pcm, frame.samples, 0);
+                break;
+        }
+
         if (decoded > 0) {
             UpdateReceiveVolume(ssrc, pcm, decoded);
-            auto &buf = it->second.buffer;
-            buf.insert(buf.end(), pcm, pcm + decoded * 2);
+            if (src.ring.Size() + decoded * 2 <= max_backlog)
+                src.ring.Write(pcm, static_cast<size_t>(decoded) * 2);
         }
     }
+    src.ready.clear();
+}
+
+bool AudioEngine::GetJitterStats(uint32_t ssrc, JitterBuffer::Stats &stats) const {
+    std::lock_guard<std::mutex> lk(m_mutex);
+    if (auto it = m_sources.find(ssrc); it != m_sources.end()) {
+        stats = it->second->jitter.GetStats();
+        return true;
+    }
+    return false;
 }
 
 // --- Volume controls ---
@@ -381,6 +451,9 @@ void AudioEngine::SetMuteSSRC(uint32_t ssrc, bool mute) {
 void AudioEngine::SetVolumeSSRC(uint32_t ssrc, double volume) {
     std::lock_guard<std::mutex> lk(m_mutex);
     m_volume_ssrc[ssrc] = volume;
+    if (auto it = m_sources.find(ssrc); it != m_sources.end()) {
+        it->second->volume = static_cast<float>(volume);
+    }
 }
 
 double AudioEngine::GetVolumeSSRC(uint32_t ssrc) const {
@@ -429,70 +502,58 @@ void AudioEngine::SetLogCallback(LogCallback cb) {
 // --- miniaudio callbacks ---
 
 void AudioEngine::OnPlaybackRequested(float *pOutput, uint32_t frameCount) {
-    const double playback_gain = m_playback_gain;
-    std::lock_guard<std::mutex> lk(m_mutex);
-    for (auto &[ssrc, src] : m_sources) {
-        double volume = playback_gain;
-        if (auto it = m_volume_ssrc.find(ssrc); it != m_volume_ssrc.end()) {
-            volume *= it->second;
-        }
-        auto &buf = src.buffer;
-        const size_t n = std::min(static_cast<size_t>(buf.size()),
-                                  static_cast<size_t>(frameCount * 2ULL));
-        for (size_t i = 0; i < n; i++) {
-            pOutput[i] += static_cast<float>(volume * buf[i] / 32768.0);
+    // Runs on the audio thread: no locks, no allocations
+    const float playback_gain = static_cast<float>(m_playback_gain.load());
+
+    m_playback_readers++;
+    if (const PlaybackList *list = m_playback_list.load()) {
+        for (SSRCSource *src : list->sources) {
+            const float volume = playback_gain * src->volume.load(std::memory_order_relaxed);
+            src->ring.Consume(frameCount * 2ULL, [pOutput, volume](const float *data, size_t len, size_t offset) {
+                simd::MixScaled(pOutput + offset, data, len, volume);
+            });
         }
-        buf.erase(buf.begin(), buf.begin() + n);
     }
+    m_playback_readers--;
 }
 
 void AudioEngine::OnCapturedPCM(const int16_t *pcm, uint32_t frames) {
     if (!m_encoder || !m_capture_enabled) return;
 
-    const double gain = m_capture_gain;
+    // The encoder always takes exactly one 10ms frame
+    constexpr uint32_t FRAME_SIZE = 480;
+    frames = std::min(frames, FRAME_SIZE);
+
+    const float gain = static_cast<float>(m_capture_gain.load());
 
     // Apply gain
-    std::vector<int16_t> processed(pcm, pcm + frames * 2);
-    for (auto &val : processed) {
-        int32_t unclamped = static_cast<int32_t>(val * gain);
-        val = static_cast<int16_t>(std::clamp(unclamped, (int32_t)INT16_MIN, (int32_t)INT16_MAX));
-    }
+    int16_t processed[FRAME_SIZE * 2] = {};
+    simd::GainInt16(pcm, processed, frames * 2, gain);
 
     // Optional mono mix
     if (m_mix_mono) {
-        for (size_t i = 0; i < frames * 2; i += 2) {
-            int16_t mixed = static_cast<int16_t>((processed[i] + processed[i + 1]) / 2);
-            processed[i] = mixed;
-            processed[i + 1] = mixed;
-        }
+        simd::DownmixMonoInt16(processed, frames);
     }
 
     // Apply RNNoise noise suppression (mono, before encoding)
-    if (m_noise_suppress && m_denoiser && frames == 480) {
-        // Mix to mono for denoising
-        float mono_float[480];
-        for (uint32_t i = 0; i < 480; i++) {
-            mono_float[i] = static_cast<float>((processed[i * 2] + processed[i * 2 + 1]) / 2);
-        }
+    if (m_noise_suppress && m_denoiser && frames == FRAME_SIZE) {
         // RNNoise expects float input scaled to [-32768, 32768]
-        float denoised[480];
+        float mono_float[FRAME_SIZE];
+        simd::StereoToMonoFloat(processed, mono_float, FRAME_SIZE);
+        float denoised[FRAME_SIZE];
         rnnoise_process_frame(static_cast<DenoiseState *>(m_denoiser), denoised, mono_float);
         // Write denoised mono back to stereo
-        for (uint32_t i = 0; i < 480; i++) {
-            int16_t val = static_cast<int16_t>(std::clamp(static_cast<int32_t>(denoised[i]), (int32_t)INT16_MIN, (int32_t)INT16_MAX));
-            processed[i * 2] = val;
-            processed[i * 2 + 1] = val;
-        }
+        simd::MonoFloatToStereoInt16(denoised, processed, FRAME_SIZE);
     }
 
-    UpdateCaptureVolume(processed.data(), frames);
+    UpdateCaptureVolume(processed, frames);
 
     // Voice activity detection (simple gate)
     if (!CheckVADVoiceGate()) return;
 
     // Encode to Opus
     std::lock_guard<std::mutex> lk(m_enc_mutex);
-    int payload_len = opus_encode(m_encoder, processed.data(), 480,
+    int payload_len = opus_encode(m_encoder, processed, FRAME_SIZE,
                                   m_opus_buffer.data(), static_cast<opus_int32>(m_opus_buffer.size()));
     if (payload_len > 0 && m_opus_packet_callback) {
         m_opus_packet_callback(m_opus_buffer.data(), payload_len);
@@ -511,11 +572,11 @@ void AudioEngine::UpdateCaptureVolume(const int16_t *pcm, uint32_t frames) {
     }
 }
 
-void AudioEngine::UpdateReceiveVolume(uint32_t ssrc, const int16_t *pcm, int frames) {
+void AudioEngine::UpdateReceiveVolume(uint32_t ssrc, const float *pcm, int frames) {
     std::lock_guard<std::mutex> lk(m_vol_mtx);
     auto &meter = m_volumes[ssrc];
     for (int i = 0; i < frames * 2; i += 2) {
-        double amp = std::abs(pcm[i]) / 32768.0;
+        double amp = std::abs(pcm[i]);
         meter = std::max(meter, amp);
     }
 }
@@ -0,0 +1,153 @@
+#include "../include/audio_simd.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DV_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#define DV_SIMD_AVX2
+#include <immintrin.h>
+#endif
+
+namespace dv {
+namespace simd {
+
+namespace {
+
+inline int16_t SaturateInt16(float value) {
+    return static_cast<int16_t>(std::clamp(value, -32768.0f, 32767.0f));
+}
+
+// (l + r) / 2, rounding toward zero like plain integer division
+inline int16_t Average(int16_t l, int16_t r) {
+    return static_cast<int16_t>((l + r) / 2);
+}
+
+#ifdef DV_SIMD_SSE2
+// Each 32-bit lane holds an int16 value; duplicate it into both 16-bit halves.
+inline __m128i DupLow16(__m128i v) {
+    const __m128i low_mask = _mm_set1_epi32(0xFFFF);
+    return _mm_or_si128(_mm_and_si128(v, low_mask), _mm_slli_epi32(v, 16));
+}
+
+// Sum adjacent int16 pairs into int32 lanes and halve toward zero.
+inline __m128i PairAverage(__m128i v) {
+    const __m128i sum = _mm_madd_epi16(v, _mm_set1_epi16(1));
+    return _mm_srai_epi32(_mm_add_epi32(sum, _mm_srli_epi32(sum, 31)), 1);
+}
+
+inline __m128i ClampToInt32(__m128 v) {
+    v = _mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-32768.0f)), _mm_set1_ps(32767.0f));
+    return _mm_cvttps_epi32(v);
+}
+#endif
+
+#ifdef DV_SIMD_AVX2
+inline __m256i DupLow16(__m256i v) {
+    const __m256i low_mask = _mm256_set1_epi32(0xFFFF);
+    return _mm256_or_si256(_mm256_and_si256(v, low_mask), _mm256_slli_epi32(v, 16));
+}
+
+inline __m256i PairAverage(__m256i v) {
+    const __m256i sum = _mm256_madd_epi16(v, _mm256_set1_epi16(1));
+    return _mm256_srai_epi32(_mm256_add_epi32(sum, _mm256_srli_epi32(sum, 31)), 1);
+}
+#endif
+
+} // namespace
+
+void MixScaled(float *dst, const float *src, size_t count, float gain) {
+    size_t i = 0;
+#if defined(DV_SIMD_AVX2)
+    const __m256 g8 = _mm256_set1_ps(gain);
+    for (; i + 8 <= count; i += 8) {
+        __m256 d = _mm256_loadu_ps(dst + i);
+        __m256 s = _mm256_loadu_ps(src + i);
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(d, _mm256_mul_ps(s, g8)));
+    }
+#endif
+#if defined(DV_SIMD_SSE2)
+    const __m128 g4 = _mm_set1_ps(gain);
+    for (; i + 4 <= count; i += 4) {
+        __m128 d = _mm_loadu_ps(dst + i);
+        __m128 s = _mm_loadu_ps(src + i);
+        _mm_storeu_ps(dst + i, _mm_add_ps(d, _mm_mul_ps(s, g4)));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] += src[i] * gain;
+    }
+}
+
+void GainInt16(const int16_t *src, int16_t *dst, size_t count, float gain) {
+    size_t i = 0;
+#if defined(DV_SIMD_SSE2)
+    const __m128 g4 = _mm_set1_ps(gain);
+    for (; i + 8 <= count; i += 8) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        lo = ClampToInt32(_mm_mul_ps(_mm_cvtepi32_ps(lo), g4));
+        hi = ClampToInt32(_mm_mul_ps(_mm_cvtepi32_ps(hi), g4));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_packs_epi32(lo, hi));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = SaturateInt16(src[i] * gain);
+    }
+}
+
+void DownmixMonoInt16(int16_t *stereo, size_t frames) {
+    const size_t count = frames * 2;
+    size_t i = 0;
+#if defined(DV_SIMD_AVX2)
+    for (; i + 16 <= count; i += 16) {
+        auto *p = reinterpret_cast<__m256i *>(stereo + i);
+        _mm256_storeu_si256(p, DupLow16(PairAverage(_mm256_loadu_si256(p))));
+    }
+#endif
+#if defined(DV_SIMD_SSE2)
+    for (; i + 8 <= count; i += 8) {
+        auto *p = reinterpret_cast<__m128i *>(stereo + i);
+        _mm_storeu_si128(p, DupLow16(PairAverage(_mm_loadu_si128(p))));
+    }
+#endif
+    for (; i < count; i += 2) {
+        const int16_t mixed = Average(stereo[i], stereo[i + 1]);
+        stereo[i] = mixed;
+        stereo[i + 1] = mixed;
+    }
+}
+
+void StereoToMonoFloat(const int16_t *stereo, float *mono, size_t frames) {
+    size_t i = 0;
+#if defined(DV_SIMD_SSE2)
+    for (; i + 4 <= frames; i += 4) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(stereo + i * 2));
+        _mm_storeu_ps(mono + i, _mm_cvtepi32_ps(PairAverage(v)));
+    }
+#endif
+    for (; i < frames; i++) {
+        mono[i] = static_cast<float>(Average(stereo[i * 2], stereo[i * 2 + 1]));
+    }
+}
+
+void MonoFloatToStereoInt16(const float *mono, int16_t *stereo, size_t frames) {
+    size_t i = 0;
+#if defined(DV_SIMD_SSE2)
+    for (; i + 4 <= frames; i += 4) {
+        __m128i v = ClampToInt32(_mm_loadu_ps(mono + i));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(stereo + i * 2), DupLow16(v));
+    }
+#endif
+    for (; i < frames; i++) {
+        const int16_t val = SaturateInt16(mono[i]);
+        stereo[i * 2] = val;
+        stereo[i * 2 + 1] = val;
+    }
+}
+
+} // namespace simd
+} // namespace dv
@@ -0,0 +1,173 @@
+#include "../include/jitter_buffer.h"
+#include <algorithm>
+#include <cmath>
+
+namespace dv {
+
+bool JitterBuffer::IsSilenceFrame(const uint8_t *data, size_t size) {
+    return size == 3 && data[0] == 0xF8 && data[1] == 0xFF && data[2] == 0xFE;
+}
+
+void JitterBuffer::Reset() {
+    for (auto &slot : m_slots)
+        slot.used = false;
+    m_held = 0;
+    m_started = false;
+    m_next_seq = 0;
+    m_last_timestamp = 0;
+    m_frame_samples = DEFAULT_FRAME_SAMPLES;
+    m_have_transit = false;
+    m_stats = Stats{};
+}
+
+void JitterBuffer::UpdateJitter(uint32_t timestamp, Clock::time_point arrival) {
+    if (m_have_transit) {
+        // D(i-1,i) from RFC 3550 section 6.4.1, in milliseconds
+        const double arrival_ms = std::chrono::duration<double, std::milli>(arrival - m_last_arrival).count();
+        const double media_ms = static_cast<int32_t>(timestamp - m_last_arrival_ts) / 48.0;
+        const double d = std::abs(arrival_ms - media_ms);
+
+        // A long pause (end of a talk spurt) says nothing about network jitter
+        if (d < 1000.0)
+            m_stats.jitter_ms += (d - m_stats.jitter_ms) / 16.0;
+    }
+
+    m_have_transit = true;
+    m_last_arrival = arrival;
+    m_last_arrival_ts = timestamp;
+
+    const double frame_ms = m_frame_samples / 48.0;
+    const int depth = static_cast<int>(std::ceil(2.0 * m_stats.jitter_ms / frame_ms));
+    m_stats.target_depth = std::clamp(depth, MIN_DEPTH, MAX_DEPTH);
+}
+
+void JitterBuffer::Resync(uint32_t seq, uint32_t timestamp) {
+    for (auto &held : m_slots)
+        held.used = false;
+    m_held = 0;
+    m_next_seq = seq;
+    m_last_timestamp = timestamp - m_frame_samples;
+}
+
+JitterBuffer::Slot *JitterBuffer::FindHeld(uint32_t seq) {
+    Slot &slot = SlotFor(seq);
+    return (slot.used && slot.sequence == seq) ? &slot : nullptr;
+}
+
+void JitterBuffer::Push(uint16_t sequence, uint32_t timestamp, const uint8_t *data, size_t size,
+                        Clock::time_point arrival, std::vector<Frame> &out) {
+    m_stats.received++;
+
+    if (!m_started) {
+        m_started = true;
+        // Leave room below so that the first sequence can't underflow when unwrapped
+        m_next_seq = 0x10000u | sequence;
+        m_last_timestamp = timestamp - m_frame_samples;
+    }
+
+    // Unwrap relative to the next expected sequence number
+    const int16_t delta = static_cast<int16_t>(sequence - static_cast<uint16_t>(m_next_seq));
+    uint32_t seq = m_next_seq + delta;
+
+    if (delta <= -static_cast<int>(WINDOW)) {
+        // Way behind us: the sender restarted its sequence numbers, so everything
+        // that follows would be dropped as late.  Start over from here.  Unwrap it
+        // like the first packet, so that repeated restarts can't underflow.
+        seq = 0x10000u | sequence;
+        Resync(seq, timestamp);
+    } else if (delta < 0) {
+        m_stats.late++;
+        return;
+    } else if (static_cast<uint32_t>(delta) >= WINDOW) {
+        // Way ahead of us: whatever we're holding is stale, start over from here.
+        // (Draining it instead would hand out frames whose slot we're about to reuse.)
+        m_stats.skipped += seq - m_next_seq;
+        Resync(seq, timestamp);
+    } else if (FindHeld(seq)) {
+        m_stats.duplicate++;
+        return;
+    }
+
+    UpdateJitter(timestamp, arrival);
+
+    Slot &slot = SlotFor(seq);
+    slot.used = true;
+    slot.sequence = seq;
+    slot.timestamp = timestamp;
+    slot.data.assign(data, data + size); // reuses the slot's capacity
+    m_held++;
+
+    // Nothing will follow a silence frame for a while, so don't sit on what we have
+    Drain(IsSilenceFrame(data, size), out);
+}
+
+void JitterBuffer::Flush(std::vector<Frame> &out) {
+    Drain(true, out);
+}
+
+void JitterBuffer::Conceal(std::vector<Frame> &out) {
+    Frame frame;
+    frame.samples = m_frame_samples;
+
+    // The packet right after the hole may carry an LBRR copy of the missing one
+    if (Slot *next = FindHeld(m_next_seq + 1)) {
+        frame.kind = FrameKind::FEC;
+        frame.data = next->data.data();
+        frame.size = next->data.size();
+        m_stats.fec_recovered++;
+    } else {
+        frame.kind = FrameKind::PLC;
+        m_stats.concealed++;
+    }
+
+    out.push_back(frame);
+    m_last_timestamp += m_frame_samples;
+    m_next_seq++;
+}
+
+void JitterBuffer::Drain(bool flush, std::vector<Frame> &out) {
+    while (m_held > 0) {
+        if (!flush && static_cast<int>(m_held) <= m_stats.target_depth)
+            break;
+
+        // Distance to the oldest held packet
+        uint32_t missing = 0;
+        while (!FindHeld(m_next_seq + missing))
+            missing++;
+
+        if (missing == 0) {
+            Slot &slot = SlotFor(m_next_seq);
+
+            // Learn the frame size from timestamp spacing; Discord normally sends 20ms
+            const uint32_t spacing = slot.timestamp - m_last_timestamp;
+            if (spacing >= 120 && spacing <= 5760)
+                m_frame_samples = static_cast<int>(spacing);
+
+            Frame frame;
+            frame.kind = FrameKind::Normal;
+            frame.samples = m_frame_samples;
+            frame.data = slot.data.data();
+            frame.size = slot.data.size();
+            out.push_back(frame);
+
+            // The slot keeps its bytes until it is reused, so `frame.data` stays valid
+            slot.used = false;
+            m_held--;
+            m_last_timestamp = slot.timestamp;
+            m_next_seq++;
+            continue;
+        }
+
+        if (missing > static_cast<uint32_t>(MAX_CONCEAL)) {
+            // Too much is gone; concealing it all would only add latency
+            m_stats.skipped += missing;
+            m_next_seq += missing;
+            m_last_timestamp = SlotFor(m_next_seq).timestamp - m_frame_samples;
+            continue;
+        }
+
+        Conceal(out);
+    }
+}
+
+} // namespace dv
@@ -0,0 +1,111 @@
+#include "../include/packet_pool.h"
+#include <sodium.h>
+#include <cstring>
+
+namespace dv {
+
+static_assert(PacketBuffer::TAG_SIZE == crypto_aead_xchacha20poly1305_ietf_ABYTES,
+              "PacketBuffer::TAG_SIZE out of sync with libsodium");
+
+PacketPool::PacketPool(size_t initial_count) {
+    m_storage.reserve(initial_count);
+    m_free.reserve(initial_count);
+    for (size_t i = 0; i < initial_count; i++) {
+        m_storage.push_back(std::make_unique<PacketBuffer>());
+        m_free.push_back(m_storage.back().get());
+    }
+}
+
+PacketPool::Ptr PacketPool::Acquire() {
+    std::lock_guard<std::mutex> lk(m_mutex);
+    PacketBuffer *buf;
+    if (m_free.empty()) {
+        m_storage.push_back(std::make_unique<PacketBuffer>());
+        buf = m_storage.back().get();
+        // Make sure Release never has to grow the free list
+        m_free.reserve(m_storage.size());
+    } else {
+        buf = m_free.back();
+        m_free.pop_back();
+    }
+    buf->size = 0;
+    return Ptr(buf, Releaser{this});
+}
+
+void PacketPool::Release(PacketBuffer *buf) {
+    std::lock_guard<std::mutex> lk(m_mutex);
+    m_free.push_back(buf);
+}
+
+size_t PacketPool::GetAllocatedCount() const {
+    std::lock_guard<std::mutex> lk(m_mutex);
+    return m_storage.size();
+}
+
+bool SealRTPPacket(PacketBuffer &buf, uint8_t payload_type, uint16_t sequence, uint32_t timestamp,
+                   uint32_t ssrc, uint32_t nonce, const std::array<uint8_t, 32> &key,
+                   const uint8_t *payload, size_t len) {
+    if (len > PacketBuffer::MAX_PAYLOAD) return false;
+
+    uint8_t *rtp = buf.data.data();
+    rtp[0] = 0x80; // Version 2
+    rtp[1] = payload_type;
+    rtp[2] = (sequence >> 8) & 0xFF;
+    rtp[3] = (sequence >> 0) & 0xFF;
+    rtp[4] = (timestamp >> 24) & 0xFF;
+    rtp[5] = (timestamp >> 16) & 0xFF;
+    rtp[6] = (timestamp >> 8) & 0xFF;
+    rtp[7] = (timestamp >> 0) & 0xFF;
+    rtp[8] = (ssrc >> 24) & 0xFF;
+    rtp[9] = (ssrc >> 16) & 0xFF;
+    rtp[10] = (ssrc >> 8) & 0xFF;
+    rtp[11] = (ssrc >> 0) & 0xFF;
+
+    // Nonce: 4-byte counter in first 4 bytes, rest zeroed
+    std::array<uint8_t, crypto_aead_xchacha20poly1305_ietf_NPUBBYTES> nonce_bytes{};
+    std::memcpy(nonce_bytes.data(), &nonce, sizeof(uint32_t));
+
+    // libsodium allows the ciphertext to overlap the message exactly, which is what
+    // happens when the payload was written at PayloadData()
+    unsigned long long ciphertext_len;
+    crypto_aead_xchacha20poly1305_ietf_encrypt(
+        rtp + PacketBuffer::RTP_HEADER_SIZE, &ciphertext_len,
+        payload, len,
+        rtp, PacketBuffer::RTP_HEADER_SIZE, // AAD = RTP header
+        nullptr,
+        nonce_bytes.data(),
+        key.data());
+
+    // Append 4-byte nonce counter at end
+    buf.size = PacketBuffer::RTP_HEADER_SIZE + static_cast<size_t>(ciphertext_len) + sizeof(uint32_t);
+    std::memcpy(rtp + buf.size - sizeof(uint32_t), &nonce, sizeof(uint32_t));
+    return true;
+}
+
+bool SealRTCPPacket(PacketBuffer &buf, uint32_t nonce, const std::array<uint8_t, 32> &key,
+                    const uint8_t *rtcp, size_t len) {
+    constexpr size_t RTCP_HEADER_SIZE = 8;
+    if (len < RTCP_HEADER_SIZE) return false;
+    if (len + PacketBuffer::TAG_SIZE + PacketBuffer::NONCE_SIZE > PacketBuffer::CAPACITY) return false;
+
+    uint8_t *out = buf.data.data();
+    std::memcpy(out, rtcp, RTCP_HEADER_SIZE);
+
+    std::array<uint8_t, crypto_aead_xchacha20poly1305_ietf_NPUBBYTES> nonce_bytes{};
+    std::memcpy(nonce_bytes.data(), &nonce, sizeof(uint32_t));
+
+    unsigned long long ciphertext_len;
+    crypto_aead_xchacha20poly1305_ietf_encrypt(
+        out + RTCP_HEADER_SIZE, &ciphertext_len,
+        rtcp + RTCP_HEADER_SIZE, len - RTCP_HEADER_SIZE,
+        out, RTCP_HEADER_SIZE, // AAD = RTCP header + sender SSRC
+        nullptr,
+        nonce_bytes.data(),
+        key.data());
+
+    buf.size = RTCP_HEADER_SIZE + static_cast<size_t>(ciphertext_len) + sizeof(uint32_t);
+    std::memcpy(out + buf.size - sizeof(uint32_t), &nonce, sizeof(uint32_t));
+    return true;
+}
+
+} // namespace dv
@@ -1,5 +1,6 @@
 #include "../include/udp_socket.h"
 #include <sodium.h>
+#include <algorithm>
 #include <cstring>
 #include <sstream>
 
@@ -86,46 +87,26 @@ void UDPSocket::SetSSRC(uint32_t ssrc) {
 
 void UDPSocket::SendEncrypted(const uint8_t *data, size_t len, uint32_t timestamp) {
     m_sequence++;
-    m_nonce++;
-
-    // Build RTP header (12 bytes) + encrypted payload + auth tag + 4-byte nonce
-    const size_t encrypted_size = len + crypto_aead_xchacha20poly1305_ietf_ABYTES;
-    std::vector<uint8_t> rtp(12 + encrypted_size + sizeof(uint32_t), 0);
-
-    // RTP header
-    rtp[0] = 0x80; // Version 2
-    rtp[1] = 0x78; // Payload type 120 (Opus)
-    rtp[2] = (m_sequence >> 8) & 0xFF;
-    rtp[3] = (m_sequence >> 0) & 0xFF;
-    rtp[4] = (timestamp >> 24) & 0xFF;
-    rtp[5] = (timestamp >> 16) & 0xFF;
-    rtp[6] = (timestamp >> 8) & 0xFF;
-    rtp[7] = (timestamp >> 0) & 0xFF;
-    rtp[8] = (m_ssrc >> 24) & 0xFF;
-    rtp[9] = (m_ssrc >> 16) & 0xFF;
-    rtp[10] = (m_ssrc >> 8) & 0xFF;
-    rtp[11] = (m_ssrc >> 0) & 0xFF;
-
-    // Nonce: 4-byte counter in first 4 bytes, rest zeroed
-    std::array<uint8_t, crypto_aead_xchacha20poly1305_ietf_NPUBBYTES> nonce_bytes{};
-    std::memcpy(nonce_bytes.data(), &m_nonce, sizeof(uint32_t));
-
-    // Encrypt with AEAD XChaCha20-Poly1305
-    // AAD = RTP header (12 bytes)
-    unsigned long long ciphertext_len;
-    crypto_aead_xchacha20poly1305_ietf_encrypt(
-        rtp.data() + 12, &ciphertext_len,
-        data, len,
-        rtp.data(), 12,  // AAD = RTP header
-        nullptr,
-        nonce_bytes.data(),
-        m_secret_key.data());
-
-    // Append 4-byte nonce counter at end
-    rtp.resize(12 + static_cast<size_t>(ciphertext_len) + sizeof(uint32_t));
-    std::memcpy(rtp.data() + rtp.size() - sizeof(uint32_t), &m_nonce, sizeof(uint32_t));
-
-    Send(rtp.data(), rtp.size());
+    const uint32_t nonce = ++m_nonce;
+
+    // RTP header (12 bytes) + encrypted payload + auth tag + 4-byte nonce, payload type 120 (Opus)
+    auto packet = m_pool.Acquire();
+    if (!SealRTPPacket(*packet, 0x78, m_sequence, timestamp, m_ssrc, nonce, m_secret_key, data, len)) {
+        Log(LOG_WARN, "Dropping oversized packet (" + std::to_string(len) + " bytes)");
+        return;
+    }
+
+    Send(packet->data.data(), packet->size);
+}
+
+void UDPSocket::SendEncryptedRTCP(const uint8_t *rtcp, size_t len) {
+    auto packet = m_pool.Acquire();
+    if (!SealRTCPPacket(*packet, ++m_nonce, m_secret_key, rtcp, len)) {
+        Log(LOG_WARN, "Dropping malformed RTCP packet (" + std::to_string(len) + " bytes)");
+        return;
+    }
+
+    Send(packet->data.data(), packet->size);
 }
 
 void UDPSocket::Send(const uint8_t *data, size_t len) {
@@ -133,6 +114,36 @@ void UDPSocket::Send(const uint8_t *data, size_t len) {
            reinterpret_cast<sockaddr *>(&m_server), sizeof(m_server));
 }
 
+void UDPSocket::SendBatch(const PacketPool::Ptr *packets, size_t count) {
+#ifdef __linux__
+    std::array<mmsghdr, SEND_BATCH> msgs;
+    std::array<iovec, SEND_BATCH> iovs;
+
+    while (count > 0) {
+        const size_t n = std::min(count, SEND_BATCH);
+        for (size_t i = 0; i < n; i++) {
+            iovs[i].iov_base = packets[i]->data.data();
+            iovs[i].iov_len = packets[i]->size;
+            std::memset(&msgs[i], 0, sizeof(mmsghdr));
+            msgs[i].msg_hdr.msg_name = &m_server;
+            msgs[i].msg_hdr.msg_namelen = sizeof(m_server);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int sent = sendmmsg(m_socket, msgs.data(), static_cast<unsigned int>(n), 0);
+        if (sent <= 0) return; // same as a failed sendto, UDP is best effort anyway
+
+        packets += sent;
+        count -= static_cast<size_t>(sent);
+    }
+#else
+    for (size_t i = 0; i < count; i++) {
+        Send(packets[i]->data.data(), packets[i]->size);
+    }
+#endif
+}
+
 std::vector<uint8_t> UDPSocket::Receive() {
     while (true) {
         sockaddr_in from;
@@ -168,14 +179,6 @@ void UDPSocket::SetLogCallback(LogCallback cb) {
 
 void UDPSocket::ReadThread() {
     while (m_running) {
-        uint8_t buf[4096];
-        sockaddr_in from;
-#ifdef _WIN32
-        int addrlen = sizeof(from);
-#else
-        socklen_t addrlen = sizeof(from);
-#endif
-
         // Use select with 1-second timeout so we can check m_running
         fd_set read_fds;
         FD_ZERO(&read_fds);
@@ -187,22 +190,69 @@ void UDPSocket::ReadThread() {
 
         int sel = select(static_cast<int>(m_socket + 1), &read_fds, nullptr, nullptr, &tv);
         if (sel > 0) {
-            int n = recvfrom(m_socket, reinterpret_cast<char *>(buf), sizeof(buf), 0,
-                             reinterpret_cast<sockaddr *>(&from), &addrlen);
-            if (n > 0) {
+            ReceiveBatch();
+        }
+    }
+}
+
+bool UDPSocket::IsFromServer(const sockaddr_in &from) const {
 #ifdef _WIN32
-                bool from_server = (from.sin_addr.S_un.S_addr == m_server.sin_addr.S_un.S_addr &&
-                                    from.sin_port == m_server.sin_port);
+    return from.sin_addr.S_un.S_addr == m_server.sin_addr.S_un.S_addr &&
+           from.sin_port == m_server.sin_port;
 #else
-                bool from_server = (from.sin_addr.s_addr == m_server.sin_addr.s_addr &&
-                                    from.sin_port == m_server.sin_port);
+    return from.sin_addr.s_addr == m_server.sin_addr.s_addr &&
+           from.sin_port == m_server.sin_port;
 #endif
-                if (from_server && m_data_callback) {
-                    m_data_callback({buf, buf + n});
-                }
-            }
+}
+
+// Drains up to RECV_BATCH datagrams per wakeup instead of one per select()
+void UDPSocket::ReceiveBatch() {
+#ifdef __linux__
+    std::array<mmsghdr, RECV_BATCH> msgs;
+    std::array<iovec, RECV_BATCH> iovs;
+    std::array<sockaddr_in, RECV_BATCH> addrs;
+
+    for (size_t i = 0; i < RECV_BATCH; i++) {
+        iovs[i].iov_base = m_recv_buffers[i].data();
+        iovs[i].iov_len = m_recv_buffers[i].size();
+        std::memset(&msgs[i], 0, sizeof(mmsghdr));
+        msgs[i].msg_hdr.msg_name = &addrs[i];
+        msgs[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        msgs[i].msg_hdr.msg_iov = &iovs[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int n = recvmmsg(m_socket, msgs.data(), RECV_BATCH, MSG_DONTWAIT, nullptr);
+    for (int i = 0; i < n; i++) {
+        if (msgs[i].msg_len > 0 && IsFromServer(addrs[i]) && m_data_callback) {
+            m_data_callback(m_recv_buffers[i].data(), msgs[i].msg_len);
         }
     }
+#else
+    auto &buf = m_recv_buffers[0];
+    for (size_t i = 0; i < RECV_BATCH; i++) {
+        sockaddr_in from;
+#ifdef _WIN32
+        int addrlen = sizeof(from);
+#else
+        socklen_t addrlen = sizeof(from);
+#endif
+        int n = recvfrom(m_socket, reinterpret_cast<char *>(buf.data()), static_cast<int>(buf.size()), 0,
+                         reinterpret_cast<sockaddr *>(&from), &addrlen);
+        if (n <= 0) break;
+
+        if (IsFromServer(from) && m_data_callback) {
+            m_data_callback(buf.data(), static_cast<size_t>(n));
+        }
+
+        // Anything else already queued?  Poll without waiting.
+        fd_set read_fds;
+        FD_ZERO(&read_fds);
+        FD_SET(m_socket, &read_fds);
+        timeval tv{0, 0};
+        if (select(static_cast<int>(m_socket + 1), &read_fds, nullptr, nullptr, &tv) <= 0) break;
+    }
+#endif
 }
 
 void UDPSocket::Log(int level, const std::string &msg) {
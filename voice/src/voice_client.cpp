@@ -16,8 +16,8 @@ VoiceClient::VoiceClient() {
         Log(LOG_ERROR, "sodium_init() failed");
     }
 
-    m_udp.SetDataCallback([this](const std::vector<uint8_t> &data) {
-        OnUDPData(data);
+    m_udp.SetDataCallback([this](const uint8_t *data, size_t len) {
+        OnUDPData(data, len);
     });
 }
 
@@ -411,14 +411,16 @@ static size_t GetPayloadOffset(const uint8_t *buf, size_t num_bytes) {
     return offset;
 }
 
-void VoiceClient::OnUDPData(const std::vector<uint8_t> &data) {
-    if (data.size() < 16) return; // Too small for RTP + any payload
+void VoiceClient::OnUDPData(const uint8_t *data, size_t len) {
+    if (len < 16) return; // Too small for RTP + any payload
 
+    uint16_t sequence = (data[2] << 8) | data[3];
+    uint32_t timestamp = (data[4] << 24) | (data[5] << 16) | (data[6] << 8) | data[7];
     uint32_t ssrc = (data[8] << 24) | (data[9] << 16) | (data[10] << 8) | data[11];
 
     // Extract 4-byte nonce from end, expand to 24-byte nonce
     std::array<uint8_t, 24> nonce{};
-    std::memcpy(nonce.data(), data.data() + data.size() - sizeof(uint32_t), sizeof(uint32_t));
+    std::memcpy(nonce.data(), data + len - sizeof(uint32_t), sizeof(uint32_t));
 
     const bool has_extension = (data[0] & 0b00010000) != 0;
     size_t ext_size = has_extension ? 4 : 0;
@@ -427,15 +429,17 @@ void VoiceClient::OnUDPData(const std::vector<uint8_t> &data) {
     unsigned long long mlen = 0;
     size_t aad_len = 12 + ext_size;
     size_t ciphertext_start = aad_len;
-    size_t ciphertext_len = data.size() - ciphertext_start - sizeof(uint32_t);
+    if (len < ciphertext_start + sizeof(uint32_t) + crypto_aead_xchacha20poly1305_ietf_ABYTES) return;
+    size_t ciphertext_len = len - ciphertext_start - sizeof(uint32_t);
+    if (ciphertext_len > m_decrypt_buffer.size()) return;
 
-    // We need a mutable buffer for in-place decryption
-    std::vector<uint8_t> decrypted(ciphertext_len);
+    // Decrypt into a reusable buffer, the read thread is the only caller
+    uint8_t *decrypted = m_decrypt_buffer.data();
 
     if (crypto_aead_xchacha20poly1305_ietf_decrypt(
-            decrypted.data(), &mlen, nullptr,
-            data.data() + ciphertext_start, ciphertext_len,
-            data.data(), aad_len,
+            decrypted, &mlen, nullptr,
+            data + ciphertext_start, ciphertext_len,
+            data, aad_len,
             nonce.data(), m_secret_key.data()) != 0) {
         // Decryption failed, silently ignore
         return;
@@ -443,11 +447,11 @@ void VoiceClient::OnUDPData(const std::vector<uint8_t> &data) {
 
     if (m_audio && mlen > 0) {
         // Find actual Opus payload offset (skip RTP extensions in decrypted data)
-        const auto opus_offset = GetPayloadOffset(data.data(), data.size()) - ciphertext_start;
+        const auto opus_offset = GetPayloadOffset(data, len) - ciphertext_start;
         if (opus_offset < mlen) {
-            m_audio->FeedMeOpus(ssrc, {decrypted.data() + opus_offset, decrypted.data() + mlen});
+            m_audio->FeedMeOpus(ssrc, sequence, timestamp, decrypted + opus_offset, static_cast<size_t>(mlen - opus_offset));
         } else {
-            m_audio->FeedMeOpus(ssrc, {decrypted.data(), decrypted.data() + mlen});
+            m_audio->FeedMeOpus(ssrc, sequence, timestamp, decrypted, static_cast<size_t>(mlen));
         }
     }
 }